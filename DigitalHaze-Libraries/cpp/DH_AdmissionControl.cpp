@@ -0,0 +1,357 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_AdmissionControl.cpp
+ * Author: phytress
+ *
+ * Created on October 19, 2026, 2:30 PM
+ */
+
+#include "DH_AdmissionControl.hpp"
+
+#include <time.h>
+#include <netinet/in.h>
+
+#include <cstring>
+
+// A token, in the billionths buckets count in
+#define ADMISSION_TOKEN 1000000000ULL
+
+// Nanoseconds at the resolution of the kernel's tick. Plenty for
+// rates, and a lot cheaper than asking the hardware.
+static uint64_t GetCoarseNanoseconds() {
+	timespec now;
+	if (0 != clock_gettime(CLOCK_MONOTONIC_COARSE, &now))
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+// Reads 8 bytes in network order
+static uint64_t ReadBigEndian64(const uint8_t* bytes) {
+	uint64_t value = 0;
+	for (int i = 0; i < 8; ++i)
+		value = (value << 8) | bytes[i];
+	return value;
+}
+
+// Turns an address into a key. Returns false if it's neither IPv4 nor IPv6.
+static bool AddressToKey(const sockaddr* addr, DigitalHaze::AdmissionKey& keyOut) {
+	if (!addr) return false;
+
+	switch (addr->sa_family) {
+		case AF_INET:
+			keyOut.high = 0;
+			keyOut.low = 0x0000FFFF00000000ULL
+					| ntohl(((const sockaddr_in*) addr)->sin_addr.s_addr);
+			return true;
+		case AF_INET6:
+		{
+			const uint8_t* bytes = ((const sockaddr_in6*) addr)->sin6_addr.s6_addr;
+			keyOut.high = ReadBigEndian64(bytes);
+			keyOut.low = ReadBigEndian64(bytes + 8);
+			return true;
+		}
+		default:
+			return false;
+	}
+}
+
+// The /24 of an IPv4 address, or the /64 of an IPv6 one
+static DigitalHaze::AdmissionKey PrefixOf(const DigitalHaze::AdmissionKey& key) {
+	DigitalHaze::AdmissionKey prefix = key;
+
+	if (!key.high && (key.low >> 32) == 0xFFFF)
+		prefix.low &= ~0xFFULL;
+	else
+		prefix.low = 0;
+
+	return prefix;
+}
+
+static void SetBucketRate(uint64_t& perNanosecond, uint64_t& capacity,
+		uint64_t& fillTime, uint32_t rate, uint32_t burst) {
+	// Tokens are billionths, so a rate per second is that many per ns
+	perNanosecond = rate;
+	if (!rate) {
+		capacity = fillTime = 0;
+		return;
+	}
+
+	capacity = (uint64_t) (burst ? burst : rate) * ADMISSION_TOKEN;
+	fillTime = capacity / rate;
+}
+
+DigitalHaze::AdmissionControl::AdmissionControl(const AdmissionLimits& limits,
+		size_t tableSize) : ThreadLockedObject() {
+	size_t capacity = DH_ADMISSION_PROBELIMIT;
+	while (capacity < tableSize) capacity <<= 1;
+
+	hosts.entries = new tableEntry[capacity];
+	hosts.mask = capacity - 1;
+	prefixes.entries = new tableEntry[capacity];
+	prefixes.mask = capacity - 1;
+	memset(hosts.entries, 0, sizeof (tableEntry) * capacity);
+	memset(prefixes.entries, 0, sizeof (tableEntry) * capacity);
+
+	// Keeps where an address lands from being predictable
+	hashSeed = GetCoarseNanoseconds() ^ (uint64_t) (size_t) this;
+
+	memset(&stats, 0, sizeof (stats));
+	SetLimits(limits);
+
+	globalBucket.tokens = globalRate.capacity;
+	globalBucket.stamp = GetCoarseNanoseconds();
+}
+
+DigitalHaze::AdmissionControl::~AdmissionControl() {
+	delete[] hosts.entries;
+	delete[] prefixes.entries;
+}
+
+// Adds what came in since the bucket was last topped up. Returns true
+// if it has a whole token, or has no rate.
+static bool TopUpBucket(uint64_t& tokens, uint64_t& stamp,
+		uint64_t perNanosecond, uint64_t capacity, uint64_t fillTime,
+		uint64_t now) {
+	if (!perNanosecond) return true;
+
+	uint64_t elapsed = now > stamp ? now - stamp : 0;
+
+	if (elapsed >= fillTime) tokens = capacity;
+	else {
+		tokens += elapsed * perNanosecond;
+		if (tokens > capacity) tokens = capacity;
+	}
+	stamp = now;
+
+	return tokens >= ADMISSION_TOKEN;
+}
+
+DigitalHaze::AdmissionDecision
+DigitalHaze::AdmissionControl::Admit(const sockaddr* addr, AdmissionTicket& ticketOut) {
+	AdmissionKey key, prefixKey;
+	bool hasKey = AddressToKey(addr, key);
+	if (hasKey) prefixKey = PrefixOf(key);
+
+	uint64_t now = GetCoarseNanoseconds();
+	AdmissionDecision decision = ADMIT_ACCEPTED;
+	tableEntry* host = nullptr;
+	tableEntry* prefix = nullptr;
+	uint8_t counted = 0;
+
+	LockObject();
+
+	if (hasKey && (hostRate.perNanosecond || currentLimits.maxHostConnections))
+		host = FindOrInsert(hosts, key, hostRate, now);
+	if (hasKey && (prefixRate.perNanosecond || currentLimits.maxPrefixConnections))
+		prefix = FindOrInsert(prefixes, prefixKey, prefixRate, now);
+
+	// Caps first, they don't cost tokens
+	if (host && currentLimits.maxHostConnections
+		&& host->connections >= currentLimits.maxHostConnections)
+		decision = ADMIT_HOSTCONNECTIONS;
+	else if (prefix && currentLimits.maxPrefixConnections
+		&& prefix->connections >= currentLimits.maxPrefixConnections)
+		decision = ADMIT_PREFIXCONNECTIONS;
+	else if (host && !TopUpBucket(host->bucket.tokens, host->bucket.stamp,
+		hostRate.perNanosecond, hostRate.capacity, hostRate.fillTime, now))
+		decision = ADMIT_HOSTRATE;
+	else if (prefix && !TopUpBucket(prefix->bucket.tokens, prefix->bucket.stamp,
+		prefixRate.perNanosecond, prefixRate.capacity, prefixRate.fillTime, now))
+		decision = ADMIT_PREFIXRATE;
+	else if (!TopUpBucket(globalBucket.tokens, globalBucket.stamp,
+		globalRate.perNanosecond, globalRate.capacity, globalRate.fillTime, now))
+		decision = ADMIT_GLOBALRATE;
+
+	if (decision == ADMIT_ACCEPTED) {
+		// Every bucket had a token, so take them
+		if (host && hostRate.perNanosecond) host->bucket.tokens -= ADMISSION_TOKEN;
+		if (prefix && prefixRate.perNanosecond) prefix->bucket.tokens -= ADMISSION_TOKEN;
+		if (globalRate.perNanosecond) globalBucket.tokens -= ADMISSION_TOKEN;
+
+		if (TracksConnections()) {
+			if (host) {
+				++host->connections;
+				counted |= ADMITCOUNTED_HOST;
+			}
+			if (prefix) {
+				++prefix->connections;
+				counted |= ADMITCOUNTED_PREFIX;
+			}
+		}
+	}
+
+	++stats.decisions[decision];
+	UnlockObject();
+
+	if (decision == ADMIT_ACCEPTED && counted)
+		ticketOut = AdmissionTicket(this, key, counted);
+	else
+		ticketOut.Release();
+
+	return decision;
+}
+
+void DigitalHaze::AdmissionControl::SetLimits(const AdmissionLimits& limits) {
+	LockObject();
+	currentLimits = limits;
+	SetBucketRate(hostRate.perNanosecond, hostRate.capacity, hostRate.fillTime,
+			limits.hostRate, limits.hostBurst);
+	SetBucketRate(prefixRate.perNanosecond, prefixRate.capacity, prefixRate.fillTime,
+			limits.prefixRate, limits.prefixBurst);
+	SetBucketRate(globalRate.perNanosecond, globalRate.capacity, globalRate.fillTime,
+			limits.globalRate, limits.globalBurst);
+	UnlockObject();
+}
+
+void DigitalHaze::AdmissionControl::GetLimits(AdmissionLimits& limitsOut) {
+	LockObject();
+	limitsOut = currentLimits;
+	UnlockObject();
+}
+
+void DigitalHaze::AdmissionControl::GetStats(AdmissionStats& statsOut) {
+	LockObject();
+	statsOut = stats;
+	UnlockObject();
+}
+
+void DigitalHaze::AdmissionControl::ResetStats() {
+	LockObject();
+	memset(&stats, 0, sizeof (stats));
+	UnlockObject();
+}
+
+DigitalHaze::AdmissionControl::tableEntry*
+DigitalHaze::AdmissionControl::FindOrInsert(admissionTable& table,
+		const AdmissionKey& key, const bucketRate& rate, uint64_t now) {
+	size_t start = HashKey(key);
+	tableEntry* victim = nullptr;
+
+	for (size_t i = 0; i < DH_ADMISSION_PROBELIMIT; ++i) {
+		tableEntry* entry = &table.entries[(start + i) & table.mask];
+
+		// Entries are replaced but never removed, so nothing is past
+		// an unused slot.
+		if (!entry->used) {
+			victim = entry;
+			break;
+		}
+
+		if (entry->key.high == key.high && entry->key.low == key.low)
+			return entry;
+
+		// Give up whichever idle entry was seen least recently
+		if (!entry->connections
+			&& (!victim || entry->bucket.stamp < victim->bucket.stamp))
+			victim = entry;
+	}
+
+	if (!victim) {
+		++stats.untracked;
+		return nullptr;
+	}
+
+	if (victim->used) ++stats.evictions;
+
+	victim->key = key;
+	victim->bucket.tokens = rate.capacity;
+	victim->bucket.stamp = now;
+	victim->connections = 0;
+	victim->used = true;
+	return victim;
+}
+
+DigitalHaze::AdmissionControl::tableEntry*
+DigitalHaze::AdmissionControl::Find(admissionTable& table, const AdmissionKey& key) {
+	size_t start = HashKey(key);
+
+	for (size_t i = 0; i < DH_ADMISSION_PROBELIMIT; ++i) {
+		tableEntry* entry = &table.entries[(start + i) & table.mask];
+
+		if (!entry->used) break;
+		if (entry->key.high == key.high && entry->key.low == key.low)
+			return entry;
+	}
+
+	return nullptr;
+}
+
+size_t DigitalHaze::AdmissionControl::HashKey(const AdmissionKey& key) const {
+	// Folds both halves together, then mixes (MurmurHash3's finalizer)
+	uint64_t hash = (key.high ^ hashSeed) * 0x9E3779B97F4A7C15ULL ^ key.low;
+
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ULL;
+	hash ^= hash >> 33;
+
+	return (size_t) hash;
+}
+
+void DigitalHaze::AdmissionControl::ReleaseConnection(const AdmissionKey& key,
+														uint8_t counted) {
+	LockObject();
+
+	// An entry we counted in holds open connections, so it's still ours
+	if (counted & ADMITCOUNTED_HOST) {
+		tableEntry* host = Find(hosts, key);
+		if (host && host->connections) --host->connections;
+	}
+
+	if (counted & ADMITCOUNTED_PREFIX) {
+		tableEntry* prefix = Find(prefixes, PrefixOf(key));
+		if (prefix && prefix->connections) --prefix->connections;
+	}
+
+	UnlockObject();
+}
+
+DigitalHaze::AdmissionTicket&
+DigitalHaze::AdmissionTicket::operator=(const AdmissionTicket&) {
+	// Copies are empty
+	Release();
+	return *this;
+}
+
+DigitalHaze::AdmissionTicket&
+DigitalHaze::AdmissionTicket::operator=(AdmissionTicket&& rhs) noexcept {
+	if (this != &rhs) {
+		Release();
+		owner = rhs.owner;
+		key = rhs.key;
+		counted = rhs.counted;
+		rhs.owner = nullptr;
+	}
+	return *this;
+}
+
+void DigitalHaze::AdmissionTicket::Release() {
+	if (!owner) return;
+
+	owner->ReleaseConnection(key, counted);
+	owner = nullptr;
+}
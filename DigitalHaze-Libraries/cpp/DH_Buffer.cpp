@@ -25,6 +25,7 @@
 #define _GNU_SOURCE
 
 #include "DH_Buffer.hpp"
+#include "DH_MemoryBudget.hpp"
 #include "DH_Common.hpp"
 
 #include <exception>
@@ -36,15 +37,18 @@
 #include <stdio.h>
 
 DigitalHaze::Buffer::Buffer(size_t sizeInBytes, size_t reallocSize, size_t maxSize)
-	: bufferSize(0), bufferMaxSize(maxSize), buffer(nullptr) {
+	: bufferSize(0), bufferMaxSize(maxSize), buffer(nullptr),
+	memoryBudget(nullptr) {
 	// Our recreate function will allocate us.
-	Recreate(sizeInBytes, reallocSize);
+	Recreate(sizeInBytes, reallocSize, maxSize);
 }
 
 DigitalHaze::Buffer::~Buffer() {
 	// Free any data
 	if (buffer != nullptr)
 		free(buffer);
+	if (memoryBudget)
+		memoryBudget->Release(bufferSize);
 }
 
 bool DigitalHaze::Buffer::Read(void* outBuffer, size_t len, size_t offset) {
@@ -125,11 +129,18 @@ void DigitalHaze::Buffer::NotifyWrite(size_t len) {
 }
 
 void DigitalHaze::Buffer::ExpandBuffer(size_t additionalBytes) {
+	if (!TryExpandBuffer(additionalBytes))
+		throw std::overflow_error("DigitalHaze::Buffer::ExpandBuffer cannot expand buffer past its memory budget.");
+}
+
+bool DigitalHaze::Buffer::TryExpandBuffer(size_t additionalBytes) {
 	if (!additionalBytes) additionalBytes = bufferReallocSize;
 	if (!additionalBytes)
 		throw std::invalid_argument("DigitalHaze::Buffer::ExpandBuffer cannot expand by 0");
 	if (bufferMaxSize && bufferSize + additionalBytes > bufferMaxSize)
 		throw std::overflow_error("DigitalHaze::Buffer::ExpandBuffer cannot expand buffer past max size.");
+	if (memoryBudget && !memoryBudget->TryCharge(additionalBytes))
+		return false;
 
 	bufferSize += additionalBytes;
 	buffer = realloc(buffer, bufferSize);
@@ -137,6 +148,36 @@ void DigitalHaze::Buffer::ExpandBuffer(size_t additionalBytes) {
 	if (!buffer) {
 		throw std::bad_alloc();
 	}
+
+	return true;
+}
+
+size_t DigitalHaze::Buffer::ShrinkBuffer(size_t newSize) {
+	if (newSize < bufferLen) newSize = bufferLen;
+	if (!newSize) newSize = 1;
+	if (!buffer || newSize >= bufferSize) return 0;
+
+	// If the smaller block can't be had, keep the one we have
+	void* shrunk = realloc(buffer, newSize);
+	if (!shrunk) return 0;
+
+	size_t freedBytes = bufferSize - newSize;
+	buffer = shrunk;
+	bufferSize = newSize;
+
+	if (memoryBudget)
+		memoryBudget->Release(freedBytes);
+	return freedBytes;
+}
+
+void DigitalHaze::Buffer::SetMemoryBudget(MemoryBudget* budget) {
+	if (budget == memoryBudget) return;
+
+	if (memoryBudget)
+		memoryBudget->Release(bufferSize);
+	memoryBudget = budget;
+	if (memoryBudget)
+		memoryBudget->Charge(bufferSize);
 }
 
 void DigitalHaze::Buffer::ExpandBufferAligned(size_t additionalBytes) {
@@ -256,11 +297,18 @@ void DigitalHaze::Buffer::Recreate(size_t newBufferSize, size_t newBufferRealloc
 		size_t maxSize) {
 	if (!newBufferSize)
 		throw std::bad_array_new_length();
-	if (maxSize && newBufferSize < maxSize)
+	if (maxSize && newBufferSize > maxSize)
 		throw std::invalid_argument("DigitalHaze::Buffer::Recreate newBufferSize is larger than maxSize");
 
 	// Reallocate only if we have to. If the size is the same, then don't bother.
 	if (newBufferSize != bufferSize) {
+		if (memoryBudget) {
+			if (newBufferSize < bufferSize)
+				memoryBudget->Release(bufferSize - newBufferSize);
+			else if (!memoryBudget->TryCharge(newBufferSize - bufferSize))
+				throw std::overflow_error("DigitalHaze::Buffer::Recreate cannot grow buffer past its memory budget.");
+		}
+
 		buffer = realloc(buffer, newBufferSize);
 
 		if (!buffer)
@@ -279,6 +327,10 @@ void* DigitalHaze::Buffer::ExportBuffer(size_t& bufLen, size_t& bufSize) {
 	bufLen = bufferLen;
 	bufSize = bufferSize;
 	
+	// The caller owns the memory now
+	if (memoryBudget)
+		memoryBudget->Release(bufferSize);
+
 	void* retVal = buffer;
 	
 	buffer = nullptr;
@@ -306,7 +358,8 @@ DigitalHaze::Buffer::Buffer(const Buffer& rhs)
 DigitalHaze::Buffer::Buffer(Buffer&& rhs) noexcept
 : bufferLen(rhs.bufferLen), bufferSize(rhs.bufferSize),
 bufferReallocSize(rhs.bufferReallocSize),
-bufferMaxSize(rhs.bufferMaxSize), buffer(rhs.buffer) {
+bufferMaxSize(rhs.bufferMaxSize), buffer(rhs.buffer),
+memoryBudget(rhs.memoryBudget) {
 	rhs.buffer = nullptr;
 	rhs.bufferSize = 0;
 	rhs.bufferLen = 0;
@@ -329,9 +382,12 @@ DigitalHaze::Buffer& DigitalHaze::Buffer::operator=(const Buffer& rhs) {
 DigitalHaze::Buffer& DigitalHaze::Buffer::operator=(Buffer&& rhs) noexcept {
 	if (buffer)
 		free(buffer);
+	if (memoryBudget)
+		memoryBudget->Release(bufferSize);
 
 	// Copy
 	buffer = rhs.buffer;
+	memoryBudget = rhs.memoryBudget;
 	bufferLen = rhs.bufferLen;
 	bufferSize = rhs.bufferSize;
 	bufferReallocSize = rhs.bufferReallocSize;
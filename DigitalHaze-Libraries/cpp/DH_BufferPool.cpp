@@ -0,0 +1,75 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "DH_BufferPool.hpp"
+
+#include <utility>
+
+DigitalHaze::BufferPool::BufferPool(size_t bufSize, size_t reallocSize,
+		size_t maxSize, size_t maxSpares)
+	: ThreadLockedObject(), bufferSize(bufSize), bufferReallocSize(reallocSize),
+	bufferMaxSize(maxSize), maxPooled(maxSpares) {
+	spareBuffers.reserve(maxPooled);
+}
+
+DigitalHaze::BufferPool::~BufferPool() {
+}
+
+void DigitalHaze::BufferPool::Acquire(Buffer& bufOut) {
+	LockObject();
+	if (!spareBuffers.empty()) {
+		bufOut = std::move(spareBuffers.back());
+		spareBuffers.pop_back();
+		UnlockObject();
+		return;
+	}
+	UnlockObject();
+
+	// Out of spares, so allocate outside of our lock
+	bufOut = Buffer(bufferSize, bufferReallocSize, bufferMaxSize);
+}
+
+void DigitalHaze::BufferPool::Release(Buffer&& buf) {
+	// An exported or moved-from buffer has nothing to give back
+	if (!buf.GetBufferStart()) return;
+
+	// Spares aren't anyone's memory
+	buf.SetMemoryBudget(nullptr);
+
+	// Shrink grown buffers back so spares don't pin large blocks.
+	// This also discards the data.
+	buf.Recreate(bufferSize, bufferReallocSize, bufferMaxSize);
+
+	LockObject();
+	if (spareBuffers.size() < maxPooled)
+		spareBuffers.push_back(std::move(buf));
+	UnlockObject();
+}
+
+size_t DigitalHaze::BufferPool::GetSpareCount() {
+	LockObject();
+	size_t spareCount = spareBuffers.size();
+	UnlockObject();
+	return spareCount;
+}
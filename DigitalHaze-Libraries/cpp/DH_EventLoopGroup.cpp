@@ -0,0 +1,372 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_EventLoopGroup.cpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 2:05 PM
+ */
+
+#include "DH_EventLoopGroup.hpp"
+
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstring>
+
+// Default handler behavior
+
+DigitalHaze::EventLoopHandler::~EventLoopHandler() {
+}
+
+void DigitalHaze::EventLoopHandler::OnShardStart(EventLoopShard& /*shard*/) {
+}
+
+bool DigitalHaze::EventLoopHandler::OnNewConnection(EventLoopShard& /*shard*/,
+		TCPSocket* /*pSocket*/, void** /*pParam*/) {
+	return true;
+}
+
+void DigitalHaze::EventLoopHandler::OnWritable(EventLoopShard& /*shard*/,
+		TCPSocket* pSocket, void* /*pParam*/) {
+	if (pSocket->GetEgressDataLen())
+		pSocket->PerformSocketWrite();
+}
+
+void DigitalHaze::EventLoopHandler::OnError(EventLoopShard& shard,
+		TCPSocket* pSocket, void* /*pParam*/) {
+	shard.CloseConnection(pSocket);
+}
+
+void DigitalHaze::EventLoopHandler::OnPollComplete(EventLoopShard& /*shard*/) {
+}
+
+void DigitalHaze::EventLoopHandler::OnShardStop(EventLoopShard& /*shard*/) {
+}
+
+// Shards
+
+DigitalHaze::EventLoopShard::EventLoopShard(EventLoopGroup* parentGroup,
+		size_t shardIndex, int shardCPU)
+	: group(parentGroup), index(shardIndex), cpu(shardCPU), pool(nullptr),
+	threadStarted(false), closedSinceCompact(0),
+	connectionsAccepted(0), connectionsRejected(0), connectionsClosed(0),
+	acceptErrors(0), pollIterations(0), readableEvents(0), writableEvents(0),
+	errorEvents(0), pollError(0) {
+}
+
+DigitalHaze::EventLoopShard::~EventLoopShard() {
+	CloseAllConnections();
+	delete pool;
+}
+
+void DigitalHaze::EventLoopShard::CloseConnection(TCPSocket* pSocket) {
+	SocketHandle handle = pool->GetSocketHandle(pSocket);
+	if (handle == DH_INVALID_SOCKETHANDLE) return;
+
+	pool->RemoveSocket(handle);
+	delete pSocket;
+	connectionsClosed.fetch_add(1, std::memory_order_relaxed);
+
+	// Don't let handles of closed connections pile up
+	if (++closedSinceCompact > connections.size() / 2) {
+		size_t kept = 0;
+		for (size_t i = 0; i < connections.size(); ++i) {
+			if (pool->IsValidHandle(connections[i]))
+				connections[kept++] = connections[i];
+		}
+		connections.resize(kept);
+		closedSinceCompact = 0;
+	}
+}
+
+void DigitalHaze::EventLoopShard::GetStats(EventLoopShardStats& statsOut) const {
+	statsOut.connectionsAccepted = connectionsAccepted.load(std::memory_order_relaxed);
+	statsOut.connectionsRejected = connectionsRejected.load(std::memory_order_relaxed);
+	statsOut.connectionsClosed = connectionsClosed.load(std::memory_order_relaxed);
+	statsOut.acceptErrors = acceptErrors.load(std::memory_order_relaxed);
+	statsOut.pollIterations = pollIterations.load(std::memory_order_relaxed);
+	statsOut.readableEvents = readableEvents.load(std::memory_order_relaxed);
+	statsOut.writableEvents = writableEvents.load(std::memory_order_relaxed);
+	statsOut.errorEvents = errorEvents.load(std::memory_order_relaxed);
+
+	// Both counters move independently, so don't go below zero
+	uint64_t opened = statsOut.connectionsAccepted - statsOut.connectionsRejected;
+	statsOut.activeConnections = opened > statsOut.connectionsClosed ?
+			opened - statsOut.connectionsClosed : 0;
+}
+
+void DigitalHaze::EventLoopShard::AdoptConnection(TCPSocket* pSocket) {
+	connectionsAccepted.fetch_add(1, std::memory_order_relaxed);
+
+	void* pParam = nullptr;
+	if (!group->handler->OnNewConnection(*this, pSocket, &pParam)) {
+		connectionsRejected.fetch_add(1, std::memory_order_relaxed);
+		delete pSocket;
+		return;
+	}
+
+	SocketHandle handle = pool->AddSocket(pSocket, pParam);
+	if (handle == DH_INVALID_SOCKETHANDLE) {
+		// Shouldn't happen with a fresh socket
+		connectionsRejected.fetch_add(1, std::memory_order_relaxed);
+		delete pSocket;
+		return;
+	}
+
+	connections.push_back(handle);
+}
+
+void DigitalHaze::EventLoopShard::CloseAllConnections() {
+	if (!pool) return;
+
+	for (size_t i = 0; i < connections.size(); ++i) {
+		Socket* pSocket = pool->GetSocket(connections[i]);
+		if (!pSocket) continue;
+
+		pool->RemoveSocket(connections[i]);
+		delete pSocket;
+		connectionsClosed.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	connections.clear();
+	closedSinceCompact = 0;
+}
+
+void DigitalHaze::EventLoopShard::Run() {
+	EventLoopHandler* handler = group->handler;
+	int pollTimeout = group->pollTimeout;
+
+	handler->OnShardStart(*this);
+
+	while (!group->stopRequested.load(std::memory_order_relaxed)) {
+		if (!pool->PollSockets(pollTimeout)) {
+			if (pool->GetLastError() == EINTR) continue;
+
+			// It would fail the same way again, so give up
+			pollError.store(pool->GetLastError(), std::memory_order_relaxed);
+			break;
+		}
+
+		pollIterations.fetch_add(1, std::memory_order_relaxed);
+
+		void* pParam;
+		Socket* pSocket;
+
+		// Connections the io_uring backend accepted for us
+		int newfd;
+		while ((newfd = pool->GetNextAcceptedFD()) != -1) {
+			if (TCPSocket* newSocket = listener.AdoptAcceptedFD(newfd))
+				AdoptConnection(newSocket);
+		}
+
+		while ((pSocket = pool->GetNextReadableSocket(&pParam))) {
+			if (pSocket == &listener) {
+				TCPSocket* newConnections[DH_EVENTLOOP_ACCEPTBATCH];
+				size_t acceptedCount = listener.AcceptConnections(newConnections,
+						DH_EVENTLOOP_ACCEPTBATCH);
+
+				for (size_t i = 0; i < acceptedCount; ++i)
+					AdoptConnection(newConnections[i]);
+
+				// Running out of connections isn't an error
+				if (!acceptedCount && listener.GetLastError() != EAGAIN &&
+						listener.GetLastError() != EWOULDBLOCK)
+					acceptErrors.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+
+			readableEvents.fetch_add(1, std::memory_order_relaxed);
+			handler->OnReadable(*this, static_cast<TCPSocket*> (pSocket), pParam);
+		}
+
+		while ((pSocket = pool->GetNextWritableSocket(&pParam))) {
+			writableEvents.fetch_add(1, std::memory_order_relaxed);
+			handler->OnWritable(*this, static_cast<TCPSocket*> (pSocket), pParam);
+		}
+
+		while ((pSocket = pool->GetNextErroredSocket(&pParam))) {
+			if (pSocket == &listener) {
+				acceptErrors.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+
+			errorEvents.fetch_add(1, std::memory_order_relaxed);
+			handler->OnError(*this, static_cast<TCPSocket*> (pSocket), pParam);
+		}
+
+		handler->OnPollComplete(*this);
+	}
+
+	handler->OnShardStop(*this);
+	CloseAllConnections();
+}
+
+void* DigitalHaze::EventLoopShardThread(void* data) {
+	EventLoopShard* shard = (EventLoopShard*) data;
+	shard->Run();
+	return nullptr;
+}
+
+// The group
+
+DigitalHaze::EventLoopGroup::EventLoopGroup(EventLoopHandler* handler,
+		size_t shardCount, SocketPoolBackend backend)
+	: handler(handler), requestedShards(shardCount), poolBackend(backend),
+	pollTimeout(DH_EVENTLOOP_POLLTIMEOUT), autoDrain(false),
+	running(false), stopRequested(false), lasterrno(0) {
+	// Default to the CPUs we're allowed on
+	cpu_set_t allowedCPUs;
+	CPU_ZERO(&allowedCPUs);
+
+	if (0 == sched_getaffinity(0, sizeof (allowedCPUs), &allowedCPUs)) {
+		for (int i = 0; i < CPU_SETSIZE; ++i) {
+			if (CPU_ISSET(i, &allowedCPUs))
+				cpus.push_back(i);
+		}
+	}
+}
+
+DigitalHaze::EventLoopGroup::~EventLoopGroup() {
+	Stop();
+	Join();
+	DestroyShards();
+}
+
+void DigitalHaze::EventLoopGroup::SetCPUs(const int* cpuList, size_t cpuCount) {
+	cpus.assign(cpuList, cpuList + cpuCount);
+}
+
+bool DigitalHaze::EventLoopGroup::Start(unsigned short port) {
+	if (running) return false;
+
+	DestroyShards();
+	stopRequested.store(false);
+
+	size_t shardCount = requestedShards;
+	if (!shardCount)
+		shardCount = cpus.empty() ? 1 : cpus.size();
+
+	// Every listener is created up front, so a port that can't be bound
+	// fails Start instead of a thread.
+	for (size_t i = 0; i < shardCount; ++i) {
+		int shardCPU = cpus.empty() ? -1 : cpus[i % cpus.size()];
+		EventLoopShard* shard = new EventLoopShard(this, i, shardCPU);
+		shards.push_back(shard);
+
+		shard->pool = new SocketPool(DH_SOCKETPOOL_DEFAULTSIZE,
+				DH_SOCKETPOOL_DEFAULTSIZE, poolBackend);
+		shard->pool->SetAutoDrain(autoDrain);
+
+		shard->listener.SetReusePort(true);
+		shard->listener.SetNonBlocking(true);
+		if (!shard->listener.CreateListener(port)) {
+			lasterrno = shard->listener.GetLastError();
+			DestroyShards();
+			return false;
+		}
+
+		shard->pool->AddPassiveSocket(&shard->listener);
+	}
+
+	running = true;
+
+	for (size_t i = 0; i < shards.size(); ++i) {
+		EventLoopShard* shard = shards[i];
+
+		pthread_attr_t threadAttr;
+		pthread_attr_init(&threadAttr);
+
+		if (shard->cpu >= 0) {
+			cpu_set_t shardCPUs;
+			CPU_ZERO(&shardCPUs);
+			CPU_SET(shard->cpu, &shardCPUs);
+			pthread_attr_setaffinity_np(&threadAttr, sizeof (shardCPUs), &shardCPUs);
+		}
+
+		int result = pthread_create(&shard->thread, &threadAttr,
+				DigitalHaze::EventLoopShardThread, (void*) shard);
+		pthread_attr_destroy(&threadAttr);
+
+		if (result != 0) {
+			lasterrno = result;
+			Stop();
+			Join();
+			DestroyShards();
+			return false;
+		}
+
+		shard->threadStarted = true;
+	}
+
+	return true;
+}
+
+void DigitalHaze::EventLoopGroup::Stop() {
+	stopRequested.store(true);
+
+	// Don't leave shards blocked until their poll times out
+	for (size_t i = 0; i < shards.size(); ++i) {
+		if (shards[i]->pool)
+			shards[i]->pool->Wake();
+	}
+}
+
+void DigitalHaze::EventLoopGroup::Join() {
+	for (size_t i = 0; i < shards.size(); ++i) {
+		if (!shards[i]->threadStarted) continue;
+
+		pthread_join(shards[i]->thread, nullptr);
+		shards[i]->threadStarted = false;
+	}
+
+	running = false;
+}
+
+void DigitalHaze::EventLoopGroup::GetTotalStats(EventLoopShardStats& statsOut) const {
+	memset(&statsOut, 0, sizeof (statsOut));
+
+	for (size_t i = 0; i < shards.size(); ++i) {
+		EventLoopShardStats shardStats;
+		shards[i]->GetStats(shardStats);
+
+		statsOut.connectionsAccepted += shardStats.connectionsAccepted;
+		statsOut.connectionsRejected += shardStats.connectionsRejected;
+		statsOut.connectionsClosed += shardStats.connectionsClosed;
+		statsOut.activeConnections += shardStats.activeConnections;
+		statsOut.acceptErrors += shardStats.acceptErrors;
+		statsOut.pollIterations += shardStats.pollIterations;
+		statsOut.readableEvents += shardStats.readableEvents;
+		statsOut.writableEvents += shardStats.writableEvents;
+		statsOut.errorEvents += shardStats.errorEvents;
+	}
+}
+
+void DigitalHaze::EventLoopGroup::DestroyShards() {
+	for (size_t i = 0; i < shards.size(); ++i)
+		delete shards[i];
+	shards.clear();
+}
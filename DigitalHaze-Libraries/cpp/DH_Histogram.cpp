@@ -0,0 +1,130 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "DH_Histogram.hpp"
+
+#include <stdexcept>
+
+DigitalHaze::Histogram::Histogram(unsigned int precision)
+	: precisionBits(precision), totalCount(0), minValue(UINT64_MAX),
+	maxValue(0), valueSum(0) {
+	if (!precisionBits || precisionBits > 16)
+		throw std::invalid_argument("DigitalHaze::Histogram precision must be between 1 and 16 bits");
+
+	// One linear group for values below 2^precisionBits, and one group
+	// for every power of two above it.
+	counts.resize((size_t) (64 - precisionBits + 1) << precisionBits, 0);
+}
+
+DigitalHaze::Histogram::~Histogram() {
+}
+
+void DigitalHaze::Histogram::Record(uint64_t value, uint64_t count) {
+	if (!count) return;
+
+	counts[GetBucketIndex(value)] += count;
+	totalCount += count;
+	valueSum += value * count;
+
+	if (value < minValue) minValue = value;
+	if (value > maxValue) maxValue = value;
+}
+
+void DigitalHaze::Histogram::Merge(const Histogram& other) {
+	if (other.precisionBits != precisionBits)
+		throw std::invalid_argument("DigitalHaze::Histogram::Merge histograms differ in precision");
+
+	if (!other.totalCount) return;
+
+	for (size_t i = 0; i < counts.size(); ++i)
+		counts[i] += other.counts[i];
+
+	totalCount += other.totalCount;
+	valueSum += other.valueSum;
+
+	if (other.minValue < minValue) minValue = other.minValue;
+	if (other.maxValue > maxValue) maxValue = other.maxValue;
+}
+
+void DigitalHaze::Histogram::Reset() {
+	for (size_t i = 0; i < counts.size(); ++i)
+		counts[i] = 0;
+
+	totalCount = 0;
+	minValue = UINT64_MAX;
+	maxValue = 0;
+	valueSum = 0;
+}
+
+uint64_t DigitalHaze::Histogram::GetPercentile(double percentile) const {
+	if (!totalCount) return 0;
+
+	if (percentile < 0.0) percentile = 0.0;
+	if (percentile > 100.0) percentile = 100.0;
+
+	// The number of values that must be at or below our answer
+	uint64_t targetCount = (uint64_t) ((percentile / 100.0) * (double) totalCount + 0.5);
+	if (!targetCount) targetCount = 1;
+
+	uint64_t runningCount = 0;
+	for (size_t i = 0; i < counts.size(); ++i) {
+		runningCount += counts[i];
+		if (runningCount >= targetCount) {
+			uint64_t value = GetBucketHighestValue(i);
+			// Don't report past what we've actually seen
+			return value > maxValue ? maxValue : value;
+		}
+	}
+
+	return maxValue;
+}
+
+size_t DigitalHaze::Histogram::GetBucketIndex(uint64_t value) const {
+	// Small values are kept exactly in the first group
+	if (value < ((uint64_t) 1 << precisionBits))
+		return (size_t) value;
+
+	// Position of the highest set bit decides the group. The bits
+	// right under it decide the bucket inside the group.
+	unsigned int highestBit = 63 - (unsigned int) __builtin_clzll(value);
+	unsigned int shift = highestBit - precisionBits;
+
+	size_t group = (size_t) shift + 1;
+	size_t subBucket = (size_t) (value >> shift) - ((size_t) 1 << precisionBits);
+
+	return (group << precisionBits) + subBucket;
+}
+
+uint64_t DigitalHaze::Histogram::GetBucketHighestValue(size_t index) const {
+	size_t group = index >> precisionBits;
+	size_t subBucket = index & (((size_t) 1 << precisionBits) - 1);
+
+	if (!group)
+		return (uint64_t) subBucket;
+
+	unsigned int shift = (unsigned int) group - 1;
+	uint64_t lowestValue = ((uint64_t) subBucket + ((uint64_t) 1 << precisionBits)) << shift;
+
+	return lowestValue + (((uint64_t) 1 << shift) - 1);
+}
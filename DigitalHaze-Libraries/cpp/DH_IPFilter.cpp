@@ -0,0 +1,88 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_IPFilter.cpp
+ * Author: phytress
+ *
+ * Created on October 19, 2026, 4:10 PM
+ */
+
+#include "DH_IPFilter.hpp"
+
+#include <sched.h>
+
+DigitalHaze::IPFilter::IPFilter(IPFilterAction defaultAction)
+	: ThreadLockedObject(), currentTable(nullptr),
+	defaultAllows(defaultAction != IPFILTER_DENY), generation(0),
+	allowedCount(0), deniedCount(0) {
+	readers[0].count.store(0, std::memory_order_relaxed);
+	readers[1].count.store(0, std::memory_order_relaxed);
+}
+
+DigitalHaze::IPFilter::~IPFilter() {
+	delete currentTable.load(std::memory_order_relaxed);
+}
+
+void DigitalHaze::IPFilter::SetTable(IPPrefixTable* table) {
+	// One replacement at a time
+	LockObject();
+
+	IPPrefixTable* oldTable = currentTable.exchange(table, std::memory_order_seq_cst);
+
+	// Lookups that register from here on see the new table. Wait out
+	// those registered in either generation before the exchange.
+	for (int pass = 0; pass < 2; ++pass) {
+		unsigned int oldGeneration = generation.fetch_add(1, std::memory_order_seq_cst);
+
+		while (readers[oldGeneration & 1].count.load(std::memory_order_seq_cst))
+			sched_yield();
+	}
+
+	UnlockObject();
+
+	delete oldTable;
+}
+
+bool DigitalHaze::IPFilter::IsAllowed(const sockaddr* addr) {
+	readerCount& registered = readers[generation.load(std::memory_order_seq_cst) & 1];
+	registered.count.fetch_add(1, std::memory_order_seq_cst);
+
+	// Registered before loading, so SetTable can't delete this under us
+	const IPPrefixTable* table = currentTable.load(std::memory_order_seq_cst);
+	uint32_t action = table ? table->Lookup(addr) : (uint32_t) IPFILTER_DEFAULT;
+
+	registered.count.fetch_sub(1, std::memory_order_release);
+
+	bool allowed;
+	if (action == IPFILTER_DEFAULT)
+		allowed = defaultAllows.load(std::memory_order_relaxed);
+	else
+		allowed = action != IPFILTER_DENY;
+
+	if (allowed) allowedCount.fetch_add(1, std::memory_order_relaxed);
+	else deniedCount.fetch_add(1, std::memory_order_relaxed);
+
+	return allowed;
+}
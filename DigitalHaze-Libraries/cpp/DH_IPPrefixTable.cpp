@@ -0,0 +1,366 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_IPPrefixTable.cpp
+ * Author: phytress
+ *
+ * Created on October 19, 2026, 4:10 PM
+ */
+
+#include "DH_IPPrefixTable.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdlib.h>
+
+// Bits of the address each trie node takes
+#define PREFIXTABLE_STRIDE 6
+
+// Bits of the address the direct arrays take
+#define PREFIXTABLE_DIRECTBITS 16
+
+// Marks a direct entry as a leaf
+#define PREFIXTABLE_DIRECTLEAF 0x80000000U
+
+// Reads 8 bytes in network order
+static uint64_t ReadBigEndian64(const uint8_t* bytes) {
+	uint64_t value = 0;
+	for (int i = 0; i < 8; ++i)
+		value = (value << 8) | bytes[i];
+	return value;
+}
+
+// The 6 bits of an address starting offset bits in. Bits past the
+// end read as zero.
+static inline unsigned int ExtractBits(uint64_t high, uint64_t low, unsigned int offset) {
+	if (offset <= 58) return (unsigned int) (high >> (58 - offset)) & 63;
+	if (offset < 64)
+		return (unsigned int) ((high << (offset - 58)) | (low >> (122 - offset))) & 63;
+
+	offset -= 64;
+	if (offset <= 58) return (unsigned int) (low >> (58 - offset)) & 63;
+	return (unsigned int) (low << (offset - 58)) & 63;
+}
+
+// Bits set in value up to and including bit
+static inline unsigned int CountThrough(uint64_t value, unsigned int bit) {
+	// 2 << 63 is 0, and 0 - 1 keeps every bit
+	return (unsigned int) __builtin_popcountll(value & ((2ULL << bit) - 1));
+}
+
+DigitalHaze::IPPrefixList::IPPrefixList() {
+}
+
+DigitalHaze::IPPrefixList::~IPPrefixList() {
+}
+
+bool DigitalHaze::IPPrefixList::AddPrefix(const char* cidr, uint32_t value) {
+	char addrText[INET6_ADDRSTRLEN];
+	const char* slash = strchr(cidr, '/');
+	size_t addrLen = slash ? (size_t) (slash - cidr) : strlen(cidr);
+	long length = -1;
+
+	if (!addrLen || addrLen >= sizeof (addrText)) return false;
+	memcpy(addrText, cidr, addrLen);
+	addrText[addrLen] = 0;
+
+	if (slash) {
+		char* lengthEnd;
+		length = strtol(slash + 1, &lengthEnd, 10);
+		if (lengthEnd == slash + 1 || *lengthEnd || length < 0) return false;
+	}
+
+	if (strchr(addrText, ':')) {
+		in6_addr addr6;
+		if (1 != inet_pton(AF_INET6, addrText, &addr6)) return false;
+		if (length > 128) return false;
+
+		AddIPv6Prefix(addr6.s6_addr, length < 0 ? 128 : (unsigned int) length, value);
+		return true;
+	}
+
+	in_addr addr4;
+	if (1 != inet_pton(AF_INET, addrText, &addr4)) return false;
+	if (length > 32) return false;
+
+	AddIPv4Prefix(ntohl(addr4.s_addr), length < 0 ? 32 : (unsigned int) length, value);
+	return true;
+}
+
+void DigitalHaze::IPPrefixList::AddIPv4Prefix(uint32_t addr, unsigned int length,
+		uint32_t value) {
+	if (length > 32) length = 32;
+
+	prefixEntry entry;
+	entry.high = length ? ((uint64_t) addr << 32) & (~0ULL << (64 - length)) : 0;
+	entry.low = 0;
+	entry.value = value;
+	entry.length = (uint8_t) length;
+	ipv4Prefixes.push_back(entry);
+}
+
+void DigitalHaze::IPPrefixList::AddIPv6Prefix(const uint8_t* addr, unsigned int length,
+		uint32_t value) {
+	if (length > 128) length = 128;
+
+	prefixEntry entry;
+	entry.high = ReadBigEndian64(addr);
+	entry.low = ReadBigEndian64(addr + 8);
+
+	if (length <= 64) {
+		entry.high &= length ? ~0ULL << (64 - length) : 0;
+		entry.low = 0;
+	} else if (length < 128)
+		entry.low &= ~0ULL << (128 - length);
+
+	entry.value = value;
+	entry.length = (uint8_t) length;
+	ipv6Prefixes.push_back(entry);
+}
+
+void DigitalHaze::IPPrefixList::Reserve(size_t prefixCount) {
+	ipv4Prefixes.reserve(prefixCount);
+	ipv6Prefixes.reserve(prefixCount);
+}
+
+void DigitalHaze::IPPrefixList::Clear() {
+	ipv4Prefixes.clear();
+	ipv6Prefixes.clear();
+}
+
+DigitalHaze::IPPrefixTable::IPPrefixTable(const IPPrefixList& list)
+	: prefixCount(list.GetPrefixCount()) {
+	std::vector<prefixEntry> prefixes;
+
+	prefixes = list.ipv4Prefixes;
+	CompileDirect(prefixes, ipv4Direct);
+	prefixes = list.ipv6Prefixes;
+	CompileDirect(prefixes, ipv6Direct);
+
+	nodes.shrink_to_fit();
+	leaves.shrink_to_fit();
+}
+
+DigitalHaze::IPPrefixTable::~IPPrefixTable() {
+}
+
+uint32_t DigitalHaze::IPPrefixTable::Lookup(const sockaddr* addr) const {
+	switch (addr->sa_family) {
+		case AF_INET:
+			return LookupIPv4(ntohl(((const sockaddr_in*) addr)->sin_addr.s_addr));
+		case AF_INET6:
+			return LookupIPv6(((const sockaddr_in6*) addr)->sin6_addr.s6_addr);
+		default:
+			return 0;
+	}
+}
+
+uint32_t DigitalHaze::IPPrefixTable::LookupIPv4(uint32_t addr) const {
+	return LookupBits(ipv4Direct, (uint64_t) addr << 32, 0);
+}
+
+uint32_t DigitalHaze::IPPrefixTable::LookupIPv6(const uint8_t* addr) const {
+	uint64_t high = ReadBigEndian64(addr);
+	uint64_t low = ReadBigEndian64(addr + 8);
+
+	// ::ffff:a.b.c.d is an IPv4 address
+	if (!high && (low >> 32) == 0xFFFF)
+		return LookupIPv4((uint32_t) low);
+
+	return LookupBits(ipv6Direct, high, low);
+}
+
+size_t DigitalHaze::IPPrefixTable::GetMemoryUsage() const {
+	return (ipv4Direct.size() + ipv6Direct.size() + leaves.size()) * sizeof (uint32_t)
+			+ nodes.size() * sizeof (trieNode);
+}
+
+uint32_t DigitalHaze::IPPrefixTable::LookupBits(const std::vector<uint32_t>& direct,
+		uint64_t high, uint64_t low) const {
+	uint32_t entry = direct[high >> (64 - PREFIXTABLE_DIRECTBITS)];
+	if (entry & PREFIXTABLE_DIRECTLEAF)
+		return leaves[entry & ~PREFIXTABLE_DIRECTLEAF];
+
+	const trieNode* node = &nodes[entry];
+	unsigned int offset = PREFIXTABLE_DIRECTBITS;
+	unsigned int slot = ExtractBits(high, low, offset);
+
+	while (node->childBits & (1ULL << slot)) {
+		node = &nodes[node->childBase + CountThrough(node->childBits, slot) - 1];
+		offset += PREFIXTABLE_STRIDE;
+		slot = ExtractBits(high, low, offset);
+	}
+
+	return leaves[node->leafBase + CountThrough(node->leafBits, slot) - 1];
+}
+
+void DigitalHaze::IPPrefixTable::CompileDirect(std::vector<prefixEntry>& prefixes,
+		std::vector<uint32_t>& directOut) {
+	const size_t directSize = (size_t) 1 << PREFIXTABLE_DIRECTBITS;
+	std::vector<uint32_t> values(directSize, 0);
+	std::vector<size_t> shortPrefixes;
+
+	// In address order, prefixes sharing a node's bits are next to each
+	// other. Equal ones keep the order they were added in.
+	std::stable_sort(prefixes.begin(), prefixes.end(),
+			[](const prefixEntry& lhs, const prefixEntry& rhs) {
+				if (lhs.high != rhs.high) return lhs.high < rhs.high;
+				if (lhs.low != rhs.low) return lhs.low < rhs.low;
+				return lhs.length < rhs.length;
+			});
+
+	// Spread prefixes that end in the direct array over it, longer ones
+	// over shorter ones
+	for (size_t i = 0; i < prefixes.size(); ++i)
+		if (prefixes[i].length <= PREFIXTABLE_DIRECTBITS)
+			shortPrefixes.push_back(i);
+
+	std::stable_sort(shortPrefixes.begin(), shortPrefixes.end(),
+			[&prefixes](size_t lhs, size_t rhs) {
+				return prefixes[lhs].length < prefixes[rhs].length;
+			});
+
+	for (size_t i = 0; i < shortPrefixes.size(); ++i) {
+		const prefixEntry& prefix = prefixes[shortPrefixes[i]];
+		size_t first = (size_t) (prefix.high >> (64 - PREFIXTABLE_DIRECTBITS));
+		size_t count = (size_t) 1 << (PREFIXTABLE_DIRECTBITS - prefix.length);
+
+		for (size_t index = first; index < first + count; ++index)
+			values[index] = prefix.value;
+	}
+
+	// Longer prefixes get a trie under their entry. The rest of the
+	// entries are leaves, shared by runs of equal values.
+	directOut.resize(directSize);
+	size_t begin = 0;
+
+	for (size_t index = 0; index < directSize; ++index) {
+		size_t end = begin;
+		bool needsNode = false;
+
+		while (end < prefixes.size()
+			&& (size_t) (prefixes[end].high >> (64 - PREFIXTABLE_DIRECTBITS)) == index) {
+			if (prefixes[end].length > PREFIXTABLE_DIRECTBITS) needsNode = true;
+			++end;
+		}
+
+		if (needsNode) {
+			directOut[index] = (uint32_t) nodes.size();
+			nodes.resize(nodes.size() + 1);
+			CompileNode(prefixes, begin, end, PREFIXTABLE_DIRECTBITS,
+					values[index], directOut[index]);
+		} else if (index && (directOut[index - 1] & PREFIXTABLE_DIRECTLEAF)
+			&& leaves[directOut[index - 1] & ~PREFIXTABLE_DIRECTLEAF] == values[index])
+			directOut[index] = directOut[index - 1];
+		else {
+			directOut[index] = (uint32_t) leaves.size() | PREFIXTABLE_DIRECTLEAF;
+			leaves.push_back(values[index]);
+		}
+
+		begin = end;
+	}
+}
+
+void DigitalHaze::IPPrefixTable::CompileNode(const std::vector<prefixEntry>& prefixes,
+		size_t begin, size_t end, unsigned int offset, uint32_t inherited,
+		size_t nodeIndex) {
+	const unsigned int nextOffset = offset + PREFIXTABLE_STRIDE;
+	uint32_t slots[64];
+	uint64_t childBits = 0;
+	std::vector<size_t> endingHere;
+
+	for (unsigned int i = 0; i < 64; ++i)
+		slots[i] = inherited;
+
+	for (size_t i = begin; i < end; ++i) {
+		const prefixEntry& prefix = prefixes[i];
+
+		if (prefix.length <= offset) continue; // An ancestor's
+		if (prefix.length <= nextOffset) endingHere.push_back(i);
+		else childBits |= 1ULL << ExtractBits(prefix.high, prefix.low, offset);
+	}
+
+	// Longer prefixes are laid over shorter ones
+	std::stable_sort(endingHere.begin(), endingHere.end(),
+			[&prefixes](size_t lhs, size_t rhs) {
+				return prefixes[lhs].length < prefixes[rhs].length;
+			});
+
+	for (size_t i = 0; i < endingHere.size(); ++i) {
+		const prefixEntry& prefix = prefixes[endingHere[i]];
+		unsigned int first = ExtractBits(prefix.high, prefix.low, offset);
+		unsigned int count = 1U << (nextOffset - prefix.length);
+
+		for (unsigned int slot = first; slot < first + count; ++slot)
+			slots[slot] = prefix.value;
+	}
+
+	// Leaves are stored once per run of equal values
+	uint32_t leafBase = (uint32_t) leaves.size();
+	uint64_t leafBits = 0;
+	bool anyLeaf = false;
+
+	for (unsigned int slot = 0; slot < 64; ++slot) {
+		if (childBits & (1ULL << slot)) continue;
+
+		if (!anyLeaf || slots[slot] != leaves.back()) {
+			leafBits |= 1ULL << slot;
+			leaves.push_back(slots[slot]);
+			anyLeaf = true;
+		}
+	}
+
+	// Children are in one block, in slot order
+	uint32_t childBase = (uint32_t) nodes.size();
+	nodes.resize(nodes.size() + (size_t) __builtin_popcountll(childBits));
+
+	trieNode& node = nodes[nodeIndex];
+	node.childBits = childBits;
+	node.leafBits = leafBits;
+	node.leafBase = leafBase;
+	node.childBase = childBase;
+
+	// Hand each child the prefixes under its slot
+	size_t childIndex = childBase;
+	size_t i = begin;
+
+	while (childBits) {
+		unsigned int slot = (unsigned int) __builtin_ctzll(childBits);
+		childBits &= childBits - 1;
+
+		while (i < end && ExtractBits(prefixes[i].high, prefixes[i].low, offset) < slot)
+			++i;
+		size_t childEnd = i;
+		while (childEnd < end
+			&& ExtractBits(prefixes[childEnd].high, prefixes[childEnd].low, offset) == slot)
+			++childEnd;
+
+		CompileNode(prefixes, i, childEnd, nextOffset, slots[slot], childIndex++);
+		i = childEnd;
+	}
+}
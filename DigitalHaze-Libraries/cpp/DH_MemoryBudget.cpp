@@ -0,0 +1,99 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_MemoryBudget.cpp
+ * Author: phytress
+ *
+ * Created on October 19, 2026, 9:10 AM
+ */
+
+#include "DH_MemoryBudget.hpp"
+
+// Without overflowing on large limits
+static inline size_t PercentOf(size_t bytes, size_t percent) {
+	return bytes / 100 * percent + bytes % 100 * percent / 100;
+}
+
+DigitalHaze::MemoryBudget::MemoryBudget(size_t limitBytes)
+	: limit(limitBytes),
+	highWatermark(PercentOf(limitBytes, DH_MEMORYBUDGET_HIGHPERCENT)),
+	lowWatermark(PercentOf(limitBytes, DH_MEMORYBUDGET_LOWPERCENT)),
+	used(0), peak(0), refusedCharges(0), refusedBytes(0) {
+}
+
+DigitalHaze::MemoryBudget::~MemoryBudget() {
+}
+
+bool DigitalHaze::MemoryBudget::TryCharge(size_t bytes) {
+	size_t nowUsed = used.load(std::memory_order_relaxed);
+
+	do {
+		if (bytes > limit || nowUsed > limit - bytes) {
+			refusedCharges.fetch_add(1, std::memory_order_relaxed);
+			refusedBytes.fetch_add(bytes, std::memory_order_relaxed);
+			return false;
+		}
+	} while (!used.compare_exchange_weak(nowUsed, nowUsed + bytes,
+			std::memory_order_relaxed));
+
+	UpdatePeak(nowUsed + bytes);
+	return true;
+}
+
+void DigitalHaze::MemoryBudget::Charge(size_t bytes) {
+	UpdatePeak(used.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+void DigitalHaze::MemoryBudget::Release(size_t bytes) {
+	used.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void DigitalHaze::MemoryBudget::SetWatermarks(size_t highBytes, size_t lowBytes) {
+	if (highBytes > limit) highBytes = limit;
+	if (lowBytes > highBytes) lowBytes = highBytes;
+
+	highWatermark = highBytes;
+	lowWatermark = lowBytes;
+}
+
+void DigitalHaze::MemoryBudget::GetStats(MemoryBudgetStats& statsOut) const {
+	statsOut.limit = limit;
+	statsOut.used = used.load(std::memory_order_relaxed);
+	statsOut.peak = peak.load(std::memory_order_relaxed);
+	statsOut.refusedCharges = refusedCharges.load(std::memory_order_relaxed);
+	statsOut.refusedBytes = refusedBytes.load(std::memory_order_relaxed);
+}
+
+void DigitalHaze::MemoryBudget::ResetStats() {
+	peak.store(used.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	refusedCharges.store(0, std::memory_order_relaxed);
+	refusedBytes.store(0, std::memory_order_relaxed);
+}
+
+void DigitalHaze::MemoryBudget::UpdatePeak(size_t nowUsed) {
+	size_t oldPeak = peak.load(std::memory_order_relaxed);
+	while (oldPeak < nowUsed &&
+			!peak.compare_exchange_weak(oldPeak, nowUsed, std::memory_order_relaxed));
+}
@@ -25,9 +25,11 @@
 #define _GNU_SOURCE
 
 #include "DH_Socket.hpp"
+#include "DH_SocketPool.hpp"
 
 #include <errno.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <utility>
 
 #include <string>
@@ -59,16 +61,71 @@ void DigitalHaze::Socket::RecordErrno(int specificerrno) {
 
 DigitalHaze::IOSocket::IOSocket() : Socket(),
 	readBuffer(DHSOCKETBUFSIZE, DHSOCKETBUFRESIZE),
-	writeBuffer(DHSOCKETBUFSIZE, DHSOCKETBUFRESIZE) {
+	writeBuffer(DHSOCKETBUFSIZE, DHSOCKETBUFRESIZE),
+	directReadThreshold(DHSOCKETDIRECTREADSIZE), bufferPool(nullptr),
+	memoryBudget(nullptr), ownerPool(nullptr), ownerHandle(0) {
 }
 
 DigitalHaze::IOSocket::~IOSocket() {
+	// Don't leave our pool with a dangling pointer
+	if (ownerPool)
+		ownerPool->RemoveSocket((SocketHandle) ownerHandle);
+}
+
+void DigitalHaze::IOSocket::NotifyOwnerPool() {
+	ownerPool->MarkEgressDirty((SocketHandle) ownerHandle);
 }
 
 bool DigitalHaze::IOSocket::Read(void* outBuffer, size_t len) {
-	if (!Peek(outBuffer, len))
+	size_t bufferedLen = readBuffer.GetBufferDataLen();
+
+	// If we have enough data, or are missing only a little,
+	// then go through our buffer.
+	if (len <= bufferedLen || !directReadThreshold
+		|| len - bufferedLen < directReadThreshold) {
+		if (!Peek(outBuffer, len))
+			return false;
+		readBuffer.ShiftBufferFromFront(len);
+		return true;
+	}
+
+	// Receive what we're missing straight into the caller's memory,
+	// right after where our buffered data will go.
+	void* directPtr = (void*) ((size_t) outBuffer + bufferedLen);
+	size_t bytesRead;
+
+	if (!PerformDirectRead(directPtr, len - bufferedLen, bytesRead)) {
+		// Error! Keep what we did get after our buffered data,
+		// as if it went through our buffer in the first place.
+		if (bytesRead)
+			readBuffer.Write(directPtr, bytesRead);
 		return false;
-	readBuffer.ShiftBufferFromFront(len);
+	}
+
+	// Now fill in the front with what we had buffered
+	return readBuffer.Read(outBuffer, bufferedLen);
+}
+
+bool DigitalHaze::IOSocket::PerformDirectRead(void* outBuffer, size_t len,
+		size_t& bytesRead) {
+	bytesRead = 0;
+
+	while (bytesRead < len) {
+		ssize_t nBytes = recv(Socket::sockfd,
+				(void*) ((size_t) outBuffer + bytesRead),
+				len - bytesRead, MSG_WAITALL);
+
+		if (nBytes <= 0) {
+			// A signal can cut MSG_WAITALL short
+			if (nBytes == -1 && errno == EINTR)
+				continue;
+			Socket::RecordErrno();
+			return false;
+		}
+
+		bytesRead += (size_t) nBytes;
+	}
+
 	return true;
 }
 
@@ -88,8 +145,90 @@ bool DigitalHaze::IOSocket::Peek(void* outBuffer, size_t len) {
 	return readBuffer.Peek(outBuffer, len);
 }
 
+bool DigitalHaze::IOSocket::DetachMessage(size_t messageLen, Buffer& messageOut) {
+	size_t bufferedLen = readBuffer.GetBufferDataLen();
+
+	if (!messageLen || messageLen > bufferedLen)
+		return false;
+
+	// Bytes that belong to whatever comes after this message
+	size_t trailingLen = bufferedLen - messageLen;
+
+	Buffer replacement(std::move(readBuffer));
+	AcquireBuffer(readBuffer);
+
+	if (trailingLen > messageLen) {
+		// Cheaper to copy the message out and keep our buffer
+		std::swap(readBuffer, replacement);
+		messageOut = std::move(replacement);
+		messageOut.Write(readBuffer.GetBufferStart(), messageLen);
+		readBuffer.ShiftBufferFromFront(messageLen);
+		return true;
+	}
+
+	// Move the start of the next message to our fresh buffer,
+	// then cut it off the end of the message we hand over.
+	if (trailingLen) {
+		readBuffer.Write((void*) ((size_t) replacement.GetBufferStart() + messageLen),
+				trailingLen);
+		replacement.ShiftBufferAtOffset(trailingLen, messageLen);
+	}
+
+	messageOut = std::move(replacement);
+	return true;
+}
+
+void* DigitalHaze::IOSocket::DetachMessageBlock(size_t messageLen, size_t& blockSize) {
+	// There's no way to construct an empty Buffer without allocating,
+	// but a moved-from Buffer is empty. Move our read buffer through
+	// a temporary and back to get one.
+	Buffer message(std::move(readBuffer));
+	readBuffer = std::move(message);
+
+	if (!DetachMessage(messageLen, message))
+		return nullptr;
+
+	size_t dataLen;
+	return message.ExportBuffer(dataLen, blockSize);
+}
+
+void DigitalHaze::IOSocket::AcquireBuffer(Buffer& bufOut) {
+	if (bufferPool)
+		bufferPool->Acquire(bufOut);
+	else
+		bufOut = Buffer(DHSOCKETBUFSIZE, DHSOCKETBUFRESIZE);
+
+	bufOut.SetMemoryBudget(memoryBudget);
+}
+
+void DigitalHaze::IOSocket::SetMemoryBudget(MemoryBudget* budget) {
+	memoryBudget = budget;
+	readBuffer.SetMemoryBudget(budget);
+	writeBuffer.SetMemoryBudget(budget);
+}
+
+void DigitalHaze::IOSocket::ResetForReuse() {
+	if (ownerPool) {
+		ownerPool->RemoveSocket((SocketHandle) ownerHandle);
+		ownerPool = nullptr;
+	}
+
+	// Discards our data too
+	CloseSocket();
+	lasterrno = 0;
+
+	SetMemoryBudget(nullptr);
+	readBuffer.ShrinkBuffer(DHSOCKETBUFSIZE);
+	writeBuffer.ShrinkBuffer(DHSOCKETBUFSIZE);
+
+	directReadThreshold = DHSOCKETDIRECTREADSIZE;
+	bufferPool = nullptr;
+}
+
 void DigitalHaze::IOSocket::Write(void* inBuffer, size_t len) {
+	bool hadEgress = GetEgressDataLen() != 0;
 	writeBuffer.Write(inBuffer, len);
+	NotifyEgressChange(hadEgress);
 }
 
 size_t DigitalHaze::IOSocket::WriteString(const char* fmtStr, ...) {
@@ -117,8 +256,10 @@ void DigitalHaze::IOSocket::CloseSocket() {
 
 	// We can keep our buffers allocated (until destructed), but
 	// we need to tell them that theres no need to keep the old data.
+	bool hadEgress = GetEgressDataLen() != 0;
 	readBuffer.ShiftBufferFromFront(readBuffer.GetBufferDataLen());
 	writeBuffer.ShiftBufferFromFront(writeBuffer.GetBufferDataLen());
+	NotifyEgressChange(hadEgress);
 }
 
 // copy
@@ -159,12 +300,18 @@ DigitalHaze::Socket& DigitalHaze::Socket::operator=(Socket&& rhs) noexcept {
 }
 
 DigitalHaze::IOSocket::IOSocket(const IOSocket& rhs)
-	: Socket(rhs), readBuffer(rhs.readBuffer), writeBuffer(rhs.writeBuffer) {
+	: Socket(rhs), readBuffer(rhs.readBuffer), writeBuffer(rhs.writeBuffer),
+	directReadThreshold(rhs.directReadThreshold), bufferPool(rhs.bufferPool),
+	memoryBudget(nullptr), ownerPool(nullptr), ownerHandle(0) {
 }
 
 DigitalHaze::IOSocket::IOSocket(IOSocket&& rhs) noexcept
 : Socket(rhs),
-readBuffer(std::move(rhs.readBuffer)), writeBuffer(std::move(rhs.writeBuffer)) {
+readBuffer(std::move(rhs.readBuffer)), writeBuffer(std::move(rhs.writeBuffer)),
+directReadThreshold(rhs.directReadThreshold), bufferPool(rhs.bufferPool),
+memoryBudget(rhs.memoryBudget), ownerPool(nullptr), ownerHandle(0) {
+	// Pools stay with the object they were given
+	rhs.NotifyEgressChange(GetEgressDataLen() != 0);
 }
 
 DigitalHaze::IOSocket& DigitalHaze::IOSocket::operator=(const IOSocket& rhs) {
@@ -172,8 +319,12 @@ DigitalHaze::IOSocket& DigitalHaze::IOSocket::operator=(const IOSocket& rhs) {
 	Socket::operator=(rhs);
 
 	// copy buffers
+	bool hadEgress = GetEgressDataLen() != 0;
 	readBuffer = rhs.readBuffer;
 	writeBuffer = rhs.writeBuffer;
+	directReadThreshold = rhs.directReadThreshold;
+	bufferPool = rhs.bufferPool;
+	NotifyEgressChange(hadEgress);
 	return *this;
 }
 
@@ -182,8 +333,15 @@ DigitalHaze::IOSocket& DigitalHaze::IOSocket::operator=(IOSocket&& rhs) noexcept
 	Socket::operator=(rhs);
 
 	// move buffers
+	bool hadEgress = GetEgressDataLen() != 0;
+	bool rhsHadEgress = rhs.GetEgressDataLen() != 0;
 	readBuffer = std::move(rhs.readBuffer);
 	writeBuffer = std::move(rhs.writeBuffer);
+	directReadThreshold = rhs.directReadThreshold;
+	bufferPool = rhs.bufferPool;
+	memoryBudget = rhs.memoryBudget;
+	NotifyEgressChange(hadEgress);
+	rhs.NotifyEgressChange(rhsHadEgress);
 
 	return *this;
 }
\ No newline at end of file
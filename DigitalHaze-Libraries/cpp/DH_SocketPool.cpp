@@ -23,70 +23,624 @@
  */
 
 #include "DH_SocketPool.hpp"
+#include "DH_TCPSocket.hpp"
+
+#include "DH_Common.hpp"
 
 #include <sys/poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
+// Milliseconds on a clock that never jumps
+static uint64_t GetMonotonicMilliseconds() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+// The same clock in nanoseconds, for timing short spins
+static uint64_t GetMonotonicNanoseconds() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+// The same clock, at the resolution of the kernel's tick. It's read
+// without asking the hardware, which makes it a lot cheaper.
+static uint64_t GetCoarseMilliseconds() {
+	timespec now;
+	if (0 != clock_gettime(CLOCK_MONOTONIC_COARSE, &now))
+		return GetMonotonicMilliseconds();
+	return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+// How far the coarse clock can lag behind, in whole milliseconds
+static uint64_t GetCoarseResolution() {
+	static uint64_t resolution = 0;
+
+	if (!resolution) {
+		timespec res;
+		if (0 != clock_getres(CLOCK_MONOTONIC_COARSE, &res)) res.tv_nsec = 0;
+		resolution = (uint64_t) (res.tv_nsec + 999999) / 1000000 + 1;
+	}
+
+	return resolution;
+}
+
+// Makes room for len more bytes in a socket's buffer, if its memory
+// budget allows.
+static bool ReserveBufferSpace(DigitalHaze::Buffer& buf, size_t len) {
+	size_t remaining = buf.GetRemainingBufferLength();
+	if (len <= remaining) return true;
+
+	return buf.TryExpandBuffer(len - remaining);
+}
+
+// What epoll tells us our wake eventfd with. It can't be a socket's
+// handle, since slot indexes never reach UINT32_MAX.
+#define WAKEEVENTHANDLE UINT64_MAX
+
+// Older headers don't know these
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+DigitalHaze::SocketEventHandler::~SocketEventHandler() {
+}
+
+void DigitalHaze::SocketEventHandler::OnWritable(SocketPool& /*pool*/,
+		SocketHandle /*handle*/, IOSocket* /*pSocket*/, void* /*pParam*/) {
+}
+
+void DigitalHaze::SocketEventHandler::OnError(SocketPool& /*pool*/,
+		SocketHandle /*handle*/, Socket* /*pSocket*/, void* /*pParam*/) {
+}
+
+void DigitalHaze::SocketEventHandler::OnIdleTimeout(SocketPool& /*pool*/,
+		SocketHandle /*handle*/, Socket* /*pSocket*/, void* /*pParam*/) {
+}
+
 DigitalHaze::SocketPool::SocketPool(size_t defaultPoolSize,
-		size_t expandSlotSize)
-	: ThreadLockedObject(),
+		size_t expandSlotSize, SocketPoolBackend pollBackend)
+	: ThreadLockedObject(), backend(pollBackend), autoDrain(false), lasterrno(0),
+	budgetBytes(0), budgetReads(0), drainIteration(0),
+	freeSlotHead(UINT32_MAX), socketCount(0),
 	pollfdsBuffer(sizeof (pollfd) * (defaultPoolSize ? defaultPoolSize : DH_SOCKETPOOL_DEFAULTSIZE),
 	sizeof (pollfd) * expandSlotSize),
-	readListIndex(0), writeListIndex(0), errorListIndex(0) {
+	wakefd(-1), wakePending(false),
+	epollfd(-1),
+	epollEventsBuffer(sizeof (epoll_event) * (defaultPoolSize ? defaultPoolSize : DH_SOCKETPOOL_DEFAULTSIZE),
+	sizeof (epoll_event) * expandSlotSize),
+	uring(nullptr),
+	readListIndex(0), writeListIndex(0), errorListIndex(0),
+	timedOutListIndex(0), timers(GetCoarseMilliseconds()),
+	cachedTime(timers.GetCurrentTime()),
+	busyPollSpin(0), busyPollCurrentSpin(0), socketBusyPoll(0),
+	preferBusyPoll(false), pollEventCount(0),
+	loopStatsEnabled(false), lastPollEnd(0), pollBlockedTime(0),
+	pollReadable(0), pollWritable(0), pollErrors(0),
+	memoryBudget(nullptr), memoryPolicies(MEMPOLICY_NONE),
+	memoryPressured(false), acceptsPaused(false),
+	tcpInfoInterval(0), tcpInfoSocketsPerSample(0), tcpInfoCursor(0),
+	tcpInfoNextSample(0) {
+	memset(&memoryPolicyStats, 0, sizeof (memoryPolicyStats));
+	ResetTCPInfoStats();
+	ResetBusyPollStats();
+	ResetLoopStats();
+
+	slots.reserve(defaultPoolSize ? defaultPoolSize : DH_SOCKETPOOL_DEFAULTSIZE);
+
+	// Older kernels get the next best thing
+	if (backend == SOCKETPOOL_IOURING && !InitIOUring())
+		backend = SOCKETPOOL_EPOLL;
+
+	if (backend == SOCKETPOOL_EPOLL) {
+		epollfd = epoll_create1(EPOLL_CLOEXEC);
+
+		if (epollfd == -1 && pollBackend == SOCKETPOOL_IOURING) {
+			backend = SOCKETPOOL_POLL;
+		} else if (epollfd == -1) {
+			throw std::runtime_error(
+					stringprintf("DigitalHaze::SocketPool could not create epoll instance: %s",
+					strerror(errno)));
+		}
+	}
+
+	wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakefd == -1) {
+		int wakeErrno = errno;
+		if (uring) DestroyIOUring();
+		if (epollfd != -1) close(epollfd);
+		throw std::runtime_error(
+				stringprintf("DigitalHaze::SocketPool could not create eventfd: %s",
+				strerror(wakeErrno)));
+	}
+
+	// The poll backend adds it to every poll, and io_uring arms it on
+	// the first poll.
+	if (backend == SOCKETPOOL_EPOLL) {
+		epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u64 = WAKEEVENTHANDLE;
+		epoll_ctl(epollfd, EPOLL_CTL_ADD, wakefd, &ev);
+	}
 }
 
 DigitalHaze::SocketPool::~SocketPool() {
+	// Our sockets may outlive us
+	for (size_t i = 0; i < slots.size(); ++i) {
+		if (!slots[i].inUse || slots[i].entry.passiveSocket) continue;
+
+		IOSocket* sockio = static_cast<IOSocket*> (slots[i].entry.pSocket);
+		if (sockio->ownerPool == this) sockio->ownerPool = nullptr;
+		if (memoryBudget && sockio->GetMemoryBudget() == memoryBudget)
+			sockio->SetMemoryBudget(nullptr);
+	}
+
+	// Posted data that never made it out
+	poolCommand command;
+	while (commands.Pop(command))
+		delete command.data;
+
+	if (uring)
+		DestroyIOUring();
+	if (epollfd != -1)
+		close(epollfd);
+	if (wakefd != -1)
+		close(wakefd);
 }
 
-void DigitalHaze::SocketPool::AddSocket(IOSocket* ptrSocket, void* ptrParam) {
+DigitalHaze::SocketHandle
+DigitalHaze::SocketPool::AddSocket(IOSocket* ptrSocket, void* ptrParam,
+		SocketEventHandler* handler) {
 	// Irresponsible value?
-	if (!ptrSocket) return;
-	// Duplicate?
-	if (-1 != GetListIndexFromFD(ptrSocket->sockfd)) return;
+	if (!ptrSocket || ptrSocket->sockfd == -1) return DH_INVALID_SOCKETHANDLE;
 
 	socketEntry entry;
 	entry.pSocket = ptrSocket;
 	entry.pParam = ptrParam;
+	entry.handler = handler;
 	entry.passiveSocket = false;
 
-	sockList.push_back(entry);
-	AddSocketToPollList(ptrSocket->sockfd);
+	return AddEntry(entry);
 }
 
-void DigitalHaze::SocketPool::AddPassiveSocket(Socket* ptrSocket, void* ptrParam) {
-	if (!ptrSocket) return; // Bad pointer?
-	if (-1 != GetListIndexFromFD(ptrSocket->sockfd)) return; // Duplicate?
+DigitalHaze::SocketHandle
+DigitalHaze::SocketPool::AddPassiveSocket(Socket* ptrSocket, void* ptrParam,
+		SocketEventHandler* handler) {
+	// Bad pointer?
+	if (!ptrSocket || ptrSocket->sockfd == -1) return DH_INVALID_SOCKETHANDLE;
 
 	socketEntry entry;
 	entry.pSocket = ptrSocket;
 	entry.pParam = ptrParam;
+	entry.handler = handler;
 	entry.passiveSocket = true;
 
-	sockList.push_back(entry);
-	AddSocketToPollList(ptrSocket->sockfd);
+	return AddEntry(entry);
+}
+
+DigitalHaze::SocketHandle
+DigitalHaze::SocketPool::AddEntry(socketEntry& entry) {
+	int sockfd = entry.pSocket->sockfd;
+	uint32_t existingSlot = GetSlotIndexFromFD(sockfd);
+
+	if (existingSlot != UINT32_MAX) {
+		// Duplicate?
+		if (slots[existingSlot].entry.pSocket == entry.pSocket)
+			return DH_INVALID_SOCKETHANDLE;
+
+		// Two open sockets can't share a file descriptor, so the socket
+		// we have was closed (or moved from) and the kernel gave its
+		// descriptor to this one. Forget the old socket.
+		RemoveSlot(existingSlot);
+	}
+
+	// Find a slot for the socket
+	uint32_t slotIndex;
+	if (freeSlotHead != UINT32_MAX) {
+		slotIndex = freeSlotHead;
+		freeSlotHead = slots[slotIndex].nextFreeSlot;
+	} else {
+		if (slots.size() >= UINT32_MAX - 1)
+			throw std::overflow_error("DigitalHaze::SocketPool ran out of slots");
+
+		socketSlot newSlot;
+		newSlot.generation = 1;
+		newSlot.inUse = false;
+		slots.push_back(newSlot);
+		slotIndex = (uint32_t) (slots.size() - 1);
+	}
+
+	socketSlot& slot = slots[slotIndex];
+	slot.entry = entry;
+	// Listeners added while accepts are paused start out paused
+	slot.readPaused = entry.passiveSocket && acceptsPaused;
+	slot.memoryEvicted = false;
+	slot.entry.pollEvents = GetEpollEvents(entry, false, !slot.readPaused);
+	slot.sockfd = sockfd;
+	slot.pollIndex = UINT32_MAX;
+	slot.nextFreeSlot = UINT32_MAX;
+	slot.idleTimeout = 0;
+	slot.lastActivity = cachedTime;
+	slot.idleTimer = DH_INVALID_TIMERHANDLE;
+	slot.drainIteration = drainIteration;
+	slot.carriedOver = false;
+	slot.egressDirty = false;
+	slot.watchWritable = false;
+
+	if (socketBusyPoll > 0 || preferBusyPoll)
+		ApplyBusyPollOptions(sockfd);
+
+	SocketHandle handle = MakeHandle(slotIndex);
+
+	if (backend == SOCKETPOOL_EPOLL) {
+		epoll_event ev;
+		ev.events = slot.entry.pollEvents;
+		// The handle comes back with every event, so events from a socket
+		// that was removed in the meantime can be recognized.
+		ev.data.u64 = handle;
+
+		if (0 != epoll_ctl(epollfd, EPOLL_CTL_ADD, sockfd, &ev)) {
+			// Give the slot back
+			slot.nextFreeSlot = freeSlotHead;
+			freeSlotHead = slotIndex;
+
+			throw std::runtime_error(
+					stringprintf("DigitalHaze::SocketPool could not add fd %d to epoll: %s",
+					sockfd, strerror(errno)));
+		}
+
+		// Keep room to hear about every socket in one wakeup
+		if (epollEventsBuffer.GetBufferSize() < sizeof (epoll_event) * (socketCount + 1))
+			epollEventsBuffer.ExpandBufferAligned(sizeof (epoll_event));
+	} else if (backend == SOCKETPOOL_POLL)
+		AddSocketToPollList(slotIndex);
+
+	slot.inUse = true;
+	++socketCount;
+
+	// Operations start with our next poll
+	if (backend == SOCKETPOOL_IOURING)
+		IOUringAddSlot(slotIndex);
+
+	// Remember where this fd lives in our list
+	if ((size_t) sockfd >= fdSlotTable.size())
+		fdSlotTable.resize((size_t) sockfd + 1, UINT32_MAX);
+	fdSlotTable[sockfd] = slotIndex;
+
+	// From now on the socket tells us when its write buffer changes
+	if (!entry.passiveSocket) {
+		IOSocket* sockio = static_cast<IOSocket*> (entry.pSocket);
+		sockio->ownerPool = this;
+		sockio->ownerHandle = handle;
+
+		if (sockio->GetEgressDataLen())
+			MarkEgressDirty(handle);
+		if (sockio->GetIngressDataLen())
+			bufferedIngress.push_back(handle);
+
+		// Leave a budget of its own alone
+		if (memoryBudget && !sockio->GetMemoryBudget())
+			sockio->SetMemoryBudget(memoryBudget);
+	} else if (slot.readPaused)
+		memoryPausedSockets.push_back(handle);
+
+	return handle;
 }
 
 bool DigitalHaze::SocketPool::RemoveSocket(Socket* pSocket) {
-	// Erase from our pollfds list, if we haven't already
-	if (!RemoveSocketFromPollList(pSocket->sockfd)) {
+	SocketHandle handle = GetSocketHandle(pSocket);
+
+	if (handle == DH_INVALID_SOCKETHANDLE) {
 		// This wasn't on our poll list??
 		throw std::logic_error("Error socket not in fd list");
 	}
 
-	size_t temp = 0;
-	if (RemoveSocketFromVector(pSocket, sockList, temp)) {
-		// We found the socket in the main vector.
-		// We can remove it from our write, read, and error list if it is
-		// in them.
-		RemoveSocketFromVector(pSocket, readList, readListIndex);
-		RemoveSocketFromVector(pSocket, writeList, writeListIndex);
-		RemoveSocketFromVector(pSocket, errorList, errorListIndex);
+	RemoveSlot((uint32_t) (handle & 0xFFFFFFFF));
+	return true;
+}
 
-		return true;
+bool DigitalHaze::SocketPool::RemoveSocket(SocketHandle handle) {
+	if (!GetSlotFromHandle(handle)) return false;
+
+	RemoveSlot((uint32_t) (handle & 0xFFFFFFFF));
+	return true;
+}
+
+void DigitalHaze::SocketPool::RemoveSlot(uint32_t slotIndex) {
+	socketSlot& slot = slots[slotIndex];
+
+	if (backend == SOCKETPOOL_EPOLL) {
+		// If the socket was already closed, the kernel already forgot it
+		epoll_ctl(epollfd, EPOLL_CTL_DEL, slot.sockfd, nullptr);
+	} else if (backend == SOCKETPOOL_IOURING) {
+		IOUringRemoveSlot(slotIndex);
+	} else RemoveSocketFromPollList(slotIndex);
+
+	if (GetSlotIndexFromFD(slot.sockfd) == slotIndex)
+		fdSlotTable[slot.sockfd] = UINT32_MAX;
+
+	if (!slot.entry.passiveSocket) {
+		IOSocket* sockio = static_cast<IOSocket*> (slot.entry.pSocket);
+		if (sockio->ownerPool == this && sockio->ownerHandle == MakeHandle(slotIndex))
+			sockio->ownerPool = nullptr;
+		if (memoryBudget && sockio->GetMemoryBudget() == memoryBudget)
+			sockio->SetMemoryBudget(nullptr);
+	}
+
+	if (slot.idleTimer != DH_INVALID_TIMERHANDLE) {
+		timers.CancelTimer(slot.idleTimer);
+		slot.idleTimer = DH_INVALID_TIMERHANDLE;
+	}
+
+	// Our read, write, and error lists may still hold this slot's handle.
+	// Bumping the generation makes those entries skip themselves.
+	slot.inUse = false;
+	if (++slot.generation == 0)
+		slot.generation = 1; // Handles are never zero
+	slot.entry.pSocket = nullptr;
+	slot.entry.pParam = nullptr;
+	slot.entry.handler = nullptr;
+	slot.sockfd = -1;
+
+	slot.nextFreeSlot = freeSlotHead;
+	freeSlotHead = slotIndex;
+	--socketCount;
+}
+
+DigitalHaze::Socket*
+DigitalHaze::SocketPool::GetSocket(SocketHandle handle, void** pParam) const {
+	const socketSlot* slot = GetSlotFromHandle(handle);
+	if (!slot) return nullptr;
+
+	if (pParam) *pParam = slot->entry.pParam;
+	return slot->entry.pSocket;
+}
+
+bool DigitalHaze::SocketPool::SetSocketHandler(SocketHandle handle,
+		SocketEventHandler* handler) {
+	if (!GetSlotFromHandle(handle)) return false;
+
+	slots[(uint32_t) (handle & 0xFFFFFFFF)].entry.handler = handler;
+	return true;
+}
+
+bool DigitalHaze::SocketPool::SetWatchWritable(SocketHandle handle, bool enable) {
+	const socketSlot* slot = GetSlotFromHandle(handle);
+	if (!slot || slot->entry.passiveSocket) return false;
+
+	slots[(uint32_t) (handle & 0xFFFFFFFF)].watchWritable = enable;
+	// Our backend picks it up like a change in the write buffer
+	MarkEgressDirty(handle);
+	return true;
+}
+
+void DigitalHaze::SocketPool::SetMemoryBudget(MemoryBudget* budget,
+		unsigned policies) {
+	memoryPolicies = policies;
+	if (budget == memoryBudget) return;
+
+	// Nothing we paused for the old budget should stay paused
+	ReleaseMemoryPressure();
+
+	for (uint32_t i = 0; i < slots.size(); ++i) {
+		if (!slots[i].inUse || slots[i].entry.passiveSocket) continue;
+
+		IOSocket* sockio = static_cast<IOSocket*> (slots[i].entry.pSocket);
+		MemoryBudget* socketBudget = sockio->GetMemoryBudget();
+
+		// Leave a budget of its own alone
+		if (!socketBudget || socketBudget == memoryBudget)
+			sockio->SetMemoryBudget(budget);
+	}
+
+	memoryBudget = budget;
+}
+
+void DigitalHaze::SocketPool::SetReadPaused(uint32_t slotIndex, bool paused) {
+	socketSlot& slot = slots[slotIndex];
+	if (slot.readPaused == paused) return;
+	slot.readPaused = paused;
+
+	SocketHandle handle = MakeHandle(slotIndex);
+
+	if (backend == SOCKETPOOL_EPOLL) {
+		bool wantWrite = slot.watchWritable;
+		if (!slot.entry.passiveSocket) {
+			IOSocket* sockio = static_cast<IOSocket*> (slot.entry.pSocket);
+			wantWrite = wantWrite || sockio->GetEgressDataLen();
+		}
+
+		epoll_event ev;
+		ev.events = GetEpollEvents(slot.entry, wantWrite, !paused);
+		ev.data.u64 = handle;
+
+		if (0 == epoll_ctl(epollfd, EPOLL_CTL_MOD, slot.sockfd, &ev))
+			slot.entry.pollEvents = ev.events;
+	} else if (backend == SOCKETPOOL_IOURING) {
+		IOUringSetReadPaused(slotIndex, paused);
+	} else {
+		pollfd* fdptr = (pollfd*) pollfdsBuffer.GetBufferStart() + slot.pollIndex;
+		if (paused) fdptr->events &= ~POLLIN;
+		else fdptr->events |= POLLIN;
+	}
+}
+
+void DigitalHaze::SocketPool::ApplyMemoryPolicy() {
+	size_t used = memoryBudget->GetUsed();
+
+	if (!memoryPressured) {
+		if (used < memoryBudget->GetHighWatermark()) return;
+
+		memoryPressured = true;
+		++memoryPolicyStats.pressureEvents;
+	} else if (used <= memoryBudget->GetLowWatermark()) {
+		ReleaseMemoryPressure();
+		return;
+	}
+
+	++memoryPolicyStats.pressuredPolls;
+
+	// Memory nobody needs right now goes first
+	memoryPolicyStats.trimmedBytes += TrimSocketBuffers();
+
+	used = memoryBudget->GetUsed();
+	size_t highWatermark = memoryBudget->GetHighWatermark();
+	if (used < highWatermark) return;
+
+	if ((memoryPolicies & MEMPOLICY_REFUSEACCEPTS) && !acceptsPaused) {
+		acceptsPaused = true;
+		++memoryPolicyStats.acceptPauses;
+
+		for (uint32_t i = 0; i < slots.size(); ++i) {
+			if (!slots[i].inUse || !slots[i].entry.passiveSocket ||
+					slots[i].readPaused) continue;
+
+			SetReadPaused(i, true);
+			memoryPausedSockets.push_back(MakeHandle(i));
+		}
+	}
+
+	if (memoryPolicies & MEMPOLICY_PAUSEREADS) {
+		// Stop the biggest consumers until what they hold would take us
+		// down to the low watermark.
+		size_t toCover = used - memoryBudget->GetLowWatermark();
+		size_t covered = 0;
+
+		FindMemoryCandidates(false);
+		for (size_t i = 0; i < memoryCandidates.size() && covered < toCover; ++i) {
+			uint32_t slotIndex = memoryCandidates[i].second;
+
+			PauseForMemory(slotIndex);
+			covered += memoryCandidates[i].first;
+		}
+	}
+
+	// Evicting is a last resort, for when even growth we already allowed
+	// would be refused.
+	size_t limit = memoryBudget->GetLimit();
+	size_t nearlySpent = limit - (limit < DHSOCKETBUFRESIZE ? limit : DHSOCKETBUFRESIZE);
+
+	if ((memoryPolicies & MEMPOLICY_CLOSEWORST) && used > nearlySpent) {
+		size_t toCover = used - highWatermark;
+		size_t covered = 0;
+
+		FindMemoryCandidates(true);
+		for (size_t i = 0; i < memoryCandidates.size() && covered < toCover; ++i) {
+			uint32_t slotIndex = memoryCandidates[i].second;
+			SocketHandle handle = MakeHandle(slotIndex);
+			covered += memoryCandidates[i].first;
+
+			// An earlier handler may have removed it
+			if (!GetSlotFromHandle(handle)) continue;
+
+			slots[slotIndex].memoryEvicted = true;
+			++memoryPolicyStats.evictions;
+
+			slots[slotIndex].entry.pSocket->RecordErrno(ENOBUFS);
+			DispatchEvents(handle, false, false, true);
+		}
+	}
+}
+
+void DigitalHaze::SocketPool::PauseForMemory(uint32_t slotIndex) {
+	if (slots[slotIndex].readPaused) return;
+
+	SetReadPaused(slotIndex, true);
+	memoryPausedSockets.push_back(MakeHandle(slotIndex));
+	++memoryPolicyStats.readPauses;
+
+	// So it's resumed once the budget recovers
+	if (!memoryPressured) {
+		memoryPressured = true;
+		++memoryPolicyStats.pressureEvents;
+	}
+}
+
+void DigitalHaze::SocketPool::ReleaseMemoryPressure() {
+	for (size_t i = 0; i < memoryPausedSockets.size(); ++i) {
+		SocketHandle handle = memoryPausedSockets[i];
+		if (GetSlotFromHandle(handle))
+			SetReadPaused((uint32_t) (handle & 0xFFFFFFFF), false);
+	}
+
+	memoryPausedSockets.clear();
+	memoryPressured = false;
+	acceptsPaused = false;
+}
+
+size_t DigitalHaze::SocketPool::TrimSocketBuffers() {
+	size_t trimmed = 0;
+
+	for (uint32_t i = 0; i < slots.size(); ++i) {
+		if (!slots[i].inUse || slots[i].entry.passiveSocket) continue;
+
+		IOSocket* sockio = static_cast<IOSocket*> (slots[i].entry.pSocket);
+		if (sockio->GetMemoryBudget() != memoryBudget) continue;
+
+		trimmed += sockio->readBuffer.ShrinkBuffer(DHSOCKETBUFSIZE);
+		trimmed += sockio->writeBuffer.ShrinkBuffer(DHSOCKETBUFSIZE);
+	}
+
+	return trimmed;
+}
+
+// Largest first
+static bool CompareMemoryCandidates(const std::pair<size_t, uint32_t>& lhs,
+		const std::pair<size_t, uint32_t>& rhs) {
+	return lhs.first > rhs.first;
+}
+
+void DigitalHaze::SocketPool::FindMemoryCandidates(bool forEviction) {
+	memoryCandidates.clear();
+
+	for (uint32_t i = 0; i < slots.size(); ++i) {
+		const socketSlot& slot = slots[i];
+		if (!slot.inUse || slot.entry.passiveSocket) continue;
+		if (forEviction ? slot.memoryEvicted : slot.readPaused) continue;
+
+		IOSocket* sockio = static_cast<IOSocket*> (slot.entry.pSocket);
+		if (sockio->GetMemoryBudget() != memoryBudget) continue;
+
+		memoryCandidates.push_back(std::make_pair(sockio->GetBufferMemory(), i));
+	}
+
+	std::sort(memoryCandidates.begin(), memoryCandidates.end(),
+			CompareMemoryCandidates);
+}
+
+DigitalHaze::SocketHandle
+DigitalHaze::SocketPool::GetSocketHandle(const Socket* pSocket) const {
+	if (!pSocket) return DH_INVALID_SOCKETHANDLE;
+
+	// The quick way, if the socket is still open
+	uint32_t slotIndex = GetSlotIndexFromFD(pSocket->sockfd);
+	if (slotIndex != UINT32_MAX && slots[slotIndex].entry.pSocket == pSocket)
+		return MakeHandle(slotIndex);
+
+	// Closed sockets have to be searched for
+	for (size_t i = 0; i < slots.size(); ++i) {
+		if (slots[i].inUse && slots[i].entry.pSocket == pSocket)
+			return MakeHandle((uint32_t) i);
 	}
 
-	// Did not find the fd
-	return false;
+	return DH_INVALID_SOCKETHANDLE;
 }
 
 bool DigitalHaze::SocketPool::PollSockets(int milliSeconds) {
@@ -94,147 +648,1814 @@ bool DigitalHaze::SocketPool::PollSockets(int milliSeconds) {
 	readList.clear();
 	writeList.clear();
 	errorList.clear();
+	timedOutList.clear();
 
 	// Restart at position zero
 	readListIndex = 0;
 	writeListIndex = 0;
 	errorListIndex = 0;
+	timedOutListIndex = 0;
+
+	UpdateCachedTime();
+	uint64_t pollStart = loopStatsEnabled ? GetMonotonicNanoseconds() : 0;
+	uint64_t startEvents = pollEventCount;
+	pollBlockedTime = 0;
+	pollReadable = pollWritable = pollErrors = 0;
+
+	size_t postedRun = RunPostedCommands();
+
+	// Before we read anything more
+	if (memoryBudget)
+		ApplyMemoryPolicy();
+
+	// Sockets that ran out of budget last time go again this time
+	++drainIteration;
+	carryOverRunning.clear();
+	carryOverRunning.swap(carryOver);
+	for (size_t i = 0; i < carryOverRunning.size(); ++i) {
+		if (IsValidHandle(carryOverRunning[i]))
+			slots[(uint32_t) (carryOverRunning[i] & 0xFFFFFFFF)].carriedOver = false;
+	}
+
+	// They have data waiting, so don't wait for more. Neither do we if
+	// posted work may have given the caller something to do.
+	int waitTime = carryOverRunning.empty() && !postedRun &&
+			bufferedIngress.empty() ? GetPollWaitTime(milliSeconds) : 0;
+	bool result = true;
 
 	// Do we even have sockets?
-	if (!GetListSize()) return true; // Can't error if we did nothing.
+	if (GetListSize()) {
+		// Send what was written since our last poll. With edge-triggered
+		// epoll we wouldn't hear about sockets that stayed writable.
+		if (autoDrain && backend != SOCKETPOOL_IOURING)
+			FlushPendingEgress();
 
-	// This is our poll array
-	pollfd* pollfdStartPtr = (pollfd*) pollfdsBuffer.GetBufferStart();
+		if (busyPollSpin > 0 && waitTime)
+			result = BusyPoll(waitTime);
+		else result = PollBackend(waitTime);
+
+		if (autoDrain && !carryOverRunning.empty())
+			DrainCarriedOver();
+
+		if (!bufferedIngress.empty())
+			ReportBufferedIngress();
+	} else if (waitTime) {
+		// Nothing to poll, so just wait for posted work or our next timer
+		pollfd wakepollfd;
+		wakepollfd.fd = wakefd;
+		wakepollfd.events = POLLIN;
+		wakepollfd.revents = 0;
+
+		uint64_t waitStart = StartWait();
+		poll(&wakepollfd, 1, waitTime);
+		EndWait(waitStart);
+	}
+
+	// Whatever woke us up
+	RunPostedCommands();
+
+	// Timers go last, so idle timers know about this poll's events
+	timers.Advance(cachedTime);
 
-	// Check if we want to write only on sockets that have data in the buffer
-	for (pollfd* fdptr = pollfdStartPtr;
-		fdptr != pollfdsBuffer.GetBufferEnd(); ++fdptr) {
-		ssize_t listIndex = GetListIndexFromFD(fdptr->fd);
+	if (loopStatsEnabled)
+		RecordLoopStats(pollStart, pollEventCount - startEvents, waitTime);
 
-		// Error finding the socket?
-		if (listIndex < 0)
-			throw std::logic_error("Error could not find socket in list");
+	return result;
+}
+
+bool DigitalHaze::SocketPool::PollBackend(int milliSeconds) {
+	bool result;
+
+	if (backend == SOCKETPOOL_IOURING)
+		result = PollWithIOUring(milliSeconds);
+	else if (backend == SOCKETPOOL_EPOLL)
+		result = PollWithEpoll(milliSeconds);
+	else result = PollWithPoll(milliSeconds);
+
+	if (!result) lasterrno = errno;
+	return result;
+}
+
+bool DigitalHaze::SocketPool::BusyPoll(int milliSeconds) {
+	uint64_t spinStart = GetMonotonicNanoseconds();
+	uint64_t spinEnd = spinStart + (uint64_t) busyPollCurrentSpin * 1000;
+	uint64_t startEvents = pollEventCount;
+	uint64_t now;
 
-		// If we're not a passive socket
-		if (!sockList[listIndex].passiveSocket) {
-			// non-passive sockets are IOSockets, so do the faster static cast.
-			IOSocket* sockio = static_cast<IOSocket*> (sockList[listIndex].pSocket);
+	for (;;) {
+		if (!PollBackend(0)) return false;
+		++busyPollStats.spinPolls;
+		now = GetMonotonicNanoseconds();
+
+		if (pollEventCount != startEvents) {
+			busyPollStats.spinNanoSeconds += now - spinStart;
+			busyPollStats.spinEvents += pollEventCount - startEvents;
+			++busyPollStats.spinHits;
+			busyPollCurrentSpin = busyPollSpin;
+			return true;
+		}
 
-			// Do we have data in the buffer?
-			if (sockio->GetEgressDataLen()) {
-				// Then we need to check if we can write data
-				fdptr->events |= POLLOUT;
-			} else fdptr->events &= ~POLLOUT; // Don't check write capable
+		// Posted work and timers are handled by our caller
+		if (!commands.IsEmpty() ||
+				(milliSeconds > 0 && now - spinStart >= (uint64_t) milliSeconds * 1000000)) {
+			busyPollStats.spinNanoSeconds += now - spinStart;
+			return true;
 		}
+
+		if (now >= spinEnd) break;
 	}
 
-	int activeFDs = poll(pollfdStartPtr, GetListSize(), milliSeconds);
+	busyPollStats.spinNanoSeconds += now - spinStart;
+	++busyPollStats.spinMisses;
 
-	// Error
-	if (activeFDs == -1)
-		return false;
+	// Quiet times spin less
+	busyPollCurrentSpin /= 2;
+	if (busyPollCurrentSpin < busyPollSpin / 16)
+		busyPollCurrentSpin = busyPollSpin / 16;
+	if (!busyPollCurrentSpin)
+		busyPollCurrentSpin = 1;
 
-	// No pending IO?
-	if (!activeFDs)
-		return true;
+	// Wait for whatever is left
+	if (milliSeconds > 0) {
+		uint64_t spunMilliSeconds = (now - spinStart) / 1000000;
+		milliSeconds = spunMilliSeconds >= (uint64_t) milliSeconds ? 0 :
+				milliSeconds - (int) spunMilliSeconds;
+	}
 
-	// Go through our poll fd list
-	for (pollfd* fdptr = pollfdStartPtr;
-		fdptr != pollfdsBuffer.GetBufferEnd(); ++fdptr) {
-		ssize_t listIndex = GetListIndexFromFD(fdptr->fd);
+	uint64_t waitEvents = pollEventCount;
+	++busyPollStats.blockingPolls;
+	bool result = PollBackend(milliSeconds);
+	busyPollStats.blockingEvents += pollEventCount - waitEvents;
 
-		// Checking for supposedly impossible things
-		if (listIndex < 0)
-			throw std::logic_error("Error could not find socket in list");
+	return result;
+}
 
-		// Read capable?
-		if (fdptr->revents & POLLIN)
-			readList.push_back(sockList[listIndex]);
-		// Write capable?
-		if (fdptr->revents & POLLOUT)
-			writeList.push_back(sockList[listIndex]);
-		// Error?
-		if (fdptr->revents & POLLERR
-			|| fdptr->revents & POLLNVAL
-			|| fdptr->revents & POLLHUP)
-			errorList.push_back(sockList[listIndex]);
+void DigitalHaze::SocketPool::SetBusyPoll(int spinMicroSeconds,
+		int socketBusyPollMicroSeconds, bool preferBusy) {
+	busyPollSpin = spinMicroSeconds > 0 ? spinMicroSeconds : 0;
+	busyPollCurrentSpin = busyPollSpin;
 
-		// Did we have an event? If so, that's one socket down
-		if (fdptr->revents)
-			--activeFDs;
+	bool changed = socketBusyPoll != socketBusyPollMicroSeconds ||
+			preferBusyPoll != preferBusy;
+	socketBusyPoll = socketBusyPollMicroSeconds > 0 ? socketBusyPollMicroSeconds : 0;
+	preferBusyPoll = preferBusy;
 
-		// If there are no more active FDs left, then don't waste cycles.
-		if (!activeFDs)
-			break;
+	if (!changed) return;
+
+	// Sockets we already have get the new options too
+	for (size_t i = 0; i < slots.size(); ++i) {
+		if (slots[i].inUse)
+			ApplyBusyPollOptions(slots[i].sockfd);
 	}
+}
 
-	return true;
+void DigitalHaze::SocketPool::ResetBusyPollStats() {
+	memset(&busyPollStats, 0, sizeof (busyPollStats));
 }
 
-DigitalHaze::Socket*
-DigitalHaze::SocketPool::GetNextEntryFromList(std::vector<socketEntry>& list,
-		size_t& index,
-		void** pParam) {
-	if (index >= list.size()) return nullptr;
-	socketEntry se = list[index++];
-	if (pParam) *pParam = se.pParam;
-	return se.pSocket;
+void DigitalHaze::SocketPool::ApplyBusyPollOptions(int sockfd) {
+	int busyPoll = socketBusyPoll;
+	int prefer = preferBusyPoll ? 1 : 0;
+
+	if (0 != setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &busyPoll, sizeof (busyPoll)))
+		++busyPollStats.socketOptionFailures;
+	if (0 != setsockopt(sockfd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof (prefer)))
+		++busyPollStats.socketOptionFailures;
 }
 
-void DigitalHaze::SocketPool::AddSocketToPollList(int sockfd) {
-	// This describes how we will be polling the socket
-	pollfd socketpollfd;
-	socketpollfd.fd = sockfd;
-	socketpollfd.events = POLLIN;
-	socketpollfd.revents = 0;
+int DigitalHaze::SocketPool::GetPollWaitTime(int milliSeconds) const {
+	uint64_t nextExpiry = timers.GetNextExpiry();
+	if (nextExpiry == UINT64_MAX) return milliSeconds;
 
-	// Store it in our poll list
-	pollfdsBuffer.WriteVar(socketpollfd);
+	// Waking up before our clock reaches the timer would only make us
+	// wait again, so allow for how far the clock lags.
+	uint64_t untilExpiry = nextExpiry > cachedTime ?
+			nextExpiry - cachedTime + GetCoarseResolution() : 0;
+	if (untilExpiry > INT_MAX) untilExpiry = INT_MAX;
+
+	if (milliSeconds < 0 || untilExpiry < (uint64_t) milliSeconds)
+		return (int) untilExpiry;
+	return milliSeconds;
 }
 
-bool DigitalHaze::SocketPool::RemoveSocketFromPollList(int sockfd) {
-	// Iterate through our list of pollfds
-	for (pollfd* fdptr = (pollfd*) pollfdsBuffer.GetBufferStart();
-		fdptr != pollfdsBuffer.GetBufferEnd(); ++fdptr) {
-		if (fdptr->fd == sockfd) {
-			// Found. This is the byte position of the structure in our list.
-			size_t structPos = (size_t) fdptr - (size_t) pollfdsBuffer.GetBufferStart();
+void DigitalHaze::SocketPool::UpdateCachedTime() {
+	cachedTime = GetCoarseMilliseconds();
+}
 
-			// And we shift the contents of the buffer
-			pollfdsBuffer.ShiftBufferAtOffset(sizeof (pollfd), structPos);
-			return true;
-		}
-	}
+uint64_t DigitalHaze::SocketPool::StartWait() const {
+	return loopStatsEnabled ? GetMonotonicNanoseconds() : 0;
+}
 
-	// Not found
-	return false;
+void DigitalHaze::SocketPool::EndWait(uint64_t waitStart) {
+	UpdateCachedTime();
+
+	if (loopStatsEnabled && waitStart)
+		pollBlockedTime += GetMonotonicNanoseconds() - waitStart;
 }
 
-bool DigitalHaze::SocketPool::RemoveSocketFromVector(Socket* pSock,
-		std::vector<socketEntry>& list,
-		size_t& vectorIndex) {
-	for (size_t i = 0; i < list.size(); ++i) {
-		// Compare socketfds (not pointers because the Socket may be std::move'd)
-		if (list[i].pSocket->sockfd == pSock->sockfd) {
-			// We found the socket, erase it.
-			list.erase(list.begin() + i);
+void DigitalHaze::SocketPool::SetLoopStats(bool enable) {
+	loopStatsEnabled = enable;
+	// The time between polls is only known from our next poll on
+	lastPollEnd = 0;
+}
 
-			// Is this going to mess up what we're iterating through?
-			if (vectorIndex > i) --vectorIndex; // fix it
-			return true;
-		}
-	}
+void DigitalHaze::SocketPool::GetLoopStats(PollLoopStats& statsOut) const {
+	loopStatsLock.LockObject();
+	statsOut = loopStats;
+	loopStatsLock.UnlockObject();
+}
 
-	return false;
+void DigitalHaze::SocketPool::ResetLoopStats() {
+	loopStatsLock.LockObject();
+	loopStats.blockedTime.Reset();
+	loopStats.processingTime.Reset();
+	loopStats.betweenPolls.Reset();
+	loopStats.readyPerWakeup.Reset();
+	loopStats.loopLag.Reset();
+	loopStats.polls = 0;
+	loopStats.idlePolls = 0;
+	loopStats.readableEvents = 0;
+	loopStats.writableEvents = 0;
+	loopStats.errorEvents = 0;
+	loopStatsLock.UnlockObject();
 }
 
-ssize_t DigitalHaze::SocketPool::GetListIndexFromFD(int sockfd) const {
-	for (size_t i = 0; i < sockList.size(); ++i) {
-		if (sockList[i].pSocket->sockfd == sockfd) {
-			// found it!
-			return (ssize_t) i;
+void DigitalHaze::SocketPool::RecordLoopStats(uint64_t pollStart,
+		uint64_t readyCount, int waitTime) {
+	uint64_t now = GetMonotonicNanoseconds();
+	uint64_t pollTime = now - pollStart;
+	uint64_t processingTime = pollTime > pollBlockedTime ? pollTime - pollBlockedTime : 0;
+
+	loopStatsLock.LockObject();
+
+	++loopStats.polls;
+	if (!readyCount) ++loopStats.idlePolls;
+	loopStats.readableEvents += pollReadable;
+	loopStats.writableEvents += pollWritable;
+	loopStats.errorEvents += pollErrors;
+
+	loopStats.blockedTime.Record(pollBlockedTime / 1000);
+	loopStats.processingTime.Record(processingTime / 1000);
+	loopStats.readyPerWakeup.Record(readyCount);
+
+	// Polls started before enabling, or right after, don't count
+	if (lastPollEnd && pollStart > lastPollEnd)
+		loopStats.betweenPolls.Record((pollStart - lastPollEnd) / 1000);
+
+	// Waits cut short by events or posted work are not late
+	uint64_t scheduled = waitTime > 0 ? (uint64_t) waitTime * 1000000 : 0;
+	if (scheduled && pollBlockedTime >= scheduled)
+		loopStats.loopLag.Record((pollBlockedTime - scheduled) / 1000);
+
+	loopStatsLock.UnlockObject();
+
+	lastPollEnd = now;
+}
+
+void DigitalHaze::SocketPool::PostAddSocket(IOSocket* pSocket, void* pParam,
+		SocketEventHandler* handler) {
+	poolCommand command;
+	memset(&command, 0, sizeof (command));
+	command.type = POOLCMD_ADDSOCKET;
+	command.pSocket = pSocket;
+	command.pParam = pParam;
+	command.handler = handler;
+	PostCommand(command);
+}
+
+void DigitalHaze::SocketPool::PostAddPassiveSocket(Socket* pSocket, void* pParam,
+		SocketEventHandler* handler) {
+	poolCommand command;
+	memset(&command, 0, sizeof (command));
+	command.type = POOLCMD_ADDPASSIVESOCKET;
+	command.pSocket = pSocket;
+	command.pParam = pParam;
+	command.handler = handler;
+	PostCommand(command);
+}
+
+void DigitalHaze::SocketPool::PostRemoveSocket(SocketHandle handle) {
+	poolCommand command;
+	memset(&command, 0, sizeof (command));
+	command.type = POOLCMD_REMOVESOCKET;
+	command.handle = handle;
+	PostCommand(command);
+}
+
+void DigitalHaze::SocketPool::PostWrite(SocketHandle handle, const void* data,
+		size_t len) {
+	poolCommand command;
+	memset(&command, 0, sizeof (command));
+	command.type = POOLCMD_WRITE;
+	command.handle = handle;
+	command.data = new Buffer(len ? len : 1);
+	command.data->Write((void*) data, len);
+	PostCommand(command);
+}
+
+void DigitalHaze::SocketPool::PostWrite(SocketHandle handle, Buffer&& data) {
+	poolCommand command;
+	memset(&command, 0, sizeof (command));
+	command.type = POOLCMD_WRITE;
+	command.handle = handle;
+	command.data = new Buffer(std::move(data));
+	PostCommand(command);
+}
+
+void DigitalHaze::SocketPool::PostClosure(PoolClosure closure, void* pParam) {
+	poolCommand command;
+	memset(&command, 0, sizeof (command));
+	command.type = POOLCMD_CLOSURE;
+	command.closure = closure;
+	command.pParam = pParam;
+	PostCommand(command);
+}
+
+void DigitalHaze::SocketPool::PostCommand(const poolCommand& command) {
+	commands.Push(command);
+	Wake();
+}
+
+void DigitalHaze::SocketPool::Wake() {
+	// Someone already woke us up, and we haven't looked yet
+	if (wakePending.exchange(true, std::memory_order_acq_rel))
+		return;
+
+	uint64_t one = 1;
+	ssize_t written = write(wakefd, &one, sizeof (one));
+	(void) written; // Only fails if the counter is full, which still wakes us
+}
+
+size_t DigitalHaze::SocketPool::RunPostedCommands() {
+	// Reset first, so anything posted while we work wakes us up again
+	if (wakePending.exchange(false, std::memory_order_acq_rel)) {
+		uint64_t count;
+		ssize_t readLen = read(wakefd, &count, sizeof (count));
+		(void) readLen;
+	}
+
+	size_t commandsRun = 0;
+	poolCommand command;
+	while (commands.Pop(command)) {
+		++commandsRun;
+
+		switch (command.type) {
+			case POOLCMD_ADDSOCKET:
+				AddSocket(static_cast<IOSocket*> (command.pSocket),
+						command.pParam, command.handler);
+				break;
+			case POOLCMD_ADDPASSIVESOCKET:
+				AddPassiveSocket(command.pSocket, command.pParam, command.handler);
+				break;
+			case POOLCMD_REMOVESOCKET:
+				RemoveSocket(command.handle);
+				break;
+			case POOLCMD_WRITE:
+			{
+				const socketSlot* slot = GetSlotFromHandle(command.handle);
+
+				if (slot && !slot->entry.passiveSocket) {
+					IOSocket* sockio = static_cast<IOSocket*> (slot->entry.pSocket);
+					size_t len = command.data->GetBufferDataLen();
+
+					if (ReserveBufferSpace(sockio->writeBuffer, len))
+						sockio->Write(command.data->GetBufferStart(), len);
+					else {
+						// Dropping it would corrupt the stream
+						sockio->RecordErrno(ENOBUFS);
+						DispatchEvents(command.handle, false, false, true);
+					}
+				}
+
+				delete command.data;
+				break;
+			}
+			case POOLCMD_CLOSURE:
+				command.closure(*this, command.pParam);
+				break;
 		}
 	}
 
-	return -1;
-}
\ No newline at end of file
+	// A push we can't see yet may have found wakePending set by a later
+	// one, whose wakeup we already read. Nobody would wake us for it, so
+	// we do, and look again once it's linked.
+	if (commands.IsPushInProgress()) {
+		wakePending.store(true, std::memory_order_release);
+
+		uint64_t one = 1;
+		ssize_t written = write(wakefd, &one, sizeof (one));
+		(void) written;
+	}
+
+	return commandsRun;
+}
+
+DigitalHaze::TimerHandle DigitalHaze::SocketPool::AddTimer(int milliSeconds,
+		TimerCallback callback, void* pParam) {
+	if (milliSeconds < 0) milliSeconds = 0;
+	return timers.AddTimer(cachedTime + (uint64_t) milliSeconds, callback, pParam);
+}
+
+bool DigitalHaze::SocketPool::SetIdleTimeout(SocketHandle handle, int milliSeconds) {
+	if (!GetSlotFromHandle(handle)) return false;
+
+	uint32_t slotIndex = (uint32_t) (handle & 0xFFFFFFFF);
+	socketSlot& slot = slots[slotIndex];
+
+	if (milliSeconds <= 0) {
+		if (slot.idleTimer != DH_INVALID_TIMERHANDLE)
+			timers.CancelTimer(slot.idleTimer);
+		slot.idleTimer = DH_INVALID_TIMERHANDLE;
+		slot.idleTimeout = 0;
+		return true;
+	}
+
+	// The socket's idle time starts now
+	slot.idleTimeout = (uint32_t) milliSeconds;
+	slot.lastActivity = cachedTime;
+	ArmIdleTimer(slotIndex, cachedTime + slot.idleTimeout);
+	return true;
+}
+
+void DigitalHaze::SocketPool::ArmIdleTimer(uint32_t slotIndex, uint64_t expireTime) {
+	socketSlot& slot = slots[slotIndex];
+
+	if (slot.idleTimer != DH_INVALID_TIMERHANDLE &&
+			timers.RescheduleTimer(slot.idleTimer, expireTime))
+		return;
+
+	slot.idleTimer = timers.AddTimer(expireTime, IdleTimerExpired, this);
+
+	uint32_t timerIndex = TimerWheel::GetTimerIndex(slot.idleTimer);
+	if (timerIndex >= idleTimerSlots.size())
+		idleTimerSlots.resize((size_t) timerIndex + 1, UINT32_MAX);
+	idleTimerSlots[timerIndex] = slotIndex;
+}
+
+void DigitalHaze::SocketPool::IdleTimerExpired(TimerHandle handle, void* pParam) {
+	SocketPool* pool = (SocketPool*) pParam;
+	uint32_t slotIndex = pool->idleTimerSlots[TimerWheel::GetTimerIndex(handle)];
+	socketSlot& slot = pool->slots[slotIndex];
+
+	// Removing a socket cancels its timer, so this is just in case
+	if (!slot.inUse || slot.idleTimer != handle) return;
+	slot.idleTimer = DH_INVALID_TIMERHANDLE;
+
+	uint64_t deadline = slot.lastActivity + slot.idleTimeout;
+
+	// Something happened since the timer was set. Wait for the rest.
+	if (deadline > pool->cachedTime) {
+		pool->ArmIdleTimer(slotIndex, deadline);
+		return;
+	}
+
+	SocketHandle socketHandle = pool->MakeHandle(slotIndex);
+	pool->ArmIdleTimer(slotIndex, pool->cachedTime + slot.idleTimeout);
+
+	if (slot.entry.handler) {
+		slot.entry.handler->OnIdleTimeout(*pool, socketHandle,
+				slot.entry.pSocket, slot.entry.pParam);
+	} else pool->timedOutList.push_back(socketHandle);
+}
+
+bool DigitalHaze::SocketPool::PollWithPoll(int milliSeconds) {
+	// This is our poll array
+	pollfd* pollfdStartPtr = (pollfd*) pollfdsBuffer.GetBufferStart();
+
+	size_t pollCount = pollSlots.size();
+
+	// Check if we want to write only on sockets that have data in the
+	// buffer. Only sockets whose buffer changed need looking at.
+	TakeDirtyEgress();
+	for (size_t i = 0; i < dirtyEgressRunning.size(); ++i) {
+		const socketSlot* slot = GetSlotFromHandle(dirtyEgressRunning[i]);
+		if (!slot) continue;
+
+		// Only IOSockets are ever marked, so do the faster static cast.
+		IOSocket* sockio = static_cast<IOSocket*> (slot->entry.pSocket);
+		pollfd* fdptr = pollfdStartPtr + slot->pollIndex;
+
+		// Do we have data in the buffer?
+		if (sockio->GetEgressDataLen() || slot->watchWritable) {
+			// Then we need to check if we can write data
+			fdptr->events |= POLLOUT;
+		} else fdptr->events &= ~POLLOUT; // Don't check write capable
+	}
+
+	// Our wake eventfd rides along after the sockets
+	if (pollfdsBuffer.GetBufferSize() < sizeof (pollfd) * (pollCount + 1)) {
+		pollfdsBuffer.ExpandBufferAligned(sizeof (pollfd));
+		pollfdStartPtr = (pollfd*) pollfdsBuffer.GetBufferStart();
+	}
+	pollfdStartPtr[pollCount].fd = wakefd;
+	pollfdStartPtr[pollCount].events = POLLIN;
+	pollfdStartPtr[pollCount].revents = 0;
+
+	uint64_t waitStart = StartWait();
+	int activeFDs = poll(pollfdStartPtr, pollCount + 1, milliSeconds);
+	EndWait(waitStart);
+
+	// Error
+	if (activeFDs == -1)
+		return false;
+
+	// Take our TCP samples while we're awake
+	if (tcpInfoInterval > 0)
+		SampleTCPInfo();
+
+	// No pending IO?
+	if (!activeFDs)
+		return true;
+
+	// Go through our poll fd list
+	pollResults.clear();
+	for (size_t i = 0; i < pollCount; ++i) {
+		pollfd* fdptr = pollfdStartPtr + i;
+
+		// Nothing happened on this one
+		if (!fdptr->revents)
+			continue;
+
+		pollResult result;
+		result.handle = MakeHandle(pollSlots[i]);
+		result.revents = fdptr->revents;
+		pollResults.push_back(result);
+
+		// We had an event, that's one socket down.
+		// If there are no more active FDs left, then don't waste cycles.
+		if (!--activeFDs)
+			break;
+	}
+
+	for (size_t i = 0; i < pollResults.size(); ++i) {
+		SocketHandle handle = pollResults[i].handle;
+		short revents = pollResults[i].revents;
+
+		// A handler may have removed it
+		if (!GetSlotFromHandle(handle)) continue;
+
+		RecordEvents(handle,
+				revents & POLLIN,
+				revents & POLLOUT,
+				revents & (POLLERR | POLLNVAL | POLLHUP));
+	}
+
+	return true;
+}
+
+bool DigitalHaze::SocketPool::PollWithEpoll(int milliSeconds) {
+	// Tell the kernel about sockets that started or stopped having
+	// data to write. Everything else is already registered.
+	TakeDirtyEgress();
+	for (size_t i = 0; i < dirtyEgressRunning.size(); ++i) {
+		SocketHandle handle = dirtyEgressRunning[i];
+		if (!GetSlotFromHandle(handle)) continue;
+
+		socketSlot& slot = slots[(uint32_t) (handle & 0xFFFFFFFF)];
+
+		// Only IOSockets are ever marked, so do the faster static cast.
+		IOSocket* sockio = static_cast<IOSocket*> (slot.entry.pSocket);
+		uint32_t wantEvents = GetEpollEvents(slot.entry,
+				sockio->GetEgressDataLen() || slot.watchWritable, !slot.readPaused);
+
+		if (wantEvents == slot.entry.pollEvents) continue;
+
+		epoll_event ev;
+		ev.events = wantEvents;
+		ev.data.u64 = handle;
+
+		if (0 == epoll_ctl(epollfd, EPOLL_CTL_MOD, slot.sockfd, &ev))
+			slot.entry.pollEvents = wantEvents;
+	}
+
+	epoll_event* events = (epoll_event*) epollEventsBuffer.GetBufferStart();
+	int maxEvents = (int) (epollEventsBuffer.GetBufferSize() / sizeof (epoll_event));
+
+	uint64_t waitStart = StartWait();
+	int activeFDs = epoll_wait(epollfd, events, maxEvents, milliSeconds);
+	EndWait(waitStart);
+
+	// Error
+	if (activeFDs == -1)
+		return false;
+
+	// Take our TCP samples while we're awake
+	if (tcpInfoInterval > 0)
+		SampleTCPInfo();
+
+	// Only the sockets that are ready are visited
+	for (int i = 0; i < activeFDs; ++i) {
+		// A handler adding sockets may have grown our buffer
+		events = (epoll_event*) epollEventsBuffer.GetBufferStart();
+		SocketHandle handle = events[i].data.u64;
+
+		// Anything from a socket that's no longer ours is dropped.
+		// Our wake eventfd is read when posted work is run.
+		if (handle == WAKEEVENTHANDLE || !GetSlotFromHandle(handle)) continue;
+
+		RecordEvents(handle,
+				events[i].events & (EPOLLIN | EPOLLRDHUP),
+				events[i].events & EPOLLOUT,
+				events[i].events & (EPOLLERR | EPOLLHUP));
+	}
+
+	return true;
+}
+
+void DigitalHaze::SocketPool::RecordEvents(SocketHandle handle, bool readable,
+		bool writable, bool errored) {
+	++pollEventCount;
+	slots[(uint32_t) (handle & 0xFFFFFFFF)].lastActivity = cachedTime;
+
+	if (autoDrain) {
+		const socketSlot* slot = GetSlotFromHandle(handle);
+
+		if (!slot->entry.passiveSocket) {
+			DrainSocket(handle, static_cast<IOSocket*> (slot->entry.pSocket),
+					readable, writable, errored);
+			return;
+		}
+	}
+
+	DispatchEvents(handle, readable, writable, errored);
+}
+
+void DigitalHaze::SocketPool::DispatchEvents(SocketHandle handle, bool readable,
+		bool writable, bool errored) {
+	const socketSlot* slot = GetSlotFromHandle(handle);
+	SocketEventHandler* handler = slot->entry.handler;
+
+	if (readable) ++pollReadable;
+	if (writable) ++pollWritable;
+	if (errored) ++pollErrors;
+
+	if (!handler) {
+		// Read capable?
+		if (readable)
+			readList.push_back(handle);
+		// Write capable?
+		if (writable)
+			writeList.push_back(handle);
+		// Error?
+		if (errored)
+			errorList.push_back(handle);
+		return;
+	}
+
+	// Every call may remove the socket, or grow our slots, so the slot
+	// is looked up again before each one.
+	if (readable)
+		handler->OnReadable(*this, handle, slot->entry.pSocket, slot->entry.pParam);
+
+	if (writable && (slot = GetSlotFromHandle(handle)) && slot->entry.handler) {
+		slot->entry.handler->OnWritable(*this, handle,
+				static_cast<IOSocket*> (slot->entry.pSocket), slot->entry.pParam);
+	}
+
+	if (errored && (slot = GetSlotFromHandle(handle)) && slot->entry.handler) {
+		slot->entry.handler->OnError(*this, handle, slot->entry.pSocket,
+				slot->entry.pParam);
+	}
+}
+
+uint32_t DigitalHaze::SocketPool::GetEpollEvents(const socketEntry& entry,
+		bool wantWrite, bool wantRead) const {
+	uint32_t readEvents = wantRead ? (uint32_t) EPOLLIN : 0u;
+
+	// Listeners stay level-triggered. Connections are accepted one at a
+	// time, so an edge would only tell about the first one.
+	if (entry.passiveSocket)
+		return readEvents;
+
+	// Registered once for everything. We drain until the kernel tells us
+	// to wait, so there's no need to change interest.
+	if (autoDrain)
+		return readEvents | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+
+	return wantWrite ? readEvents | EPOLLOUT : readEvents;
+}
+
+void DigitalHaze::SocketPool::SetAutoDrain(bool enable) {
+	if (autoDrain == enable) return;
+	autoDrain = enable;
+
+	if (backend != SOCKETPOOL_EPOLL) return;
+
+	// Switch registered sockets between level and edge triggered
+	for (uint32_t i = 0; i < slots.size(); ++i) {
+		socketSlot& slot = slots[i];
+		if (!slot.inUse || slot.entry.passiveSocket) continue;
+
+		IOSocket* sockio = static_cast<IOSocket*> (slot.entry.pSocket);
+
+		epoll_event ev;
+		ev.events = GetEpollEvents(slot.entry,
+				sockio->GetEgressDataLen() || slot.watchWritable, !slot.readPaused);
+		ev.data.u64 = MakeHandle(i);
+
+		if (0 == epoll_ctl(epollfd, EPOLL_CTL_MOD, slot.sockfd, &ev))
+			slot.entry.pollEvents = ev.events;
+	}
+}
+
+void DigitalHaze::SocketPool::SetFairnessBudget(size_t bytesPerSocket,
+		size_t readsPerSocket) {
+	budgetBytes = bytesPerSocket;
+	budgetReads = readsPerSocket;
+}
+
+void DigitalHaze::SocketPool::DrainCarriedOver() {
+	for (size_t i = 0; i < carryOverRunning.size(); ++i) {
+		SocketHandle handle = carryOverRunning[i];
+		const socketSlot* slot = GetSlotFromHandle(handle);
+
+		// Removed, or already had its turn because the kernel reported it
+		if (!slot || slot->drainIteration == drainIteration) continue;
+
+		DrainSocket(handle, static_cast<IOSocket*> (slot->entry.pSocket),
+				true, false, false);
+	}
+
+	carryOverRunning.clear();
+}
+
+void DigitalHaze::SocketPool::ReportBufferedIngress() {
+	// Handlers may add more sockets while we go. Those wait for next time.
+	bufferedIngressRunning.clear();
+	bufferedIngressRunning.swap(bufferedIngress);
+
+	for (size_t i = 0; i < bufferedIngressRunning.size(); ++i) {
+		SocketHandle handle = bufferedIngressRunning[i];
+		if (GetSlotFromHandle(handle))
+			DispatchEvents(handle, true, false, false);
+	}
+
+	bufferedIngressRunning.clear();
+}
+
+void DigitalHaze::SocketPool::MarkEgressDirty(SocketHandle handle) {
+	if (!GetSlotFromHandle(handle)) return;
+
+	socketSlot& slot = slots[(uint32_t) (handle & 0xFFFFFFFF)];
+	if (slot.egressDirty) return;
+
+	slot.egressDirty = true;
+	dirtyEgress.push_back(handle);
+}
+
+void DigitalHaze::SocketPool::TakeDirtyEgress() {
+	dirtyEgressRunning.clear();
+	dirtyEgressRunning.swap(dirtyEgress);
+
+	for (size_t i = 0; i < dirtyEgressRunning.size(); ++i) {
+		if (IsValidHandle(dirtyEgressRunning[i]))
+			slots[(uint32_t) (dirtyEgressRunning[i] & 0xFFFFFFFF)].egressDirty = false;
+	}
+}
+
+void DigitalHaze::SocketPool::FlushPendingEgress() {
+	// Sockets that had data before that are still waiting to send it
+	// hear about it from the kernel. This leaves the list to the backend,
+	// and sockets marked while we go are flushed too.
+	for (size_t i = 0; i < dirtyEgress.size(); ++i) {
+		SocketHandle handle = dirtyEgress[i];
+		const socketSlot* slot = GetSlotFromHandle(handle);
+		if (!slot) continue;
+
+		IOSocket* sockio = static_cast<IOSocket*> (slot->entry.pSocket);
+		if (!sockio->GetEgressDataLen()) continue;
+
+		if (!FlushSocket(sockio))
+			DispatchEvents(handle, false, false, true);
+	}
+}
+
+void DigitalHaze::SocketPool::DrainSocket(SocketHandle handle, IOSocket* sockio,
+		bool readable, bool writable, bool errored) {
+	socketSlot& slot = slots[(uint32_t) (handle & 0xFFFFFFFF)];
+	bool gotData = false;
+	bool outOfBudget = false;
+	size_t bytesRead = 0, reads = 0;
+
+	slot.drainIteration = drainIteration;
+
+	// Even on errors, read what arrived before them. Unless we stopped
+	// reading to save memory.
+	if ((readable || errored) && !slot.readPaused) {
+		for (;;) {
+			if ((budgetBytes && bytesRead >= budgetBytes) ||
+					(budgetReads && reads >= budgetReads)) {
+				outOfBudget = true;
+				break;
+			}
+
+			// Don't read past our byte budget, if it's less than what
+			// would be read anyway.
+			size_t readLen = 0;
+			if (budgetBytes && budgetBytes - bytesRead <
+					sockio->readBuffer.GetRemainingBufferLength())
+				readLen = budgetBytes - bytesRead;
+
+			size_t bufferedLen = sockio->GetIngressDataLen();
+
+			if (!sockio->PerformSocketRead(readLen)) {
+				// Our memory budget is spent. The rest can wait.
+				if (sockio->GetLastError() == ENOBUFS && memoryBudget &&
+						(memoryPolicies & MEMPOLICY_PAUSEREADS)) {
+					PauseForMemory((uint32_t) (handle & 0xFFFFFFFF));
+					break;
+				}
+
+				errored = true;
+				break;
+			}
+			++reads;
+
+			// Nothing more for now
+			if (sockio->GetIngressDataLen() == bufferedLen)
+				break;
+
+			bytesRead += sockio->GetIngressDataLen() - bufferedLen;
+			gotData = true;
+		}
+	}
+
+	// Whatever's left in the kernel gets read next poll
+	if (outOfBudget && !errored && !slot.carriedOver) {
+		slot.carriedOver = true;
+		carryOver.push_back(handle);
+	}
+
+	if (writable && !errored && !FlushSocket(sockio))
+		errored = true;
+
+	// Watched sockets want to know even if there was nothing to send
+	bool reportWritable = writable && !errored && slot.watchWritable;
+
+	if (gotData || reportWritable || errored)
+		DispatchEvents(handle, gotData, reportWritable, errored);
+}
+
+bool DigitalHaze::SocketPool::FlushSocket(IOSocket* sockio) {
+	while (sockio->GetEgressDataLen()) {
+		if (!sockio->PerformSocketWrite()) {
+			// The kernel's buffer is full. We'll be told when it isn't.
+			return sockio->GetLastError() == EAGAIN ||
+					sockio->GetLastError() == EWOULDBLOCK;
+		}
+	}
+
+	return true;
+}
+
+void DigitalHaze::SocketPool::SetTCPInfoSampling(int intervalMilliSeconds,
+		size_t socketsPerSample) {
+	tcpInfoInterval = intervalMilliSeconds;
+	tcpInfoSocketsPerSample = socketsPerSample;
+	tcpInfoNextSample = 0; // Take the first sample right away
+}
+
+void DigitalHaze::SocketPool::ResetTCPInfoStats() {
+	tcpInfoStats.rtt.Reset();
+	tcpInfoStats.rttVar.Reset();
+	tcpInfoStats.totalRetrans.Reset();
+	tcpInfoStats.unackedPackets.Reset();
+	tcpInfoStats.sendCwnd.Reset();
+	tcpInfoStats.samples = 0;
+	tcpInfoStats.retransmitting = 0;
+}
+
+void DigitalHaze::SocketPool::SampleTCPInfo() {
+	uint64_t now = cachedTime;
+	if (now < tcpInfoNextSample) return;
+	tcpInfoNextSample = now + (uint64_t) tcpInfoInterval;
+
+	size_t toVisit = tcpInfoSocketsPerSample;
+	if (!toVisit || toVisit > socketCount)
+		toVisit = socketCount;
+
+	// Empty slots are stepped over and don't count as visits
+	for (size_t visited = 0, stepped = 0;
+		visited < toVisit && stepped < slots.size(); ++stepped) {
+		// Continue where the last sample left off
+		if (tcpInfoCursor >= slots.size())
+			tcpInfoCursor = 0;
+		socketSlot& slot = slots[tcpInfoCursor++];
+		if (!slot.inUse) continue;
+		++visited;
+
+		socketEntry& entry = slot.entry;
+
+		// Listeners have no connection state
+		if (entry.passiveSocket) continue;
+
+		// Only TCP sockets have TCP_INFO
+		TCPSocket* tcpSocket = dynamic_cast<TCPSocket*> (entry.pSocket);
+		if (!tcpSocket) continue;
+
+		TCPInfoSnapshot info;
+		if (!tcpSocket->GetTCPInfo(info)) continue;
+
+		tcpInfoStats.rtt.Record(info.rtt);
+		tcpInfoStats.rttVar.Record(info.rttVar);
+		tcpInfoStats.totalRetrans.Record(info.totalRetrans);
+		tcpInfoStats.unackedPackets.Record(info.unackedPackets);
+		tcpInfoStats.sendCwnd.Record(info.sendCwnd);
+		++tcpInfoStats.samples;
+		if (info.retransPackets)
+			++tcpInfoStats.retransmitting;
+	}
+}
+
+DigitalHaze::Socket*
+DigitalHaze::SocketPool::GetNextEntryFromList(std::vector<SocketHandle>& list,
+		size_t& index,
+		void** pParam,
+		SocketHandle* pHandle) const {
+	while (index < list.size()) {
+		SocketHandle handle = list[index++];
+		const socketSlot* slot = GetSlotFromHandle(handle);
+
+		// Removed since we polled
+		if (!slot) continue;
+
+		if (pParam) *pParam = slot->entry.pParam;
+		if (pHandle) *pHandle = handle;
+		return slot->entry.pSocket;
+	}
+
+	return nullptr;
+}
+
+void DigitalHaze::SocketPool::AddSocketToPollList(uint32_t slotIndex) {
+	// This describes how we will be polling the socket
+	pollfd socketpollfd;
+	socketpollfd.fd = slots[slotIndex].sockfd;
+	socketpollfd.events = slots[slotIndex].readPaused ? 0 : POLLIN;
+	socketpollfd.revents = 0;
+
+	// Store it in our poll list
+	slots[slotIndex].pollIndex = (uint32_t) pollSlots.size();
+	pollfdsBuffer.WriteVar(socketpollfd);
+	pollSlots.push_back(slotIndex);
+}
+
+void DigitalHaze::SocketPool::RemoveSocketFromPollList(uint32_t slotIndex) {
+	uint32_t pollIndex = slots[slotIndex].pollIndex;
+	uint32_t lastIndex = (uint32_t) (pollSlots.size() - 1);
+	pollfd* pollfdStartPtr = (pollfd*) pollfdsBuffer.GetBufferStart();
+
+	if (pollIndex >= pollSlots.size())
+		throw std::logic_error("Error socket not in fd list");
+
+	// The last pollfd fills the hole, so nothing else has to move
+	if (pollIndex != lastIndex) {
+		pollfdStartPtr[pollIndex] = pollfdStartPtr[lastIndex];
+		pollSlots[pollIndex] = pollSlots[lastIndex];
+		slots[pollSlots[pollIndex]].pollIndex = pollIndex;
+	}
+
+	pollfdsBuffer.ShiftBufferAtOffset(sizeof (pollfd), sizeof (pollfd) * lastIndex);
+	pollSlots.pop_back();
+	slots[slotIndex].pollIndex = UINT32_MAX;
+}
+
+// The io_uring backend.
+//
+// Every operation we submit carries the slot index, the low bits of the
+// slot's generation, and what kind of operation it is. Completions for
+// sockets that were removed in the meantime are recognized that way.
+// Receives go into buffers the kernel picks from a ring we provide, and
+// are copied into the socket's read buffer when the completion is reaped.
+// The socket's own buffer can't be handed to the kernel since it may be
+// reallocated while the receive is outstanding.
+
+enum uringOperation {
+	// Multishot recv, or POLLIN poll, depending on the socket
+	URINGOP_INGRESS = 0,
+	// Multishot accept
+	URINGOP_ACCEPT,
+	// send of a TCP socket's outgoing data
+	URINGOP_SEND,
+	// Single POLLOUT poll of a socket we can't send for
+	URINGOP_POLLOUT,
+	// Cancellations and our wake poll. Their completions are not
+	// interesting.
+	URINGOP_INTERNAL
+};
+
+enum uringSlotMode {
+	// We receive and send for the socket
+	URINGMODE_COMPLETION = 0,
+	// We accept connections on the socket
+	URINGMODE_ACCEPT,
+	// We only tell when the socket is ready
+	URINGMODE_READINESS
+};
+
+#define URING_GENERATIONMASK 0x1FFFFFFFULL
+#define URING_OPSHIFT 61
+// Our wake eventfd's poll. Cancellations use zero for the rest.
+#define URING_WAKEUSERDATA (((uint64_t) URINGOP_INTERNAL << URING_OPSHIFT) | 1)
+
+static inline uint64_t MakeUringUserData(uringOperation op,
+		DigitalHaze::SocketHandle handle) {
+	return ((uint64_t) op << URING_OPSHIFT) |
+			(((handle >> 32) & URING_GENERATIONMASK) << 32) |
+			(handle & 0xFFFFFFFF);
+}
+
+static inline int UringEnter(int ringfd, unsigned toSubmit,
+		unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+	return (int) syscall(__NR_io_uring_enter, ringfd, toSubmit, minComplete,
+			flags, arg, argSize);
+}
+
+static inline int UringRegister(int ringfd, unsigned opcode, void* arg,
+		unsigned nrArgs) {
+	return (int) syscall(__NR_io_uring_register, ringfd, opcode, arg, nrArgs);
+}
+
+struct uringSlotState {
+	uint8_t mode;
+	bool ingressArmed;
+	bool pollOutArmed;
+	// Was given to the ring's file table
+	bool fixedFile;
+	// Outgoing data the kernel is sending, and a drained buffer we
+	// swap in for the next send.
+	DigitalHaze::Buffer* sending;
+	DigitalHaze::Buffer* spareSend;
+	// Poll iterations the socket was last put in each output list
+	uint32_t readReport;
+	uint32_t writeReport;
+	uint32_t errorReport;
+};
+
+struct acceptedConnection {
+	int fd;
+	DigitalHaze::SocketHandle listener;
+	void* pParam;
+};
+
+struct DigitalHaze::SocketPool::uringState {
+	int ringfd;
+	bool enabled;
+
+	// Submission queue
+	void* sqRingPtr;
+	size_t sqRingSize;
+	unsigned* sqHead;
+	unsigned* sqTail;
+	unsigned sqMask;
+	unsigned sqEntries;
+	io_uring_sqe* sqes;
+	size_t sqesSize;
+	unsigned sqLocalTail;
+
+	// Completion queue
+	void* cqRingPtr;
+	size_t cqRingSize;
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned cqMask;
+	io_uring_cqe* cqes;
+
+	// Registered file table. Zero if we couldn't register one.
+	unsigned fileTableSize;
+
+	// Provided receive buffers
+	io_uring_buf_ring* bufRing;
+	size_t bufRingSize;
+	char* bufMemory;
+	unsigned bufCount;
+	unsigned bufSize;
+	uint16_t bufTail;
+
+	uint32_t pollIteration;
+	std::vector<uringSlotState> slotStates;
+
+	// Our wake eventfd is being polled
+	bool wakeArmed;
+
+	// Work for the next submission
+	std::vector<SocketHandle> toArm;
+	std::vector<uint64_t> toCancel;
+	std::vector<uint32_t> filesToClear;
+
+	// Outgoing data of removed sockets still held by the kernel,
+	// by the user data of the send.
+	std::vector<std::pair<uint64_t, Buffer*> > retiredSends;
+
+	std::vector<acceptedConnection> accepted;
+	size_t acceptedIndex;
+
+	// Returns a cleared submission entry, or null if the queue is full
+	// even after submitting what's in it.
+
+	io_uring_sqe* GetSQE() {
+		if (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+			Flush();
+			if (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+				return nullptr;
+		}
+
+		io_uring_sqe* sqe = &sqes[sqLocalTail & sqMask];
+		memset(sqe, 0, sizeof (io_uring_sqe));
+		++sqLocalTail;
+		return sqe;
+	}
+
+	// Makes queued submissions visible to the kernel, and returns how
+	// many there are.
+
+	unsigned PublishSubmissions() {
+		__atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+		return sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	}
+
+	// Hands queued submissions to the kernel without waiting
+
+	void Flush() {
+		unsigned pending = PublishSubmissions();
+		if (pending)
+			UringEnter(ringfd, pending, 0, 0, nullptr, 0);
+	}
+
+	// Gives a receive buffer back to the kernel. Takes effect on the
+	// next PublishBuffers.
+
+	void RecycleBuffer(uint16_t bufferID) {
+		// Indexed by hand, since C++ lays out the header's flexible
+		// array member of io_uring_buf_ring after an empty struct.
+		io_uring_buf* buf = (io_uring_buf*) bufRing + (bufTail & (bufCount - 1));
+		buf->addr = (uint64_t) (size_t) (bufMemory + (size_t) bufferID * bufSize);
+		buf->len = bufSize;
+		buf->bid = bufferID;
+		++bufTail;
+	}
+
+	void PublishBuffers() {
+		__atomic_store_n(&bufRing->tail, bufTail, __ATOMIC_RELEASE);
+	}
+};
+
+bool DigitalHaze::SocketPool::InitIOUring() {
+	io_uring_params params;
+	memset(&params, 0, sizeof (params));
+	// We submit from whichever thread polls, so the ring is enabled by
+	// our first poll rather than by the thread constructing us.
+	params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN |
+			IORING_SETUP_R_DISABLED | IORING_SETUP_SUBMIT_ALL |
+			IORING_SETUP_CQSIZE;
+	params.cq_entries = DH_SOCKETPOOL_URINGENTRIES * 4;
+
+	int ringfd = (int) syscall(__NR_io_uring_setup, DH_SOCKETPOOL_URINGENTRIES, &params);
+	if (ringfd == -1) return false;
+
+	// Without these we'd need a lot more code for very old kernels
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+		!(params.features & IORING_FEAT_EXT_ARG) ||
+		!(params.features & IORING_FEAT_NODROP)) {
+		close(ringfd);
+		return false;
+	}
+
+	uring = new uringState;
+	uring->ringfd = ringfd;
+	uring->enabled = false;
+	uring->wakeArmed = false;
+	uring->sqLocalTail = 0;
+	uring->bufRing = nullptr;
+	uring->bufMemory = nullptr;
+	uring->sqes = nullptr;
+	uring->sqRingPtr = MAP_FAILED;
+	uring->pollIteration = 0;
+	uring->acceptedIndex = 0;
+
+	// Both rings share one mapping
+	uring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+	uring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof (io_uring_cqe);
+	if (uring->cqRingSize > uring->sqRingSize)
+		uring->sqRingSize = uring->cqRingSize;
+
+	uring->sqRingPtr = mmap(nullptr, uring->sqRingSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQ_RING);
+	if (uring->sqRingPtr == MAP_FAILED) {
+		DestroyIOUring();
+		return false;
+	}
+	uring->cqRingPtr = uring->sqRingPtr;
+
+	uring->sqesSize = params.sq_entries * sizeof (io_uring_sqe);
+	void* sqesPtr = mmap(nullptr, uring->sqesSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQES);
+	if (sqesPtr == MAP_FAILED) {
+		DestroyIOUring();
+		return false;
+	}
+	uring->sqes = (io_uring_sqe*) sqesPtr;
+
+	char* sqRing = (char*) uring->sqRingPtr;
+	uring->sqHead = (unsigned*) (sqRing + params.sq_off.head);
+	uring->sqTail = (unsigned*) (sqRing + params.sq_off.tail);
+	uring->sqMask = *(unsigned*) (sqRing + params.sq_off.ring_mask);
+	uring->sqEntries = params.sq_entries;
+
+	// Submission entries are always used in order
+	unsigned* sqArray = (unsigned*) (sqRing + params.sq_off.array);
+	for (unsigned i = 0; i < params.sq_entries; ++i)
+		sqArray[i] = i;
+
+	char* cqRing = (char*) uring->cqRingPtr;
+	uring->cqHead = (unsigned*) (cqRing + params.cq_off.head);
+	uring->cqTail = (unsigned*) (cqRing + params.cq_off.tail);
+	uring->cqMask = *(unsigned*) (cqRing + params.cq_off.ring_mask);
+	uring->cqes = (io_uring_cqe*) (cqRing + params.cq_off.cqes);
+
+	// Receive buffers the kernel picks from
+	uring->bufCount = DH_SOCKETPOOL_URINGBUFCOUNT;
+	uring->bufSize = DH_SOCKETPOOL_URINGBUFSIZE;
+	uring->bufRingSize = uring->bufCount * sizeof (io_uring_buf);
+	void* bufRingPtr = mmap(nullptr, uring->bufRingSize, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (bufRingPtr == MAP_FAILED) {
+		DestroyIOUring();
+		return false;
+	}
+	uring->bufRing = (io_uring_buf_ring*) bufRingPtr;
+	uring->bufTail = 0;
+
+	uring->bufMemory = (char*) malloc((size_t) uring->bufCount * uring->bufSize);
+	if (!uring->bufMemory) {
+		DestroyIOUring();
+		return false;
+	}
+
+	io_uring_buf_reg bufReg;
+	memset(&bufReg, 0, sizeof (bufReg));
+	bufReg.ring_addr = (uint64_t) (size_t) bufRingPtr;
+	bufReg.ring_entries = uring->bufCount;
+	bufReg.bgid = 0;
+
+	if (0 != UringRegister(ringfd, IORING_REGISTER_PBUF_RING, &bufReg, 1)) {
+		DestroyIOUring();
+		return false;
+	}
+
+	for (unsigned i = 0; i < uring->bufCount; ++i)
+		uring->RecycleBuffer((uint16_t) i);
+	uring->PublishBuffers();
+
+	// A sparse file table. Sockets that don't fit use their fd as is.
+	io_uring_rsrc_register filesReg;
+	memset(&filesReg, 0, sizeof (filesReg));
+	filesReg.nr = DH_SOCKETPOOL_URINGFILES;
+	filesReg.flags = IORING_RSRC_REGISTER_SPARSE;
+
+	if (0 == UringRegister(ringfd, IORING_REGISTER_FILES2, &filesReg, sizeof (filesReg)))
+		uring->fileTableSize = DH_SOCKETPOOL_URINGFILES;
+	else
+		uring->fileTableSize = 0;
+
+	return true;
+}
+
+void DigitalHaze::SocketPool::DestroyIOUring() {
+	// Closing the ring cancels everything still in flight
+	close(uring->ringfd);
+
+	if (uring->sqes)
+		munmap(uring->sqes, uring->sqesSize);
+	if (uring->sqRingPtr != MAP_FAILED)
+		munmap(uring->sqRingPtr, uring->sqRingSize);
+	if (uring->bufRing)
+		munmap(uring->bufRing, uring->bufRingSize);
+	free(uring->bufMemory);
+
+	for (size_t i = 0; i < uring->slotStates.size(); ++i) {
+		delete uring->slotStates[i].sending;
+		delete uring->slotStates[i].spareSend;
+	}
+	for (size_t i = 0; i < uring->retiredSends.size(); ++i)
+		delete uring->retiredSends[i].second;
+
+	// Connections nobody claimed
+	for (size_t i = uring->acceptedIndex; i < uring->accepted.size(); ++i)
+		close(uring->accepted[i].fd);
+
+	delete uring;
+	uring = nullptr;
+}
+
+void DigitalHaze::SocketPool::IOUringAddSlot(uint32_t slotIndex) {
+	if (uring->slotStates.size() < slots.size()) {
+		uringSlotState blank;
+		memset(&blank, 0, sizeof (blank));
+		uring->slotStates.resize(slots.size(), blank);
+	}
+
+	socketEntry& entry = slots[slotIndex].entry;
+	uringSlotState& state = uring->slotStates[slotIndex];
+
+	if (entry.passiveSocket)
+		state.mode = URINGMODE_ACCEPT;
+	else if (dynamic_cast<TCPSocket*> (entry.pSocket))
+		state.mode = URINGMODE_COMPLETION;
+	else // Could be message based, so its own reads have to be used
+		state.mode = URINGMODE_READINESS;
+
+	state.ingressArmed = false;
+	state.pollOutArmed = false;
+	state.fixedFile = false;
+	state.readReport = state.writeReport = state.errorReport = 0;
+
+	uring->toArm.push_back(MakeHandle(slotIndex));
+}
+
+void DigitalHaze::SocketPool::IOUringRemoveSlot(uint32_t slotIndex) {
+	uringSlotState& state = uring->slotStates[slotIndex];
+	SocketHandle handle = MakeHandle(slotIndex);
+
+	// The kernel holds on to the socket until everything on it is cancelled
+	if (state.ingressArmed) {
+		uring->toCancel.push_back(MakeUringUserData(state.mode == URINGMODE_ACCEPT ?
+				URINGOP_ACCEPT : URINGOP_INGRESS, handle));
+	}
+	if (state.pollOutArmed)
+		uring->toCancel.push_back(MakeUringUserData(URINGOP_POLLOUT, handle));
+
+	if (state.sending) {
+		// The kernel may still be reading from it
+		uint64_t userData = MakeUringUserData(URINGOP_SEND, handle);
+		uring->toCancel.push_back(userData);
+		uring->retiredSends.push_back(std::make_pair(userData, state.sending));
+		state.sending = nullptr;
+	}
+
+	delete state.spareSend;
+	state.spareSend = nullptr;
+
+	if (state.fixedFile)
+		uring->filesToClear.push_back(slotIndex);
+
+	state.ingressArmed = false;
+	state.pollOutArmed = false;
+	state.fixedFile = false;
+}
+
+void DigitalHaze::SocketPool::IOUringSetReadPaused(uint32_t slotIndex, bool paused) {
+	uringSlotState& state = uring->slotStates[slotIndex];
+	SocketHandle handle = MakeHandle(slotIndex);
+
+	if (!paused) {
+		uring->toArm.push_back(handle);
+		return;
+	}
+
+	// What the kernel already read still comes to us. The multishot
+	// isn't restarted when it ends.
+	if (state.ingressArmed) {
+		uring->toCancel.push_back(MakeUringUserData(state.mode == URINGMODE_ACCEPT ?
+				URINGOP_ACCEPT : URINGOP_INGRESS, handle));
+	}
+}
+
+void DigitalHaze::SocketPool::IOUringArmSlot(SocketHandle handle) {
+	const socketSlot* slot = GetSlotFromHandle(handle);
+	if (!slot) return;
+
+	uint32_t slotIndex = (uint32_t) (handle & 0xFFFFFFFF);
+	uringSlotState& state = uring->slotStates[slotIndex];
+	if (state.ingressArmed || slot->readPaused) return;
+
+	// Register the socket with the ring the first time around
+	if (!state.fixedFile && slotIndex < uring->fileTableSize) {
+		int fd = slot->sockfd;
+		io_uring_files_update update;
+		memset(&update, 0, sizeof (update));
+		update.offset = slotIndex;
+		update.fds = (uint64_t) (size_t) & fd;
+
+		if (1 == UringRegister(uring->ringfd, IORING_REGISTER_FILES_UPDATE, &update, 1))
+			state.fixedFile = true;
+	}
+
+	io_uring_sqe* sqe = uring->GetSQE();
+	if (!sqe) {
+		// Try again next poll
+		uring->toArm.push_back(handle);
+		return;
+	}
+
+	if (state.fixedFile) {
+		sqe->fd = (int32_t) slotIndex;
+		sqe->flags = IOSQE_FIXED_FILE;
+	} else sqe->fd = slot->sockfd;
+
+	switch (state.mode) {
+		case URINGMODE_COMPLETION:
+			// Keeps receiving into buffers from our ring until something
+			// goes wrong or the ring runs dry.
+			sqe->opcode = IORING_OP_RECV;
+			sqe->ioprio = IORING_RECV_MULTISHOT;
+			sqe->flags |= IOSQE_BUFFER_SELECT;
+			sqe->buf_group = 0;
+			break;
+		case URINGMODE_ACCEPT:
+			sqe->opcode = IORING_OP_ACCEPT;
+			sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+			break;
+		default:
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->len = IORING_POLL_ADD_MULTI;
+			sqe->poll32_events = POLLIN;
+			break;
+	}
+
+	sqe->user_data = MakeUringUserData(state.mode == URINGMODE_ACCEPT ?
+			URINGOP_ACCEPT : URINGOP_INGRESS, handle);
+	state.ingressArmed = true;
+}
+
+bool DigitalHaze::SocketPool::IOUringSubmitSend(uint32_t slotIndex) {
+	uringSlotState& state = uring->slotStates[slotIndex];
+	socketSlot& slot = slots[slotIndex];
+
+	io_uring_sqe* sqe = uring->GetSQE();
+	if (!sqe) return false;
+
+	if (state.fixedFile) {
+		sqe->fd = (int32_t) slotIndex;
+		sqe->flags = IOSQE_FIXED_FILE;
+	} else sqe->fd = slot.sockfd;
+
+	sqe->opcode = IORING_OP_SEND;
+	sqe->addr = (uint64_t) (size_t) state.sending->GetBufferStart();
+	sqe->len = (uint32_t) state.sending->GetBufferDataLen();
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = MakeUringUserData(URINGOP_SEND, MakeHandle(slotIndex));
+	return true;
+}
+
+bool DigitalHaze::SocketPool::PollWithIOUring(int milliSeconds) {
+	if (!uring->enabled) {
+		// Whoever polls first becomes the ring's only submitter
+		if (0 != UringRegister(uring->ringfd, IORING_REGISTER_ENABLE_RINGS, nullptr, 0))
+			return false;
+		uring->enabled = true;
+	}
+
+	// Skip zero, which means "never reported"
+	if (!++uring->pollIteration)
+		++uring->pollIteration;
+
+	// Let go of removed sockets
+	for (size_t i = 0; i < uring->toCancel.size(); ++i) {
+		io_uring_sqe* sqe = uring->GetSQE();
+		if (!sqe) break;
+
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = uring->toCancel[i];
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+		sqe->user_data = (uint64_t) URINGOP_INTERNAL << URING_OPSHIFT;
+	}
+	uring->toCancel.clear();
+
+	for (size_t i = 0; i < uring->filesToClear.size(); ++i) {
+		int fd = -1;
+		io_uring_files_update update;
+		memset(&update, 0, sizeof (update));
+		update.offset = uring->filesToClear[i];
+		update.fds = (uint64_t) (size_t) & fd;
+		UringRegister(uring->ringfd, IORING_REGISTER_FILES_UPDATE, &update, 1);
+	}
+	uring->filesToClear.clear();
+
+	// Wake up when other threads post work
+	if (!uring->wakeArmed) {
+		io_uring_sqe* sqe = uring->GetSQE();
+
+		if (sqe) {
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->fd = wakefd;
+			sqe->len = IORING_POLL_ADD_MULTI;
+			sqe->poll32_events = POLLIN;
+			sqe->user_data = URING_WAKEUSERDATA;
+			uring->wakeArmed = true;
+		}
+	}
+
+	// Start operations on new sockets, and restart finished ones
+	std::vector<SocketHandle> armList;
+	armList.swap(uring->toArm);
+	for (size_t i = 0; i < armList.size(); ++i)
+		IOUringArmSlot(armList[i]);
+
+	// Send whatever was written since our last poll. Sockets busy with
+	// a send or a POLLOUT are marked again when it completes, and sockets
+	// we couldn't get to stay marked.
+	TakeDirtyEgress();
+	for (size_t j = 0; j < dirtyEgressRunning.size(); ++j) {
+		SocketHandle handle = dirtyEgressRunning[j];
+		if (!GetSlotFromHandle(handle)) continue;
+
+		uint32_t i = (uint32_t) (handle & 0xFFFFFFFF);
+		socketSlot& slot = slots[i];
+		uringSlotState& state = uring->slotStates[i];
+		IOSocket* sockio = static_cast<IOSocket*> (slot.entry.pSocket);
+
+		bool hasEgress = sockio->GetEgressDataLen() != 0;
+		if (!hasEgress && !slot.watchWritable) continue;
+
+		// Watched sockets with nothing to send wait for POLLOUT
+		if (state.mode == URINGMODE_COMPLETION && hasEgress) {
+			// One send at a time keeps the data in order
+			if (state.sending) continue;
+
+			// Hand the kernel the socket's write buffer as it is and give
+			// the socket an empty one to write into meanwhile.
+			if (state.spareSend) {
+				state.sending = state.spareSend;
+				state.spareSend = nullptr;
+				std::swap(*state.sending, sockio->writeBuffer);
+			} else {
+				state.sending = new Buffer(std::move(sockio->writeBuffer));
+				sockio->AcquireBuffer(sockio->writeBuffer);
+			}
+
+			if (!IOUringSubmitSend(i)) {
+				// Put it back and try again next poll
+				std::swap(*state.sending, sockio->writeBuffer);
+				state.spareSend = state.sending;
+				state.sending = nullptr;
+				MarkEgressDirty(handle);
+			}
+		} else if (!state.pollOutArmed) {
+			io_uring_sqe* sqe = uring->GetSQE();
+			if (!sqe) {
+				MarkEgressDirty(handle);
+				continue;
+			}
+
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->fd = slot.sockfd;
+			sqe->poll32_events = POLLOUT;
+			sqe->user_data = MakeUringUserData(URINGOP_POLLOUT, handle);
+			state.pollOutArmed = true;
+		}
+	}
+
+	// Submit everything and wait in one go
+	unsigned toSubmit = uring->PublishSubmissions();
+
+	__kernel_timespec timeout;
+	io_uring_getevents_arg waitArg;
+	memset(&waitArg, 0, sizeof (waitArg));
+	if (milliSeconds > 0) {
+		timeout.tv_sec = milliSeconds / 1000;
+		timeout.tv_nsec = (long long) (milliSeconds % 1000) * 1000000;
+		waitArg.ts = (uint64_t) (size_t) & timeout;
+	}
+
+	uint64_t waitStart = StartWait();
+	int ret = UringEnter(uring->ringfd, toSubmit, milliSeconds ? 1 : 0,
+			IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+			&waitArg, sizeof (waitArg));
+	EndWait(waitStart);
+
+	// Timing out and a full completion queue aren't errors for us
+	if (ret == -1 && errno != ETIME && errno != EBUSY)
+		return false;
+
+	// Take our TCP samples while we're awake
+	if (tcpInfoInterval > 0)
+		SampleTCPInfo();
+
+	unsigned head = *uring->cqHead;
+	unsigned tail = __atomic_load_n(uring->cqTail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; ++head) {
+		io_uring_cqe* cqe = &uring->cqes[head & uring->cqMask];
+		IOUringComplete(cqe->user_data, cqe->res, cqe->flags);
+	}
+
+	__atomic_store_n(uring->cqHead, head, __ATOMIC_RELEASE);
+	uring->PublishBuffers();
+
+	return true;
+}
+
+void DigitalHaze::SocketPool::IOUringComplete(uint64_t userData, int32_t res,
+		uint32_t flags) {
+	uringOperation op = (uringOperation) (userData >> URING_OPSHIFT);
+	if (op == URINGOP_INTERNAL) {
+		// Our wake poll. Posted work is run after the wait.
+		if (userData == URING_WAKEUSERDATA && !(flags & IORING_CQE_F_MORE))
+			uring->wakeArmed = false;
+		return;
+	}
+
+	// Find the socket, if it's still ours
+	uint32_t slotIndex = (uint32_t) (userData & 0xFFFFFFFF);
+	uint32_t generationBits = (uint32_t) ((userData >> 32) & URING_GENERATIONMASK);
+	bool current = slotIndex < slots.size() && slots[slotIndex].inUse &&
+			(slots[slotIndex].generation & URING_GENERATIONMASK) == generationBits;
+
+	// Only recvs use our buffers, and they always go back to the ring
+	bool hasBuffer = flags & IORING_CQE_F_BUFFER;
+	uint16_t bufferID = (uint16_t) (flags >> IORING_CQE_BUFFER_SHIFT);
+	bool more = flags & IORING_CQE_F_MORE;
+
+	if (!current) {
+		if (hasBuffer)
+			uring->RecycleBuffer(bufferID);
+
+		if (op == URINGOP_SEND) {
+			// The kernel is done with this outgoing data
+			for (size_t i = 0; i < uring->retiredSends.size(); ++i) {
+				if (uring->retiredSends[i].first != userData) continue;
+				delete uring->retiredSends[i].second;
+				uring->retiredSends.erase(uring->retiredSends.begin() + i);
+				break;
+			}
+		} else if (op == URINGOP_ACCEPT && res >= 0) {
+			// A connection came in as the listener was removed
+			close(res);
+		}
+		return;
+	}
+
+	socketSlot& slot = slots[slotIndex];
+	uringSlotState& state = uring->slotStates[slotIndex];
+	SocketHandle handle = MakeHandle(slotIndex);
+
+	// Report each socket once per list per poll
+	bool readable = false, writable = false, errored = false;
+	bool accepted = false;
+
+	if (op == URINGOP_INGRESS || op == URINGOP_ACCEPT) {
+		bool healthy = true;
+
+		if (state.mode == URINGMODE_COMPLETION) {
+			IOSocket* sockio = static_cast<IOSocket*> (slot.entry.pSocket);
+
+			if (res > 0 && hasBuffer) {
+				void* received = uring->bufMemory + (size_t) bufferID * uring->bufSize;
+
+				if (ReserveBufferSpace(sockio->readBuffer, (size_t) res)) {
+					sockio->readBuffer.Write(received, (size_t) res);
+					readable = true;
+				} else if (memoryPolicies & MEMPOLICY_PAUSEREADS) {
+					// The kernel already took it off the socket, so it's
+					// kept over budget, and we stop asking for more.
+					MemoryBudget* budget = sockio->readBuffer.GetMemoryBudget();
+					sockio->readBuffer.SetMemoryBudget(nullptr);
+					sockio->readBuffer.Write(received, (size_t) res);
+					sockio->readBuffer.SetMemoryBudget(budget);
+
+					PauseForMemory(slotIndex);
+					readable = true;
+				} else {
+					// Our memory budget is spent
+					sockio->RecordErrno(ENOBUFS);
+					errored = true;
+					healthy = false;
+				}
+			} else if (res == 0) {
+				// Connection closed
+				sockio->RecordErrno(ECONNRESET);
+				errored = true;
+				healthy = false;
+			} else if (res < 0 && res != -ENOBUFS && res != -ECANCELED) {
+				sockio->RecordErrno(-res);
+				errored = true;
+				healthy = false;
+			}
+			// -ENOBUFS: our buffer ring ran dry. It's refilled by now.
+		} else if (state.mode == URINGMODE_ACCEPT) {
+			if (res >= 0) {
+				acceptedConnection conn;
+				conn.fd = res;
+				conn.listener = handle;
+				conn.pParam = slot.entry.pParam;
+				uring->accepted.push_back(conn);
+				accepted = true;
+				// Handlers take connections from OnReadable
+				readable = slot.entry.handler != nullptr;
+			} else if (res == -EINVAL || res == -ENOTSOCK || res == -EOPNOTSUPP) {
+				// Not something we can accept on. Report it readable instead.
+				state.mode = URINGMODE_READINESS;
+			} else if (res != -ECANCELED) {
+				slot.entry.pSocket->RecordErrno(-res);
+				errored = true;
+				healthy = false;
+			}
+		} else {
+			if (res > 0) {
+				readable = res & POLLIN;
+				errored = res & (POLLERR | POLLHUP | POLLNVAL);
+			} else if (res < 0 && res != -ECANCELED) {
+				slot.entry.pSocket->RecordErrno(-res);
+				errored = true;
+				healthy = false;
+			}
+		}
+
+		if (hasBuffer)
+			uring->RecycleBuffer(bufferID);
+
+		if (!more) {
+			state.ingressArmed = false;
+			// A finished multishot is restarted, unless the socket is done
+			// or paused
+			if (healthy && !slot.readPaused)
+				uring->toArm.push_back(handle);
+		}
+	} else if (op == URINGOP_SEND) {
+		if (res < 0) {
+			slot.entry.pSocket->RecordErrno(-res);
+			errored = true;
+			state.sending->ClearData();
+		} else state.sending->ShiftBufferFromFront((size_t) res);
+
+		if (state.sending->GetBufferDataLen()) {
+			// Partial send. The rest goes out before anything newer.
+			if (!IOUringSubmitSend(slotIndex)) {
+				IOSocket* sockio = static_cast<IOSocket*> (slot.entry.pSocket);
+				sockio->writeBuffer.Write(state.sending->GetBufferStart(),
+						state.sending->GetBufferDataLen(), 0);
+				state.sending->ClearData();
+			}
+		}
+
+		if (!state.sending->GetBufferDataLen()) {
+			state.spareSend = state.sending;
+			state.sending = nullptr;
+			if (!errored) writable = true;
+
+			// Anything written meanwhile goes out with our next poll
+			MarkEgressDirty(handle);
+		}
+	} else if (op == URINGOP_POLLOUT) {
+		state.pollOutArmed = false;
+		// Whatever is still unsent once the socket was told it's writable
+		// gets another POLLOUT.
+		MarkEgressDirty(handle);
+
+		if (res > 0) {
+			writable = res & POLLOUT;
+			errored = res & (POLLERR | POLLHUP | POLLNVAL);
+		} else if (res < 0 && res != -ECANCELED) {
+			slot.entry.pSocket->RecordErrno(-res);
+			errored = true;
+		}
+	}
+
+	if (readable || writable || errored || accepted) {
+		slot.lastActivity = cachedTime;
+		++pollEventCount;
+	}
+
+	// Handlers hear about every completion as it's worked in
+	if (slot.entry.handler) {
+		if (readable || writable || errored)
+			DispatchEvents(handle, readable, writable, errored);
+		return;
+	}
+
+	if (readable && state.readReport != uring->pollIteration) {
+		state.readReport = uring->pollIteration;
+		readList.push_back(handle);
+		++pollReadable;
+	}
+	if (writable && state.writeReport != uring->pollIteration) {
+		state.writeReport = uring->pollIteration;
+		writeList.push_back(handle);
+		++pollWritable;
+	}
+	if (errored && state.errorReport != uring->pollIteration) {
+		state.errorReport = uring->pollIteration;
+		errorList.push_back(handle);
+		++pollErrors;
+	}
+}
+
+int DigitalHaze::SocketPool::GetNextAcceptedFD(void** pParam, SocketHandle* pListener) {
+	if (!uring || uring->acceptedIndex >= uring->accepted.size())
+		return -1;
+
+	acceptedConnection& conn = uring->accepted[uring->acceptedIndex++];
+	if (pParam) *pParam = conn.pParam;
+	if (pListener) *pListener = conn.listener;
+	int fd = conn.fd;
+
+	// Start over once everything was claimed
+	if (uring->acceptedIndex == uring->accepted.size()) {
+		uring->accepted.clear();
+		uring->acceptedIndex = 0;
+	}
+
+	return fd;
+}
@@ -25,6 +25,7 @@
 #include "DH_TCPClientSocket.hpp"
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
@@ -120,6 +121,91 @@ bool DigitalHaze::TCPClientSocket::AttemptConnect(const char* hostname,
 	return false;
 }
 
+bool DigitalHaze::TCPClientSocket::AttemptNonBlockingConnect(const char* hostname,
+		unsigned short port) {
+	// Close any connection or thread we already have
+	this->CloseSocket();
+
+	// Parse the IP address. Nothing is looked up.
+	addrinfo hints, *servinfo;
+	memset(&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC; // IPv4 or v6
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	hints.ai_flags = AI_NUMERICSERV | AI_NUMERICHOST;
+
+	char portNumber[8];
+	snprintf(portNumber, sizeof (portNumber), "%hu", port);
+
+	if (0 != getaddrinfo(hostname, portNumber, &hints, &servinfo)) {
+		// Not a numeric address
+		Socket::RecordErrno(EINVAL);
+		return false;
+	}
+
+	int newsockfd = socket(servinfo->ai_family,
+			servinfo->ai_socktype | SOCK_NONBLOCK,
+			servinfo->ai_protocol);
+
+	if (newsockfd == -1) {
+		Socket::RecordErrno();
+		freeaddrinfo(servinfo);
+		return false;
+	}
+
+	SetConnectedAddress(servinfo->ai_addr, servinfo->ai_addrlen);
+
+	// Loopback connects may finish right away
+	if (0 == connect(newsockfd, servinfo->ai_addr, servinfo->ai_addrlen) ||
+		errno == EINPROGRESS) {
+		freeaddrinfo(servinfo);
+		IOSocket::sockfd = newsockfd;
+		return true;
+	}
+
+	Socket::RecordErrno();
+	close(newsockfd);
+	freeaddrinfo(servinfo);
+	SetConnectedAddress(nullptr, 0);
+	return false;
+}
+
+bool DigitalHaze::TCPClientSocket::FinishConnect() {
+	if (IOSocket::sockfd == -1) return false;
+
+	int connectError = 0;
+	socklen_t errorLen = sizeof (connectError);
+
+	if (0 != getsockopt(IOSocket::sockfd, SOL_SOCKET, SO_ERROR,
+		&connectError, &errorLen)) {
+		Socket::RecordErrno();
+		this->CloseSocket();
+		return false;
+	}
+
+	if (connectError) {
+		Socket::RecordErrno(connectError);
+		this->CloseSocket();
+		return false;
+	}
+
+	// A read may have taken the error already. Then we have no peer.
+	TCPAddressStorage peerAddress;
+	socklen_t peerAddressLen = sizeof (peerAddress);
+	if (0 != getpeername(IOSocket::sockfd, &peerAddress.sa, &peerAddressLen)) {
+		Socket::RecordErrno();
+		this->CloseSocket();
+		return false;
+	}
+
+	// Our reads and writes choose for themselves whether to wait
+	int flags = fcntl(IOSocket::sockfd, F_GETFL);
+	if (flags != -1)
+		fcntl(IOSocket::sockfd, F_SETFL, flags & ~O_NONBLOCK);
+
+	return true;
+}
+
 struct threadedconnectdata {
 	char* hostname;
 	unsigned short port;
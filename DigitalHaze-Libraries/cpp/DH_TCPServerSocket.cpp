@@ -23,11 +23,18 @@
  */
 
 #include "DH_TCPServerSocket.hpp"
+#include "DH_SocketPool.hpp"
+#include "DH_TCPSocketRecycler.hpp"
+#include "DH_IPFilter.hpp"
 #include "DH_Buffer.hpp"
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include <cstring>
 #include <utility>
@@ -39,14 +46,19 @@
 enum ListenerThreadStatusCode {
 	UNKNOWN = 0,
 	STARTED,
-	NEWCONNECTION,
 	FAILED
 };
 
 DigitalHaze::TCPServerSocket::TCPServerSocket()
 	: Socket(), ThreadLockedObject(),
 	listenerThreadStatus(ListenerThreadStatusCode::UNKNOWN),
-	waitNewConnectionCond(PTHREAD_COND_INITIALIZER) {
+	listenerThreadJoinable(false),
+	reusePort(false), nonBlocking(false),
+	deferAcceptSeconds(0), fastOpenQueueLength(0), socketRecycler(nullptr),
+	admissionControl(nullptr), ipFilter(nullptr),
+	waitNewConnectionCond(PTHREAD_COND_INITIALIZER),
+	acceptQueue(DH_TCPSERVER_ACCEPTQUEUESIZE), acceptorWaiting(false),
+	notifyPending(false) {
 }
 
 DigitalHaze::TCPServerSocket::~TCPServerSocket() {
@@ -98,11 +110,31 @@ bool DigitalHaze::TCPServerSocket::CreateListener(unsigned short port) {
 			continue;
 		}
 
+		if (reusePort && setsockopt(newsockfd, SOL_SOCKET, SO_REUSEPORT,
+			&trueFlag, sizeof (int)) < 0) {
+			Socket::RecordErrno();
+			close(newsockfd);
+			newsockfd = -1;
+			continue;
+		}
+
 		if (newsockfd == -1) {
 			Socket::RecordErrno();
 			continue; // Lets try again
 		}
 
+		// Fast Open has to be on before we listen, or the first clients
+		// miss it. Deferring accepts works either way.
+		if ((fastOpenQueueLength && setsockopt(newsockfd, IPPROTO_TCP, TCP_FASTOPEN,
+			&fastOpenQueueLength, sizeof (int)) < 0) ||
+			(deferAcceptSeconds && setsockopt(newsockfd, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+			&deferAcceptSeconds, sizeof (int)) < 0)) {
+			Socket::RecordErrno();
+			close(newsockfd);
+			newsockfd = -1;
+			continue;
+		}
+
 		// Returns -1 on error, but we're checking for success
 		if (0 == bind(newsockfd, ipResult->ai_addr, ipResult->ai_addrlen)) {
 			// Successful on bind
@@ -125,12 +157,96 @@ bool DigitalHaze::TCPServerSocket::CreateListener(unsigned short port) {
 	if (newsockfd != -1) {
 		// Store
 		sockfd = newsockfd;
+		if (nonBlocking) SetNonBlocking(true);
 		return true;
 	}
 
 	return false; // No address worked
 }
 
+bool DigitalHaze::TCPServerSocket::SetNonBlocking(bool enable) {
+	nonBlocking = enable;
+
+	// Applied when we start listening
+	if (sockfd == -1) return true;
+
+	int flags = fcntl(sockfd, F_GETFL);
+	if (flags == -1) {
+		Socket::RecordErrno();
+		return false;
+	}
+
+	flags = enable ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+	if (0 != fcntl(sockfd, F_SETFL, flags)) {
+		Socket::RecordErrno();
+		return false;
+	}
+
+	return true;
+}
+
+bool DigitalHaze::TCPServerSocket::SetDeferAccept(int seconds) {
+	deferAcceptSeconds = seconds > 0 ? seconds : 0;
+
+	// Applied when we start listening
+	if (sockfd == -1) return true;
+
+	if (0 != setsockopt(sockfd, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+		&deferAcceptSeconds, sizeof (int))) {
+		Socket::RecordErrno();
+		return false;
+	}
+
+	return true;
+}
+
+bool DigitalHaze::TCPServerSocket::SetFastOpen(int queueLength) {
+	fastOpenQueueLength = queueLength > 0 ? queueLength : 0;
+
+	// Applied when we start listening
+	if (sockfd == -1) return true;
+
+	if (0 != setsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN,
+		&fastOpenQueueLength, sizeof (int))) {
+		Socket::RecordErrno();
+		return false;
+	}
+
+	return true;
+}
+
+bool DigitalHaze::TCPServerSocket::AdmitConnection(int newfd,
+		const TCPAddressStorage& addr, AdmissionTicket& ticketOut) {
+	if ((!ipFilter || ipFilter->IsAllowed(&addr.sa))
+		&& (!admissionControl
+		|| admissionControl->Admit(&addr.sa, ticketOut) == ADMIT_ACCEPTED))
+		return true;
+
+	close(newfd);
+	return false;
+}
+
+DigitalHaze::TCPSocket* DigitalHaze::TCPServerSocket::WrapConnection(int newfd,
+		AdmissionTicket&& ticket) {
+	TCPSocket* newSocket;
+
+	if (socketRecycler) newSocket = socketRecycler->Acquire(newfd);
+	else newSocket = new TCPSocket(newfd);
+
+	if (ticket.IsHeld()) newSocket->SetAdmissionTicket(std::move(ticket));
+
+	ReadOnAccept(newSocket);
+	return newSocket;
+}
+
+void DigitalHaze::TCPServerSocket::ReadOnAccept(TCPSocket* newSocket) {
+	if (!deferAcceptSeconds && !fastOpenQueueLength) return;
+
+	// Doesn't wait if nothing came. If the connection already failed,
+	// it's reported when it's next polled or read.
+	newSocket->PerformSocketRead();
+}
+
 struct threadedacceptdata {
 	DigitalHaze::TCPServerSocket* parent;
 };
@@ -145,16 +261,27 @@ void CleanupListenerThread(void* data) {
 }
 
 // Cleanup in case we got a valid connection, but the thread was canceled.
+// Closes it, and gives its admission ticket back.
 
-void CleanupNewConnectionSocket(void* data) {
+void DigitalHaze::CleanupNewConnection(void* data) {
 	if (data) {
-		int fd = *(int*) data; // We don't mind losing precision
-		if (fd != -1) {
-			close(fd);
+		TCPServerSocket::queuedConnection* conn =
+				(TCPServerSocket::queuedConnection*) data;
+		if (conn->fd != -1) {
+			close(conn->fd);
 		}
+		AdmissionTicket(conn->admittedBy, conn->admissionKey,
+						conn->admissionCounted).Release();
 	}
 }
 
+// Cleanup in case we were canceled while waiting on our parent's lock.
+// Waiting on a condition takes the lock back before we're canceled.
+
+void CleanupListenerLock(void* data) {
+	((DigitalHaze::TCPServerSocket*) data)->UnlockObject();
+}
+
 void* DigitalHaze::ListenerThread(void* data) {
 	if (!data) {
 		// Someone tried to start this thread improperly
@@ -190,10 +317,10 @@ void* DigitalHaze::ListenerThread(void* data) {
 	tad->parent->UnlockObject();
 
 	for (;;) {
-		TCPAddressStorage remoteAddr;
-		socklen_t remoteAddrLen = sizeof (remoteAddr);
+		TCPServerSocket::queuedConnection conn;
+		conn.addrLen = sizeof (conn.addr);
 
-		int newSocketfd = accept(listenerfd, (sockaddr*) & remoteAddr, &remoteAddrLen);
+		int newSocketfd = accept(listenerfd, (sockaddr*) & conn.addr, &conn.addrLen);
 
 		// Did we error?
 		if (newSocketfd == -1) {
@@ -201,6 +328,10 @@ void* DigitalHaze::ListenerThread(void* data) {
 			int currentErrno = errno; // cache errno
 			pthread_testcancel();
 
+			// The connection went away before we got to it
+			if (currentErrno == EINTR || currentErrno == ECONNABORTED)
+				continue;
+
 			// Record the error in our parent
 			tad->parent->LockObject();
 			tad->parent->Thread_RecordErrno(currentErrno);
@@ -212,37 +343,27 @@ void* DigitalHaze::ListenerThread(void* data) {
 
 		// New connection!!
 
-		// First, check if our thread was canceled. If it was, we will
-		// need to close this new connection.
-		pthread_cleanup_push(CleanupNewConnectionSocket, &newSocketfd);
+		// Drop it now if we don't want it
+		AdmissionTicket ticket;
+		if (!tad->parent->AdmitConnection(newSocketfd, conn.addr, ticket))
+			continue;
+		conn.fd = newSocketfd;
+		if (!ticket.Detach(conn.admittedBy, conn.admissionKey,
+			conn.admissionCounted))
+			conn.admittedBy = nullptr;
+
+		// If our thread is canceled before the connection is queued, the
+		// connection has to be closed and its ticket given back.
+		pthread_cleanup_push(CleanupNewConnection, &conn);
 		pthread_testcancel();
-		pthread_cleanup_pop(0); // Do not execute the cleanup if we can help it
-
-		// Notify the parent about the new connection
-		tad->parent->LockObject();
-		tad->parent->Thread_NotifyNewClient(newSocketfd, &remoteAddr, remoteAddrLen);
-		tad->parent->listenerThreadStatus = ListenerThreadStatusCode::NEWCONNECTION;
-
-		// Halt our thread until the parent thread retrieves new client info.
-		// Then we can begin working on another client
-		while (tad->parent->listenerThreadStatus
-			== ListenerThreadStatusCode::NEWCONNECTION) {
-			// Release the lock and wait on a signal.
-			tad->parent->WaitOnCondition(tad->parent->waitNewConnectionCond);
-
-			// We may have been woken up and canceled.
-			// Release the lock, then make sure.
-			tad->parent->UnlockObject();
-			pthread_testcancel();
 
-			// Reacquire since we're not canceled.
-			tad->parent->LockObject();
-		}
+		// Hand it over. If the queue is full, this waits for room while
+		// the kernel's backlog holds the rest.
+		tad->parent->Thread_QueueNewClient(conn);
 
-		tad->parent->UnlockObject();
+		pthread_cleanup_pop(0);
 
-		// Now that we're done with our wait condition, test again
-		pthread_testcancel();
+		tad->parent->NotifyQueuedConnections();
 	}
 
 	// Call our thread parameters cleanup with a non-zero execute parameter
@@ -258,23 +379,26 @@ bool DigitalHaze::TCPServerSocket::CreateThreadedListener(unsigned short port) {
 	if (!CreateListener(port))
 		return false;
 
+	// Our notifier lives as long as we do, so pools can keep polling it
+	if (acceptNotifier.sockfd == -1) {
+		acceptNotifier.sockfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (acceptNotifier.sockfd == -1) {
+			Socket::RecordErrno();
+			return false;
+		}
+	}
+
 	// Set the parameters
 	volatile threadedacceptdata* tad = new threadedacceptdata;
 	tad->parent = this;
 
 	// Init
 	listenerThreadStatus = ListenerThreadStatusCode::STARTED;
-	
-	// A listener will only exit when canceled or if an error has occurred.
-	// There is no reason to wait for a listener to close, so we won't
-	// join it when closing the threads. Instead, we will just keep it
-	// as detached.
-	pthread_attr_t threadAttr;
-	pthread_attr_init( &threadAttr );
-	pthread_attr_setdetachstate( &threadAttr, PTHREAD_CREATE_DETACHED );
-
-	// Create thread
-	if (0 != pthread_create(&listenerThread, &threadAttr,
+
+	// A listener only exits when canceled or if an error has occurred.
+	// It's joined when closing, so it can't touch us or our queue once
+	// we're gone.
+	if (0 != pthread_create(&listenerThread, nullptr,
 		DigitalHaze::ListenerThread, (void*) tad)) {
 		Socket::RecordErrno();
 		listenerThreadStatus = ListenerThreadStatusCode::FAILED;
@@ -282,44 +406,189 @@ bool DigitalHaze::TCPServerSocket::CreateThreadedListener(unsigned short port) {
 		return false;
 	}
 
+	listenerThreadJoinable = true;
 	return true;
 }
 
-DigitalHaze::TCPSocket*
-DigitalHaze::TCPServerSocket::GetNewConnectionFromThread(TCPAddressStorage* newAddr,
-		socklen_t* newAddrLen) {
-	// Check our thread status code
-	if (listenerThreadStatus != ListenerThreadStatusCode::NEWCONNECTION)
-		return nullptr;
+void DigitalHaze::TCPServerSocket::Thread_QueueNewClient(const queuedConnection& conn) {
+	if (acceptQueue.TryPush(conn)) return;
+
+	// Full. Wait until someone takes a connection.
+	LockObject();
+	pthread_cleanup_push(CleanupListenerLock, this);
+
+	acceptorWaiting.store(true, std::memory_order_relaxed);
+	// Pairs with the fence in WakeAcceptor. Either they see us waiting,
+	// or we see the room they made.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
 
+	while (!acceptQueue.TryPush(conn))
+		WaitOnCondition(waitNewConnectionCond);
+
+	acceptorWaiting.store(false, std::memory_order_relaxed);
+
+	pthread_cleanup_pop(1);
+}
+
+void DigitalHaze::TCPServerSocket::NotifyQueuedConnections() {
+	// Only the first connection since the last read has to write
+	if (notifyPending.exchange(true, std::memory_order_acq_rel)) return;
+
+	uint64_t one = 1;
+	ssize_t written = write(acceptNotifier.sockfd, &one, sizeof (one));
+	(void) written; // Only fails if the counter is full, which still notifies
+}
+
+void DigitalHaze::TCPServerSocket::WakeAcceptor() {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!acceptorWaiting.load(std::memory_order_relaxed)) return;
+
+	LockObject();
+	SignalCondition(waitNewConnectionCond);
+	UnlockObject();
+}
+
+DigitalHaze::TCPSocket*
+DigitalHaze::TCPServerSocket::TakeQueuedConnection(const queuedConnection& conn,
+		TCPAddressStorage* newAddr, socklen_t* newAddrLen) {
 	socklen_t copyAddrLen;
 
 	// If we have a length given to us..
 	if (newAddrLen) // Copy the smaller
 	{
 		// Use the smaller size for memcpy
-		copyAddrLen = *newAddrLen < remoteAddrLen ? *newAddrLen : remoteAddrLen;
-		*newAddrLen = remoteAddrLen; // Copy correct address size
+		copyAddrLen = *newAddrLen < conn.addrLen ? *newAddrLen : conn.addrLen;
 	} else
-		copyAddrLen = sizeof (TCPAddressStorage); // Otherwise assume it's big enough
+		copyAddrLen = conn.addrLen; // Otherwise assume it's big enough
 
 	// If address info is requested, fill it in
-	if (newAddr) memcpy(newAddr, &remoteAddr, copyAddrLen);
+	if (newAddr) memcpy(newAddr, &conn.addr, copyAddrLen);
+	if (newAddrLen) *newAddrLen = copyAddrLen;
 
-	// Create our new socket
-	TCPSocket* newClient = new TCPSocket(newsockfd);
+	return WrapConnection(conn.fd, AdmissionTicket(conn.admittedBy,
+			conn.admissionKey, conn.admissionCounted));
+}
 
-	// Signal our thread that it can start accepting new connections again
-	listenerThreadStatus = ListenerThreadStatusCode::STARTED;
-	SignalCondition(waitNewConnectionCond);
+DigitalHaze::TCPSocket*
+DigitalHaze::TCPServerSocket::GetNewConnectionFromThread(TCPAddressStorage* newAddr,
+		socklen_t* newAddrLen) {
+	TCPSocket* newClient = nullptr;
+	socklen_t addrLen = newAddrLen ? *newAddrLen : sizeof (TCPAddressStorage);
 
-	if (newAddrLen) *newAddrLen = copyAddrLen;
+	if (GetNewConnections(&newClient, 1, newAddr, &addrLen) && newAddrLen)
+		*newAddrLen = addrLen;
 
-	// And we have retrieved all info. The caller should unlock the mutex
-	// and then the thread will reacquire it.
 	return newClient;
 }
 
+size_t DigitalHaze::TCPServerSocket::GetNewConnections(TCPSocket** socketsOut,
+		size_t maxCount, TCPAddressStorage* addrsOut, socklen_t* addrLensOut) {
+	if (!maxCount) return 0;
+
+	if (listenerThreadStatus == ListenerThreadStatusCode::UNKNOWN) {
+		// No thread, so it's up to the listener itself
+		socketsOut[0] = GetNewConnection(addrsOut, addrLensOut);
+		return socketsOut[0] ? 1 : 0;
+	}
+
+	// Read the notification before taking connections, so any queued
+	// after we looked write it again.
+	if (notifyPending.exchange(false, std::memory_order_acq_rel)) {
+		uint64_t count;
+		ssize_t readLen = read(acceptNotifier.sockfd, &count, sizeof (count));
+		(void) readLen;
+	}
+
+	size_t taken = 0;
+	queuedConnection conn;
+	while (taken < maxCount && acceptQueue.TryPop(conn)) {
+		socketsOut[taken] = TakeQueuedConnection(conn,
+				addrsOut ? addrsOut + taken : nullptr,
+				addrLensOut ? addrLensOut + taken : nullptr);
+		++taken;
+	}
+
+	if (taken)
+		WakeAcceptor();
+
+	// We left some behind, so keep our notifier readable
+	if (taken == maxCount && acceptQueue.GetSizeApprox())
+		NotifyQueuedConnections();
+
+	return taken;
+}
+
+size_t DigitalHaze::TCPServerSocket::AcceptConnections(TCPSocket** socketsOut,
+		size_t maxCount, SocketPool* targetPool, void* pParam,
+		SocketEventHandler* handler) {
+	TCPSocket* newSocket;
+	size_t accepted = 0;
+
+	// Our thread does the accepting
+	if (listenerThreadStatus != ListenerThreadStatusCode::UNKNOWN) {
+		while (accepted < maxCount && GetNewConnections(&newSocket, 1)) {
+			if (targetPool) targetPool->AddSocket(newSocket, pParam, handler);
+			if (socketsOut) socketsOut[accepted] = newSocket;
+			++accepted;
+		}
+		return accepted;
+	}
+
+	if (!nonBlocking && !SetNonBlocking(true))
+		return 0;
+
+	while (accepted < maxCount) {
+		// The address is only needed to decide on the connection
+		bool wantAddr = admissionControl || ipFilter;
+		TCPAddressStorage newAddr;
+		socklen_t newAddrLen = sizeof (newAddr);
+		int newfd = accept4(sockfd,
+				wantAddr ? (sockaddr*) & newAddr : nullptr,
+				wantAddr ? &newAddrLen : nullptr,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if (newfd == -1) {
+			// The connection went away before we got to it
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+
+			// EAGAIN if there's nothing left, which is what we want
+			Socket::RecordErrno();
+			break;
+		}
+
+		AdmissionTicket ticket;
+		if (!AdmitConnection(newfd, newAddr, ticket)) continue;
+
+		newSocket = WrapConnection(newfd, std::move(ticket));
+		if (targetPool) targetPool->AddSocket(newSocket, pParam, handler);
+		if (socketsOut) socketsOut[accepted] = newSocket;
+		++accepted;
+	}
+
+	return accepted;
+}
+
+DigitalHaze::TCPSocket* DigitalHaze::TCPServerSocket::AdoptAcceptedFD(int newfd) {
+	TCPAddressStorage newAddr;
+	AdmissionTicket ticket;
+
+	// The address is only needed to decide on the connection. Whoever
+	// accepted it didn't keep it, so ask the kernel.
+	if (admissionControl || ipFilter) {
+		socklen_t newAddrLen = sizeof (newAddr);
+		if (0 != getpeername(newfd, &newAddr.sa, &newAddrLen)) {
+			// Gone already, and we can't decide on it anyway
+			Socket::RecordErrno();
+			close(newfd);
+			return nullptr;
+		}
+
+		if (!AdmitConnection(newfd, newAddr, ticket)) return nullptr;
+	}
+
+	return WrapConnection(newfd, std::move(ticket));
+}
+
 DigitalHaze::TCPSocket*
 DigitalHaze::TCPServerSocket::GetNewConnection(TCPAddressStorage* newAddr,
 		socklen_t* newAddrLen) {
@@ -332,36 +601,52 @@ DigitalHaze::TCPServerSocket::GetNewConnection(TCPAddressStorage* newAddr,
 			remoteAddrLen = sizeof (remoteAddr); // Assume it's big enough
 		}
 
-		int newfd = accept(sockfd, (sockaddr*) newAddr, newAddrLen);
+		socklen_t addrLenGiven = *newAddrLen;
+		AdmissionTicket ticket;
+		int newfd;
 
-		if (newfd == -1) {
-			// Error
-			Socket::RecordErrno();
-			return nullptr;
-		}
+		// Refused connections are closed, so wait for the next one
+		do {
+			*newAddrLen = addrLenGiven;
+			newfd = accept(sockfd, (sockaddr*) newAddr, newAddrLen);
+
+			if (newfd == -1) {
+				// Error
+				Socket::RecordErrno();
+				return nullptr;
+			}
+		} while (!AdmitConnection(newfd, *newAddr, ticket));
 
-		return new TCPSocket(newfd);
+		return WrapConnection(newfd, std::move(ticket));
 	}
 
 	// In a threaded listen state
 	return GetNewConnectionFromThread(newAddr, newAddrLen);
 }
 
-void DigitalHaze::TCPServerSocket::Thread_NotifyNewClient(int newfd,
-		TCPAddressStorage* addr,
-		socklen_t addrLen) {
-	newsockfd = newfd;
-	memcpy(&remoteAddr, addr, addrLen);
-	remoteAddrLen = addrLen;
-}
-
 void DigitalHaze::TCPServerSocket::CloseCurrentThreads() {
-	switch (listenerThreadStatus) {
-		case ListenerThreadStatusCode::STARTED:
-		case ListenerThreadStatusCode::NEWCONNECTION:
+	if (listenerThreadJoinable) {
+		// A failed thread already exited, but still has to be joined
+		if (listenerThreadStatus == ListenerThreadStatusCode::STARTED)
 			pthread_cancel(listenerThread);
-			break;
+
+		pthread_join(listenerThread, nullptr);
+		listenerThreadJoinable = false;
 	}
 
 	listenerThreadStatus = ListenerThreadStatusCode::UNKNOWN;
+
+	// Nobody is going to take these now
+	queuedConnection conn;
+	while (acceptQueue.TryPop(conn)) {
+		close(conn.fd);
+		AdmissionTicket(conn.admittedBy, conn.admissionKey,
+			conn.admissionCounted).Release();
+	}
+
+	if (notifyPending.exchange(false, std::memory_order_acq_rel)) {
+		uint64_t count;
+		ssize_t readLen = read(acceptNotifier.sockfd, &count, sizeof (count));
+		(void) readLen;
+	}
 }
\ No newline at end of file
@@ -26,7 +26,14 @@
 
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+
+#include <cstring>
+#include <utility>
 
 #include <errno.h>
 
@@ -40,6 +47,20 @@ DigitalHaze::TCPSocket::TCPSocket(int connectedfd) : IOSocket() {
 DigitalHaze::TCPSocket::~TCPSocket() {
 }
 
+void DigitalHaze::TCPSocket::AdoptConnection(int connectedfd) {
+	CloseSocket();
+	IOSocket::sockfd = connectedfd;
+}
+
+void DigitalHaze::TCPSocket::SetAdmissionTicket(AdmissionTicket&& ticket) {
+	admissionTicket = std::move(ticket);
+}
+
+void DigitalHaze::TCPSocket::CloseSocket() {
+	IOSocket::CloseSocket();
+	admissionTicket.Release();
+}
+
 bool DigitalHaze::TCPSocket::PerformSocketRead(size_t len, bool flush) {
 	// Check how many bytes to read.
 	// If not specified, then read as many as we can!
@@ -51,15 +72,22 @@ bool DigitalHaze::TCPSocket::PerformSocketRead(size_t len, bool flush) {
 
 			// Expand by our realloc size. If realloclen ends up being zero,
 			// this will throw an error.
-			IOSocket::readBuffer.ExpandBuffer();
+			if (!IOSocket::readBuffer.TryExpandBuffer()) {
+				// Our memory budget is spent
+				Socket::RecordErrno(ENOBUFS);
+				return false;
+			}
 		}
 	}
 
 	// Make sure we have enough space.
 	if (len > IOSocket::readBuffer.GetRemainingBufferLength()) {
 		// We don't have enough space, expand
-		IOSocket::readBuffer
-				.ExpandBuffer(len - IOSocket::readBuffer.GetRemainingBufferLength());
+		if (!IOSocket::readBuffer
+				.TryExpandBuffer(len - IOSocket::readBuffer.GetRemainingBufferLength())) {
+			Socket::RecordErrno(ENOBUFS);
+			return false;
+		}
 	}
 
 	// read
@@ -67,8 +95,15 @@ bool DigitalHaze::TCPSocket::PerformSocketRead(size_t len, bool flush) {
 			readBuffer.GetBufferEnd(), len,
 			flush ? MSG_WAITALL : MSG_DONTWAIT);
 
+	// Our peer shut down the connection. recv leaves errno alone for
+	// this, so don't let a stale EAGAIN pass for "nothing to read".
+	if (nBytes == 0) {
+		Socket::RecordErrno(ECONNRESET);
+		return false;
+	}
+
 	// error?
-	if (nBytes <= 0) {
+	if (nBytes < 0) {
 		Socket::RecordErrno();
 		if (!flush && (Socket::lasterrno == EAGAIN ||
 			Socket::lasterrno == EWOULDBLOCK)) {
@@ -117,6 +152,7 @@ bool DigitalHaze::TCPSocket::PerformSocketWrite(bool flush) {
 
 	// Remove the data we just wrote.
 	IOSocket::writeBuffer.ShiftBufferFromFront(totalWritten);
+	if (totalWritten) IOSocket::NotifyEgressChange(true);
 
 	return true;
 }
@@ -125,6 +161,66 @@ bool DigitalHaze::TCPSocket::isConnected() const {
 	return IOSocket::sockfd != -1;
 }
 
+bool DigitalHaze::TCPSocket::GetTCPInfo(TCPInfoSnapshot& infoOut,
+		bool includeQueueSizes) {
+	tcp_info info;
+	socklen_t infoLen = sizeof (info);
+
+	// Older kernels may fill in less than the whole structure,
+	// so anything they don't know about stays zero.
+	memset(&info, 0, sizeof (info));
+
+	if (0 != getsockopt(IOSocket::sockfd, IPPROTO_TCP, TCP_INFO, &info, &infoLen)) {
+		Socket::RecordErrno();
+		return false;
+	}
+
+	infoOut.state = info.tcpi_state;
+	infoOut.congestionState = info.tcpi_ca_state;
+	infoOut.retransmits = info.tcpi_retransmits;
+	infoOut.probes = info.tcpi_probes;
+	infoOut.backoff = info.tcpi_backoff;
+	infoOut.rto = info.tcpi_rto;
+	infoOut.sendMSS = info.tcpi_snd_mss;
+	infoOut.recvMSS = info.tcpi_rcv_mss;
+	infoOut.unackedPackets = info.tcpi_unacked;
+	infoOut.sackedPackets = info.tcpi_sacked;
+	infoOut.lostPackets = info.tcpi_lost;
+	infoOut.retransPackets = info.tcpi_retrans;
+	infoOut.lastDataSentMs = info.tcpi_last_data_sent;
+	infoOut.lastDataRecvMs = info.tcpi_last_data_recv;
+	infoOut.pathMTU = info.tcpi_pmtu;
+	infoOut.rtt = info.tcpi_rtt;
+	infoOut.rttVar = info.tcpi_rttvar;
+	infoOut.sendSSThresh = info.tcpi_snd_ssthresh;
+	infoOut.sendCwnd = info.tcpi_snd_cwnd;
+	infoOut.reordering = info.tcpi_reordering;
+	infoOut.recvRTT = info.tcpi_rcv_rtt;
+	infoOut.recvSpace = info.tcpi_rcv_space;
+	infoOut.totalRetrans = info.tcpi_total_retrans;
+
+	infoOut.unackedBytes = 0;
+	infoOut.unsentBytes = 0;
+	infoOut.recvQueueBytes = 0;
+
+	if (includeQueueSizes) {
+		int queueLen;
+
+		if (0 == ioctl(IOSocket::sockfd, SIOCOUTQ, &queueLen))
+			infoOut.unackedBytes = (uint32_t) queueLen;
+		if (0 == ioctl(IOSocket::sockfd, SIOCOUTQNSD, &queueLen))
+			infoOut.unsentBytes = (uint32_t) queueLen;
+		if (0 == ioctl(IOSocket::sockfd, SIOCINQ, &queueLen))
+			infoOut.recvQueueBytes = (uint32_t) queueLen;
+
+		// SIOCOUTQ counts unsent bytes too, take them out
+		if (infoOut.unackedBytes >= infoOut.unsentBytes)
+			infoOut.unackedBytes -= infoOut.unsentBytes;
+	}
+
+	return true;
+}
+
 bool DigitalHaze::TCPSocket::ConvertAddrToText(TCPAddressStorage& addr,
 		socklen_t len,
 		char* outText) {
@@ -0,0 +1,99 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_TCPSocketRecycler.cpp
+ * Author: phytress
+ *
+ * Created on October 19, 2026, 1:40 PM
+ */
+
+#include "DH_TCPSocketRecycler.hpp"
+
+#include <cstring>
+
+DigitalHaze::TCPSocketRecycler::TCPSocketRecycler(size_t maxSpares,
+		size_t preallocate)
+	: ThreadLockedObject(), maxPooled(maxSpares) {
+	memset(&stats, 0, sizeof (stats));
+	spareSockets.reserve(maxPooled);
+
+	if (preallocate > maxPooled) preallocate = maxPooled;
+	for (size_t i = 0; i < preallocate; ++i)
+		spareSockets.push_back(new TCPSocket());
+}
+
+DigitalHaze::TCPSocketRecycler::~TCPSocketRecycler() {
+	for (size_t i = 0; i < spareSockets.size(); ++i)
+		delete spareSockets[i];
+}
+
+DigitalHaze::TCPSocket* DigitalHaze::TCPSocketRecycler::Acquire(int connectedfd) {
+	TCPSocket* pSocket = nullptr;
+
+	LockObject();
+	if (!spareSockets.empty()) {
+		pSocket = spareSockets.back();
+		spareSockets.pop_back();
+		++stats.reused;
+	} else ++stats.allocated;
+	UnlockObject();
+
+	// Out of spares, so allocate outside of our lock
+	if (!pSocket)
+		return new TCPSocket(connectedfd);
+
+	pSocket->AdoptConnection(connectedfd);
+	return pSocket;
+}
+
+void DigitalHaze::TCPSocketRecycler::Release(TCPSocket* pSocket) {
+	if (!pSocket) return;
+
+	// Outside of our lock, since it may close the connection
+	pSocket->ResetForReuse();
+
+	LockObject();
+	++stats.released;
+	if (spareSockets.size() < maxPooled) {
+		spareSockets.push_back(pSocket);
+		pSocket = nullptr;
+	} else ++stats.discarded;
+	UnlockObject();
+
+	delete pSocket;
+}
+
+size_t DigitalHaze::TCPSocketRecycler::GetSpareCount() {
+	LockObject();
+	size_t spareCount = spareSockets.size();
+	UnlockObject();
+	return spareCount;
+}
+
+void DigitalHaze::TCPSocketRecycler::GetStats(TCPSocketRecyclerStats& statsOut) {
+	LockObject();
+	statsOut = stats;
+	UnlockObject();
+}
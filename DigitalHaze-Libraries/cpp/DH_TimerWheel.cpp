@@ -0,0 +1,298 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_TimerWheel.cpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 3:20 PM
+ */
+
+#include "DH_TimerWheel.hpp"
+
+#include <string.h>
+
+#define NOTIMERNODE UINT32_MAX
+#define UNUSEDWHEELSLOT UINT16_MAX
+#define SLOTMASK (DH_TIMERWHEEL_SLOTS - 1)
+// Where timers added at or before the current time wait
+#define OVERDUEWHEELSLOT (DH_TIMERWHEEL_LEVELS * DH_TIMERWHEEL_SLOTS)
+// The furthest a timer can be set from the current tick
+#define MAXTIMERDELTA ((1ULL << (DH_TIMERWHEEL_SLOTBITS * DH_TIMERWHEEL_LEVELS)) - 1)
+
+DigitalHaze::TimerWheel::TimerWheel(uint64_t startTime, size_t reserveTimers)
+: freeHead(NOTIMERNODE), timerCount(0), currentTick(startTime + 1) {
+	for (size_t i = 0; i <= OVERDUEWHEELSLOT; ++i)
+		slotHeads[i] = NOTIMERNODE;
+	memset(occupied, 0, sizeof (occupied));
+
+	nodes.reserve(reserveTimers);
+}
+
+DigitalHaze::TimerWheel::~TimerWheel() {
+}
+
+DigitalHaze::TimerHandle DigitalHaze::TimerWheel::AddTimer(uint64_t expireTime,
+														TimerCallback callback, void* pParam) {
+	uint32_t nodeIndex;
+
+	if (freeHead != NOTIMERNODE) {
+		nodeIndex = freeHead;
+		freeHead = nodes[nodeIndex].next;
+	} else {
+		nodeIndex = (uint32_t) nodes.size();
+		timerNode newNode;
+		newNode.generation = 1;
+		nodes.push_back(newNode);
+	}
+
+	timerNode& node = nodes[nodeIndex];
+	node.expireTime = expireTime;
+	node.callback = callback;
+	node.pParam = pParam;
+	Link(nodeIndex);
+
+	++timerCount;
+	return ((uint64_t) node.generation << 32) | nodeIndex;
+}
+
+bool DigitalHaze::TimerWheel::CancelTimer(TimerHandle handle) {
+	if (!GetNode(handle)) return false;
+
+	uint32_t nodeIndex = GetTimerIndex(handle);
+	Unlink(nodeIndex);
+	FreeNode(nodeIndex);
+	return true;
+}
+
+bool DigitalHaze::TimerWheel::RescheduleTimer(TimerHandle handle, uint64_t expireTime) {
+	if (!GetNode(handle)) return false;
+
+	uint32_t nodeIndex = GetTimerIndex(handle);
+	Unlink(nodeIndex);
+	nodes[nodeIndex].expireTime = expireTime;
+	Link(nodeIndex);
+	return true;
+}
+
+bool DigitalHaze::TimerWheel::IsPending(TimerHandle handle) const {
+	return GetNode(handle) != nullptr;
+}
+
+uint64_t DigitalHaze::TimerWheel::GetExpireTime(TimerHandle handle) const {
+	const timerNode* node = GetNode(handle);
+	return node ? node->expireTime : 0;
+}
+
+size_t DigitalHaze::TimerWheel::Advance(uint64_t now) {
+	// Overdue timers don't wait for the clock to move
+	size_t fired = FireSlot(OVERDUEWHEELSLOT);
+
+	while (currentTick <= now) {
+		unsigned slotIndex = (unsigned) (currentTick & SLOTMASK);
+
+		// Nothing due for the rest of this rotation? Skip to its end.
+		if (FindOccupiedSlot(0, slotIndex) < 0) {
+			uint64_t rotationEnd = currentTick | SLOTMASK;
+			currentTick = (rotationEnd < now ? rotationEnd : now) + 1;
+			if (!(currentTick & SLOTMASK)) CascadeInward();
+			continue;
+		}
+
+		fired += FireSlot(slotIndex);
+		// Callbacks may have added timers for earlier ticks
+		fired += FireSlot(OVERDUEWHEELSLOT);
+
+		if (!(++currentTick & SLOTMASK)) CascadeInward();
+	}
+
+	return fired;
+}
+
+uint64_t DigitalHaze::TimerWheel::GetNextExpiry() const {
+	if (!timerCount) return UINT64_MAX;
+	if (slotHeads[OVERDUEWHEELSLOT] != NOTIMERNODE) return GetCurrentTime();
+
+	unsigned slotIndex = (unsigned) (currentTick & SLOTMASK);
+	uint64_t rotationStart = currentTick - slotIndex;
+
+	// Anything left in this rotation of the innermost level is exact,
+	// and earlier than anything on the outer levels.
+	int found = FindOccupiedSlot(0, slotIndex);
+	if (found >= 0) return rotationStart + found;
+
+	uint64_t earliest = UINT64_MAX;
+
+	// Slots behind us hold timers of the next rotation
+	found = FindOccupiedSlot(0, 0);
+	if (found >= 0 && found < (int) slotIndex)
+		earliest = rotationStart + DH_TIMERWHEEL_SLOTS + found;
+
+	// Outer slots hold timers no earlier than when they move inward
+	for (unsigned level = 1; level < DH_TIMERWHEEL_LEVELS; ++level) {
+		unsigned shift = level * DH_TIMERWHEEL_SLOTBITS;
+		uint64_t span = 1ULL << shift;
+		uint64_t nextMove = (currentTick + span - 1) & ~(span - 1);
+		unsigned nextIndex = (unsigned) ((nextMove >> shift) & SLOTMASK);
+
+		found = FindOccupiedSlot(level, nextIndex);
+		if (found < 0) {
+			found = FindOccupiedSlot(level, 0);
+			if (found >= 0) found += DH_TIMERWHEEL_SLOTS;
+		}
+		if (found < 0) continue;
+
+		uint64_t moveTime = nextMove + (uint64_t) (found - nextIndex) * span;
+		if (moveTime < earliest) earliest = moveTime;
+	}
+
+	return earliest;
+}
+
+const DigitalHaze::TimerWheel::timerNode* DigitalHaze::TimerWheel::GetNode(TimerHandle handle) const {
+	uint32_t nodeIndex = GetTimerIndex(handle);
+	if (nodeIndex >= nodes.size()) return nullptr;
+
+	const timerNode& node = nodes[nodeIndex];
+	if (node.wheelSlot == UNUSEDWHEELSLOT) return nullptr;
+	if (node.generation != (uint32_t) (handle >> 32)) return nullptr;
+	return &node;
+}
+
+void DigitalHaze::TimerWheel::Link(uint32_t nodeIndex) {
+	timerNode& node = nodes[nodeIndex];
+	unsigned level = 0, slotIndex = 0, wheelSlot;
+
+	// Overdue timers fire on the next Advance, whatever time it's for
+	if (node.expireTime < currentTick)
+		wheelSlot = OVERDUEWHEELSLOT;
+	else {
+		uint64_t expireTime = node.expireTime;
+		uint64_t delta = expireTime - currentTick;
+		if (delta > MAXTIMERDELTA) {
+			delta = MAXTIMERDELTA;
+			expireTime = currentTick + MAXTIMERDELTA;
+		}
+
+		for (level = 0; level < DH_TIMERWHEEL_LEVELS - 1; ++level)
+			if (delta < (1ULL << ((level + 1) * DH_TIMERWHEEL_SLOTBITS))) break;
+		slotIndex = (unsigned) ((expireTime >> (level * DH_TIMERWHEEL_SLOTBITS)) & SLOTMASK);
+		wheelSlot = level * DH_TIMERWHEEL_SLOTS + slotIndex;
+	}
+
+	node.wheelSlot = (uint16_t) wheelSlot;
+	node.prev = NOTIMERNODE;
+	node.next = slotHeads[wheelSlot];
+	if (node.next != NOTIMERNODE) nodes[node.next].prev = nodeIndex;
+	slotHeads[wheelSlot] = nodeIndex;
+
+	if (wheelSlot != OVERDUEWHEELSLOT)
+		occupied[level][slotIndex / 64] |= 1ULL << (slotIndex % 64);
+}
+
+void DigitalHaze::TimerWheel::Unlink(uint32_t nodeIndex) {
+	timerNode& node = nodes[nodeIndex];
+	unsigned wheelSlot = node.wheelSlot;
+
+	if (node.prev != NOTIMERNODE) nodes[node.prev].next = node.next;
+	else slotHeads[wheelSlot] = node.next;
+	if (node.next != NOTIMERNODE) nodes[node.next].prev = node.prev;
+
+	if (slotHeads[wheelSlot] == NOTIMERNODE && wheelSlot != OVERDUEWHEELSLOT) {
+		unsigned level = wheelSlot / DH_TIMERWHEEL_SLOTS;
+		unsigned slotIndex = wheelSlot & SLOTMASK;
+		occupied[level][slotIndex / 64] &= ~(1ULL << (slotIndex % 64));
+	}
+}
+
+void DigitalHaze::TimerWheel::FreeNode(uint32_t nodeIndex) {
+	timerNode& node = nodes[nodeIndex];
+
+	node.wheelSlot = UNUSEDWHEELSLOT;
+	node.callback = nullptr;
+	node.pParam = nullptr;
+	// Zero never appears in a handle
+	if (!++node.generation) node.generation = 1;
+
+	node.next = freeHead;
+	freeHead = nodeIndex;
+	--timerCount;
+}
+
+size_t DigitalHaze::TimerWheel::FireSlot(unsigned wheelSlot) {
+	size_t fired = 0;
+
+	// Callbacks may add timers to this very slot if they're already
+	// due, so we take timers off the head until it's empty.
+	uint32_t* head = &slotHeads[wheelSlot];
+	while (*head != NOTIMERNODE) {
+		uint32_t nodeIndex = *head;
+		timerNode& node = nodes[nodeIndex];
+		TimerCallback callback = node.callback;
+		void* pParam = node.pParam;
+		TimerHandle handle = ((uint64_t) node.generation << 32) | nodeIndex;
+
+		Unlink(nodeIndex);
+		FreeNode(nodeIndex);
+		++fired;
+
+		if (callback) callback(handle, pParam);
+	}
+
+	return fired;
+}
+
+void DigitalHaze::TimerWheel::Cascade(unsigned level, unsigned slotIndex) {
+	unsigned wheelSlot = level * DH_TIMERWHEEL_SLOTS + slotIndex;
+	uint32_t nodeIndex = slotHeads[wheelSlot];
+
+	slotHeads[wheelSlot] = NOTIMERNODE;
+	occupied[level][slotIndex / 64] &= ~(1ULL << (slotIndex % 64));
+
+	while (nodeIndex != NOTIMERNODE) {
+		uint32_t nextIndex = nodes[nodeIndex].next;
+		Link(nodeIndex);
+		nodeIndex = nextIndex;
+	}
+}
+
+void DigitalHaze::TimerWheel::CascadeInward() {
+	// The next slot of the level above moves in, and so on for every
+	// level that wrapped.
+	for (unsigned level = 1; level < DH_TIMERWHEEL_LEVELS; ++level) {
+		unsigned outerIndex = (unsigned)
+				((currentTick >> (level * DH_TIMERWHEEL_SLOTBITS)) & SLOTMASK);
+		Cascade(level, outerIndex);
+		if (outerIndex) break;
+	}
+}
+
+int DigitalHaze::TimerWheel::FindOccupiedSlot(unsigned level, unsigned fromSlot) const {
+	for (unsigned word = fromSlot / 64; word < DH_TIMERWHEEL_SLOTS / 64; ++word) {
+		uint64_t bits = occupied[level][word];
+		if (word == fromSlot / 64) bits &= ~0ULL << (fromSlot % 64);
+		if (bits) return (int) (word * 64 + __builtin_ctzll(bits));
+	}
+	return -1;
+}
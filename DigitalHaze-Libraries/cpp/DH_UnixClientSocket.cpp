@@ -0,0 +1,70 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "DH_UnixClientSocket.hpp"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+
+DigitalHaze::UnixClientSocket::UnixClientSocket() : UnixSocket() {
+}
+
+DigitalHaze::UnixClientSocket::~UnixClientSocket() {
+}
+
+bool DigitalHaze::UnixClientSocket::AttemptConnect(const char* path,
+		int sockType, bool abstractNamespace) {
+	// Close any connection we already have
+	this->CloseSocket();
+
+	UnixAddressStorage addr;
+	socklen_t addrLen;
+
+	if (!UnixSocket::BuildAddress(path, abstractNamespace, addr, addrLen)) {
+		// Path is too long (or missing)
+		Socket::RecordErrno(ENAMETOOLONG);
+		return false;
+	}
+
+	int newsockfd = socket(AF_UNIX, sockType, 0);
+
+	if (newsockfd == -1) {
+		Socket::RecordErrno();
+		return false;
+	}
+
+	// Returns -1 on error, but we check for success
+	if (0 != connect(newsockfd, &addr.sa, addrLen)) {
+		Socket::RecordErrno();
+		close(newsockfd);
+		return false;
+	}
+
+	// Store the socket
+	IOSocket::sockfd = newsockfd;
+	UnixSocket::socketType = sockType;
+	return true;
+}
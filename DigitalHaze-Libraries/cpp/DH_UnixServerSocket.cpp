@@ -0,0 +1,134 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "DH_UnixServerSocket.hpp"
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <cstring>
+#include <errno.h>
+
+DigitalHaze::UnixServerSocket::UnixServerSocket()
+	: Socket(), socketType(SOCK_STREAM), boundToFilesystem(false) {
+	memset(&boundAddress, 0, sizeof (boundAddress));
+}
+
+DigitalHaze::UnixServerSocket::~UnixServerSocket() {
+	// Do not call virtual functions in constructors/destructors
+	UnixServerSocket::CloseSocket();
+}
+
+void DigitalHaze::UnixServerSocket::CloseSocket() {
+	Socket::CloseSocket();
+
+	// Remove the socket file we created
+	if (boundToFilesystem)
+		unlink(boundAddress.sa_unix.sun_path);
+	boundToFilesystem = false;
+}
+
+bool DigitalHaze::UnixServerSocket::CreateListener(const char* path,
+		int sockType, bool abstractNamespace) {
+	this->CloseSocket(); // Close current socket
+
+	UnixAddressStorage addr;
+	socklen_t addrLen;
+
+	if (!UnixSocket::BuildAddress(path, abstractNamespace, addr, addrLen)) {
+		Socket::RecordErrno(ENAMETOOLONG);
+		return false;
+	}
+
+	// A previous listener that didn't shut down cleanly leaves its
+	// socket file behind, and bind will refuse to replace it. Only
+	// remove the file if it really is a socket, and nobody listens on it.
+	if (!abstractNamespace) {
+		struct stat pathStat;
+		if (0 == lstat(path, &pathStat) && S_ISSOCK(pathStat.st_mode)) {
+			if (!IsStaleSocketFile(addr, addrLen, sockType)) {
+				Socket::RecordErrno(EADDRINUSE);
+				return false;
+			}
+			unlink(path);
+		}
+	}
+
+	int newsockfd = socket(AF_UNIX, sockType, 0);
+
+	if (newsockfd == -1) {
+		Socket::RecordErrno();
+		return false;
+	}
+
+	// Returns -1 on error, but we're checking for success
+	if (0 != bind(newsockfd, &addr.sa, addrLen)) {
+		Socket::RecordErrno();
+		close(newsockfd);
+		return false;
+	}
+
+	if (0 != listen(newsockfd, SOMAXCONN)) {
+		Socket::RecordErrno();
+		close(newsockfd);
+		if (!abstractNamespace)
+			unlink(path);
+		return false;
+	}
+
+	// Store
+	sockfd = newsockfd;
+	socketType = sockType;
+	boundAddress = addr;
+	boundToFilesystem = !abstractNamespace;
+	return true;
+}
+
+bool DigitalHaze::UnixServerSocket::IsStaleSocketFile(const UnixAddressStorage& addr,
+		socklen_t addrLen, int sockType) {
+	int probefd = socket(AF_UNIX, sockType, 0);
+	if (probefd == -1) return false;
+
+	// Connecting to a socket file nobody listens on is refused. Anything
+	// else, even failing for another reason, means it may still be in use.
+	bool stale = 0 != connect(probefd, &addr.sa, addrLen) && errno == ECONNREFUSED;
+
+	close(probefd);
+	return stale;
+}
+
+DigitalHaze::UnixSocket* DigitalHaze::UnixServerSocket::GetNewConnection() {
+	int newfd = accept(sockfd, nullptr, nullptr);
+
+	if (newfd == -1) {
+		// Error
+		Socket::RecordErrno();
+		return nullptr;
+	}
+
+	return new UnixSocket(newfd, socketType);
+}
@@ -0,0 +1,369 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "DH_UnixSocket.hpp"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stddef.h>
+
+#include <cstring>
+#include <errno.h>
+
+DigitalHaze::UnixSocket::UnixSocket() : IOSocket(),
+	socketType(SOCK_STREAM), maxMessageSize(DHUNIXMAXMSGSIZE),
+	ingressTotal(0), egressTotal(0) {
+}
+
+DigitalHaze::UnixSocket::UnixSocket(int connectedfd, int sockType) : IOSocket(),
+	socketType(sockType), maxMessageSize(DHUNIXMAXMSGSIZE),
+	ingressTotal(0), egressTotal(0) {
+	IOSocket::sockfd = connectedfd;
+}
+
+DigitalHaze::UnixSocket::~UnixSocket() {
+}
+
+bool DigitalHaze::UnixSocket::PerformSocketRead(size_t len, bool flush) {
+	if (socketType == SOCK_SEQPACKET)
+		return PerformMessageRead(len, flush);
+	return PerformStreamRead(len, flush);
+}
+
+bool DigitalHaze::UnixSocket::PerformSocketWrite(bool flush) {
+	if (socketType == SOCK_SEQPACKET)
+		return PerformMessageWrite(flush);
+	return PerformStreamWrite(flush);
+}
+
+bool DigitalHaze::UnixSocket::Read(void* outBuffer, size_t len) {
+	// Receiving around our buffer would merge messages together
+	if (socketType == SOCK_SEQPACKET) {
+		if (!IOSocket::Peek(outBuffer, len))
+			return false;
+		IOSocket::readBuffer.ShiftBufferFromFront(len);
+		return true;
+	}
+
+	return IOSocket::Read(outBuffer, len);
+}
+
+void DigitalHaze::UnixSocket::Write(void* inBuffer, size_t len) {
+	IOSocket::Write(inBuffer, len);
+
+	// Every write is a message of its own. Empty messages aren't tracked.
+	egressTotal += len;
+	if (socketType == SOCK_SEQPACKET && len)
+		egressBoundaries.push_back(egressTotal);
+}
+
+bool DigitalHaze::UnixSocket::PerformStreamRead(size_t len, bool flush) {
+	// Check how many bytes to read.
+	// If not specified, then read as many as we can!
+	if (!len) {
+		len = IOSocket::readBuffer.GetRemainingBufferLength();
+		// If we have no more space left, then read how much we'll allocate
+		if (!len) {
+			len = IOSocket::readBuffer.GetBufferReallocSize();
+
+			// Expand by our realloc size. If realloclen ends up being zero,
+			// this will throw an error.
+			if (!IOSocket::readBuffer.TryExpandBuffer()) {
+				// Our memory budget is spent
+				Socket::RecordErrno(ENOBUFS);
+				return false;
+			}
+		}
+	}
+
+	// Make sure we have enough space.
+	if (len > IOSocket::readBuffer.GetRemainingBufferLength()) {
+		// We don't have enough space, expand
+		if (!IOSocket::readBuffer
+				.TryExpandBuffer(len - IOSocket::readBuffer.GetRemainingBufferLength())) {
+			Socket::RecordErrno(ENOBUFS);
+			return false;
+		}
+	}
+
+	// read
+	ssize_t nBytes = recv(Socket::sockfd,
+			readBuffer.GetBufferEnd(), len,
+			flush ? MSG_WAITALL : MSG_DONTWAIT);
+
+	// Our peer shut down the connection. recv leaves errno alone for
+	// this, so don't let a stale EAGAIN pass for "nothing to read".
+	if (nBytes == 0) {
+		Socket::RecordErrno(ECONNRESET);
+		return false;
+	}
+
+	// error?
+	if (nBytes < 0) {
+		Socket::RecordErrno();
+		if (!flush && (Socket::lasterrno == EAGAIN ||
+			Socket::lasterrno == EWOULDBLOCK)) {
+			// If we're not flushing, then these errors are okay.
+			// We just accomplished nothing instead.
+			return true;
+		}
+		return false;
+	}
+
+	// If we're flushing, we better have gotten everything we wanted
+	if (flush && (size_t) nBytes != len) {
+		Socket::RecordErrno();
+		return false;
+	}
+
+	// Read successful
+	IOSocket::readBuffer.NotifyWrite((size_t) nBytes);
+	ingressTotal += (uint64_t) nBytes;
+
+	return true;
+}
+
+bool DigitalHaze::UnixSocket::PerformStreamWrite(bool flush) {
+	// Can't write to the socket if we have no data
+	if (!IOSocket::writeBuffer.GetBufferDataLen()) return false;
+
+	size_t totalWritten = 0;
+
+	do {
+		// Attempt send
+		ssize_t nBytes = send(
+				IOSocket::sockfd,
+				(void*) ((size_t) writeBuffer.GetBufferStart() + totalWritten),
+				IOSocket::writeBuffer.GetBufferDataLen() - totalWritten,
+				flush ? 0 : MSG_DONTWAIT);
+
+		if (nBytes <= 0) {
+			Socket::RecordErrno();
+			return false;
+		}
+
+		totalWritten += (size_t) nBytes;
+
+		// Repeat until fully sent if flushing
+	} while (flush && totalWritten < IOSocket::writeBuffer.GetBufferDataLen());
+
+	// Remove the data we just wrote.
+	IOSocket::writeBuffer.ShiftBufferFromFront(totalWritten);
+	if (totalWritten) IOSocket::NotifyEgressChange(true);
+
+	return true;
+}
+
+bool DigitalHaze::UnixSocket::PerformMessageRead(size_t len, bool flush) {
+	size_t totalRead = 0;
+
+	for (;;) {
+		// The kernel throws away the part of a message that doesn't fit,
+		// so we always make room for the largest message we accept.
+		if (IOSocket::readBuffer.GetRemainingBufferLength() < maxMessageSize &&
+				!IOSocket::readBuffer.TryExpandBuffer(maxMessageSize
+				- IOSocket::readBuffer.GetRemainingBufferLength())) {
+			// Our memory budget is spent. Keep what we got so far.
+			if (totalRead) break;
+			Socket::RecordErrno(ENOBUFS);
+			return false;
+		}
+
+		// MSG_TRUNC has recv return the real length of the message,
+		// which is how we find out we lost part of it.
+		ssize_t nBytes = recv(Socket::sockfd,
+				readBuffer.GetBufferEnd(), maxMessageSize,
+				MSG_TRUNC | (flush ? 0 : MSG_DONTWAIT));
+
+		if (nBytes < 0) {
+			Socket::RecordErrno();
+			if (!flush && (Socket::lasterrno == EAGAIN ||
+				Socket::lasterrno == EWOULDBLOCK)) {
+				// Nothing (more) to read right now.
+				return true;
+			}
+			return false;
+		}
+
+		// Our peer hung up.
+		if (nBytes == 0) {
+			Socket::RecordErrno(ECONNRESET);
+			return false;
+		}
+
+		// The message was larger than what we were willing to accept.
+		if ((size_t) nBytes > maxMessageSize) {
+			Socket::RecordErrno(EMSGSIZE);
+			return false;
+		}
+
+		// Read successful, remember where this message ends.
+		IOSocket::readBuffer.NotifyWrite((size_t) nBytes);
+		ingressTotal += (uint64_t) nBytes;
+		ingressBoundaries.push_back(ingressTotal);
+		totalRead += (size_t) nBytes;
+
+		// If flushing, block until we have what was asked for.
+		// If not flushing, keep reading until the socket runs dry.
+		if (len && totalRead >= len)
+			break;
+		if (flush && !len)
+			break;
+	}
+
+	return true;
+}
+
+bool DigitalHaze::UnixSocket::PerformMessageWrite(bool flush) {
+	// Can't write to the socket if we have no data
+	if (!IOSocket::writeBuffer.GetBufferDataLen()) return false;
+
+	TrimEgressBoundaries();
+
+	size_t totalWritten = 0;
+	uint64_t sentTotal = egressTotal - IOSocket::writeBuffer.GetBufferDataLen();
+
+	while (totalWritten < IOSocket::writeBuffer.GetBufferDataLen()) {
+		// Each message goes out in its own send
+		size_t messageLen = egressBoundaries.empty() ?
+				IOSocket::writeBuffer.GetBufferDataLen() - totalWritten :
+				(size_t) (egressBoundaries.front() - sentTotal);
+
+		ssize_t nBytes = send(
+				IOSocket::sockfd,
+				(void*) ((size_t) writeBuffer.GetBufferStart() + totalWritten),
+				messageLen,
+				flush ? 0 : MSG_DONTWAIT);
+
+		if (nBytes <= 0) {
+			Socket::RecordErrno();
+
+			// If we sent some messages already, that's still a success.
+			if (totalWritten && !flush && (Socket::lasterrno == EAGAIN ||
+				Socket::lasterrno == EWOULDBLOCK))
+				break;
+
+			IOSocket::writeBuffer.ShiftBufferFromFront(totalWritten);
+			TrimEgressBoundaries();
+			if (totalWritten) IOSocket::NotifyEgressChange(true);
+			return false;
+		}
+
+		// Messages are sent whole or not at all
+		totalWritten += messageLen;
+		sentTotal += messageLen;
+		if (!egressBoundaries.empty())
+			egressBoundaries.pop_front();
+	}
+
+	// Remove the data we just wrote.
+	IOSocket::writeBuffer.ShiftBufferFromFront(totalWritten);
+	if (totalWritten) IOSocket::NotifyEgressChange(true);
+
+	return true;
+}
+
+size_t DigitalHaze::UnixSocket::GetNextMessageLen() {
+	if (socketType != SOCK_SEQPACKET) return 0;
+
+	TrimIngressBoundaries();
+	if (ingressBoundaries.empty()) return 0;
+
+	uint64_t consumed = ingressTotal - IOSocket::readBuffer.GetBufferDataLen();
+	return (size_t) (ingressBoundaries.front() - consumed);
+}
+
+size_t DigitalHaze::UnixSocket::ReadMessage(void* outBuffer, size_t maxLen) {
+	size_t messageLen = GetNextMessageLen();
+
+	// No message, or not enough space to store it
+	if (!messageLen || messageLen > maxLen)
+		return messageLen;
+
+	IOSocket::readBuffer.Read(outBuffer, messageLen);
+	ingressBoundaries.pop_front();
+
+	return messageLen;
+}
+
+void DigitalHaze::UnixSocket::CloseSocket() {
+	IOSocket::CloseSocket();
+	ResetBoundaries();
+}
+
+bool DigitalHaze::UnixSocket::isConnected() const {
+	return IOSocket::sockfd != -1;
+}
+
+bool DigitalHaze::UnixSocket::BuildAddress(const char* path,
+		bool abstractNamespace,
+		UnixAddressStorage& addrOut,
+		socklen_t& addrLenOut) {
+	if (!path) return false;
+
+	size_t pathLen = strlen(path);
+
+	memset(&addrOut, 0, sizeof (addrOut));
+	addrOut.sa_unix.sun_family = AF_UNIX;
+
+	if (abstractNamespace) {
+		// Abstract names start with a null byte and are not terminated.
+		if (!pathLen || pathLen + 1 > sizeof (addrOut.sa_unix.sun_path))
+			return false;
+
+		memcpy(addrOut.sa_unix.sun_path + 1, path, pathLen);
+		addrLenOut = (socklen_t) (offsetof(sockaddr_un, sun_path) + 1 + pathLen);
+		return true;
+	}
+
+	// Filesystem paths need room for their null terminator.
+	if (!pathLen || pathLen >= sizeof (addrOut.sa_unix.sun_path))
+		return false;
+
+	memcpy(addrOut.sa_unix.sun_path, path, pathLen + 1);
+	addrLenOut = (socklen_t) (offsetof(sockaddr_un, sun_path) + pathLen + 1);
+	return true;
+}
+
+void DigitalHaze::UnixSocket::TrimIngressBoundaries() {
+	uint64_t consumed = ingressTotal - IOSocket::readBuffer.GetBufferDataLen();
+
+	while (!ingressBoundaries.empty() && ingressBoundaries.front() <= consumed)
+		ingressBoundaries.pop_front();
+}
+
+void DigitalHaze::UnixSocket::TrimEgressBoundaries() {
+	uint64_t sent = egressTotal - IOSocket::writeBuffer.GetBufferDataLen();
+
+	while (!egressBoundaries.empty() && egressBoundaries.front() <= sent)
+		egressBoundaries.pop_front();
+}
+
+void DigitalHaze::UnixSocket::ResetBoundaries() {
+	ingressBoundaries.clear();
+	egressBoundaries.clear();
+	ingressTotal = 0;
+	egressTotal = 0;
+}
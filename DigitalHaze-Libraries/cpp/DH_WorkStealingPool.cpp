@@ -0,0 +1,412 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_WorkStealingPool.cpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 8:00 PM
+ */
+
+#include "DH_WorkStealingPool.hpp"
+
+#include <sched.h>
+
+// The worker running on this thread, if any. Tasks submitted from it
+// go on its own deque.
+static thread_local void* currentWorker = nullptr;
+
+// Workers
+
+DigitalHaze::WorkStealingPool::worker::worker(WorkStealingPool* parentPool,
+		size_t workerIndex)
+	: pool(parentPool), index(workerIndex), threadStarted(false),
+	parked(false), parkCond(PTHREAD_COND_INITIALIZER),
+	randomState((uint32_t) workerIndex * 2654435761u + 1), tick(0),
+	tasksRun(0), tasksStolen(0), parks(0) {
+}
+
+DigitalHaze::WorkStealingPool::worker::~worker() {
+	pthread_cond_destroy(&parkCond);
+}
+
+// The pool
+
+DigitalHaze::WorkStealingPool::WorkStealingPool(size_t workerCount)
+	: parkedWorkers(0), injectedCount(0), running(false),
+	stopRequested(false), lasterrno(0) {
+	if (!workerCount) {
+		// Default to the CPUs we're allowed on
+		cpu_set_t allowedCPUs;
+		CPU_ZERO(&allowedCPUs);
+
+		if (0 == sched_getaffinity(0, sizeof (allowedCPUs), &allowedCPUs))
+			workerCount = CPU_COUNT(&allowedCPUs);
+		if (!workerCount)
+			workerCount = 1;
+	}
+
+	for (size_t i = 0; i < workerCount; ++i)
+		workers.push_back(new worker(this, i));
+}
+
+DigitalHaze::WorkStealingPool::~WorkStealingPool() {
+	Stop();
+	Join();
+	DestroyWorkers();
+}
+
+bool DigitalHaze::WorkStealingPool::Start() {
+	if (running) return false;
+
+	stopRequested.store(false);
+	running = true;
+
+	for (size_t i = 0; i < workers.size(); ++i) {
+		int result = pthread_create(&workers[i]->thread, nullptr,
+				DigitalHaze::WorkStealingPoolThread, (void*) workers[i]);
+
+		if (result != 0) {
+			lasterrno = result;
+			Stop();
+			Join();
+			return false;
+		}
+
+		workers[i]->threadStarted = true;
+	}
+
+	return true;
+}
+
+void DigitalHaze::WorkStealingPool::Stop() {
+	stopRequested.store(true);
+
+	for (size_t i = 0; i < workers.size(); ++i)
+		Unpark(workers[i]);
+}
+
+void DigitalHaze::WorkStealingPool::Join() {
+	for (size_t i = 0; i < workers.size(); ++i) {
+		if (!workers[i]->threadStarted) continue;
+
+		pthread_join(workers[i]->thread, nullptr);
+		workers[i]->threadStarted = false;
+	}
+
+	running = false;
+
+	// Workers leave once they see no work, but tasks can still be
+	// submitted until they're gone. Leftovers may submit more.
+	bool ranAny = true;
+	while (ranAny) {
+		ranAny = false;
+
+		workItem* item;
+		while ((item = TakeInjected(nullptr))) {
+			RunItem(nullptr, item);
+			ranAny = true;
+		}
+
+		for (size_t i = 0; i < workers.size(); ++i) {
+			while (workers[i]->deque.Pop(item)) {
+				RunItem(nullptr, item);
+				ranAny = true;
+			}
+		}
+	}
+}
+
+void DigitalHaze::WorkStealingPool::Submit(WorkTask task, void* pParam) {
+	workItem* item = new workItem;
+	item->task = task;
+	item->pParam = pParam;
+	item->ownedByPool = true;
+
+	Schedule(item);
+}
+
+bool DigitalHaze::WorkStealingPool::IsWorkerThread() const {
+	worker* self = (worker*) currentWorker;
+	return self && self->pool == this;
+}
+
+void DigitalHaze::WorkStealingPool::GetStats(WorkStealingStats& statsOut) const {
+	statsOut.tasksRun = 0;
+	statsOut.tasksStolen = 0;
+	statsOut.parks = 0;
+
+	for (size_t i = 0; i < workers.size(); ++i) {
+		statsOut.tasksRun += workers[i]->tasksRun.load(std::memory_order_relaxed);
+		statsOut.tasksStolen += workers[i]->tasksStolen.load(std::memory_order_relaxed);
+		statsOut.parks += workers[i]->parks.load(std::memory_order_relaxed);
+	}
+}
+
+void DigitalHaze::WorkStealingPool::Schedule(workItem* item) {
+	worker* self = (worker*) currentWorker;
+	if (!self || self->pool != this) {
+		Inject(item);
+		return;
+	}
+
+	self->deque.Push(item);
+
+	// Someone idle can take it off our hands
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (parkedWorkers.load(std::memory_order_relaxed))
+		UnparkIdleWorker();
+}
+
+void DigitalHaze::WorkStealingPool::Inject(workItem* item) {
+	injectLock.LockObject();
+	injected.push_back(item);
+	injectedCount.fetch_add(1);
+	injectLock.UnlockObject();
+
+	if (parkedWorkers.load())
+		UnparkIdleWorker();
+}
+
+void DigitalHaze::WorkStealingPool::Run(worker* self) {
+	currentWorker = self;
+
+	for (;;) {
+		workItem* item = FindWork(self);
+
+		if (item) {
+			RunItem(self, item);
+		} else if (stopRequested.load()) {
+			break;
+		} else {
+			Park(self);
+		}
+	}
+
+	currentWorker = nullptr;
+}
+
+DigitalHaze::WorkStealingPool::workItem*
+DigitalHaze::WorkStealingPool::FindWork(worker* self) {
+	workItem* item;
+
+	if (++self->tick % DH_WORKSTEALING_INJECTINTERVAL == 0) {
+		if ((item = TakeInjected(self)))
+			return item;
+	}
+
+	if (self->deque.Pop(item))
+		return item;
+
+	if ((item = TakeInjected(self)))
+		return item;
+
+	return StealWork(self);
+}
+
+DigitalHaze::WorkStealingPool::workItem*
+DigitalHaze::WorkStealingPool::TakeInjected(worker* self) {
+	if (!injectedCount.load(std::memory_order_acquire))
+		return nullptr;
+
+	workItem* batch[DH_WORKSTEALING_INJECTBATCH];
+	size_t batchSize = 0;
+
+	injectLock.LockObject();
+
+	// Leave some for the other workers
+	size_t wanted = self ? injected.size() / workers.size() + 1 : 1;
+	if (wanted > DH_WORKSTEALING_INJECTBATCH)
+		wanted = DH_WORKSTEALING_INJECTBATCH;
+
+	while (batchSize < wanted && !injected.empty()) {
+		batch[batchSize++] = injected.front();
+		injected.pop_front();
+	}
+	injectedCount.fetch_sub(batchSize);
+
+	injectLock.UnlockObject();
+
+	if (!batchSize) return nullptr;
+
+	// Newest first, so we pop them oldest first and thieves take the newest
+	for (size_t i = batchSize - 1; i > 0; --i)
+		self->deque.Push(batch[i]);
+
+	if (batchSize > 1) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (parkedWorkers.load(std::memory_order_relaxed))
+			UnparkIdleWorker();
+	}
+
+	return batch[0];
+}
+
+DigitalHaze::WorkStealingPool::workItem*
+DigitalHaze::WorkStealingPool::StealWork(worker* self) {
+	size_t workerCount = workers.size();
+	if (workerCount < 2) return nullptr;
+
+	// Start somewhere random so thieves don't all pile onto one victim
+	self->randomState ^= self->randomState << 13;
+	self->randomState ^= self->randomState >> 17;
+	self->randomState ^= self->randomState << 5;
+	size_t start = self->randomState % workerCount;
+
+	for (size_t i = 0; i < workerCount; ++i) {
+		worker* victim = workers[(start + i) % workerCount];
+		if (victim == self) continue;
+
+		workItem* item;
+		if (victim->deque.Steal(item)) {
+			self->tasksStolen.fetch_add(1, std::memory_order_relaxed);
+			return item;
+		}
+	}
+
+	return nullptr;
+}
+
+bool DigitalHaze::WorkStealingPool::HasWork() {
+	if (injectedCount.load())
+		return true;
+
+	for (size_t i = 0; i < workers.size(); ++i) {
+		if (!workers[i]->deque.IsEmpty())
+			return true;
+	}
+
+	return false;
+}
+
+void DigitalHaze::WorkStealingPool::Park(worker* self) {
+	// Announce that we're parked before the last look for work. Anyone
+	// queueing work after that look will see us parked and wake us.
+	self->parked.store(true);
+	parkedWorkers.fetch_add(1);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (HasWork() || stopRequested.load()) {
+		// Whoever clears the flag takes us off the count
+		if (self->parked.exchange(false))
+			parkedWorkers.fetch_sub(1);
+		return;
+	}
+
+	self->parks.fetch_add(1, std::memory_order_relaxed);
+
+	self->parkLock.LockObject();
+	while (self->parked.load())
+		self->parkLock.WaitOnCondition(self->parkCond);
+	self->parkLock.UnlockObject();
+}
+
+bool DigitalHaze::WorkStealingPool::Unpark(worker* target) {
+	if (!target->parked.load()) return false;
+
+	target->parkLock.LockObject();
+	bool wasParked = target->parked.exchange(false);
+	if (wasParked) {
+		parkedWorkers.fetch_sub(1);
+		ThreadLockedObject::SignalCondition(target->parkCond);
+	}
+	target->parkLock.UnlockObject();
+
+	return wasParked;
+}
+
+void DigitalHaze::WorkStealingPool::UnparkIdleWorker() {
+	for (size_t i = 0; i < workers.size(); ++i) {
+		if (Unpark(workers[i]))
+			return;
+	}
+}
+
+void DigitalHaze::WorkStealingPool::RunItem(worker* self, workItem* item) {
+	WorkTask task = item->task;
+	void* pParam = item->pParam;
+	if (item->ownedByPool)
+		delete item;
+
+	task(pParam);
+
+	if (self)
+		self->tasksRun.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DigitalHaze::WorkStealingPool::DestroyWorkers() {
+	for (size_t i = 0; i < workers.size(); ++i)
+		delete workers[i];
+	workers.clear();
+}
+
+void* DigitalHaze::WorkStealingPoolThread(void* data) {
+	WorkStealingPool::worker* self = (WorkStealingPool::worker*) data;
+	self->pool->Run(self);
+	return nullptr;
+}
+
+// Serial queues
+
+DigitalHaze::SerialQueue::SerialQueue(WorkStealingPool& workPool)
+	: pool(workPool), pending(0) {
+	runItem.task = RunBatch;
+	runItem.pParam = this;
+	runItem.ownedByPool = false;
+}
+
+DigitalHaze::SerialQueue::~SerialQueue() {
+}
+
+void DigitalHaze::SerialQueue::Submit(WorkTask task, void* pParam) {
+	serialTask queued;
+	queued.task = task;
+	queued.pParam = pParam;
+	tasks.Push(queued);
+
+	// Only one of us gets to schedule the queue, and only when it's idle
+	if (pending.fetch_add(1, std::memory_order_acq_rel) == 0)
+		pool.Schedule(&runItem);
+}
+
+void DigitalHaze::SerialQueue::RunBatch(void* pParam) {
+	SerialQueue* queue = (SerialQueue*) pParam;
+
+	for (size_t ran = 0; ran < DH_SERIALQUEUE_BATCH; ++ran) {
+		serialTask next;
+
+		// pending counts a task whose push may still be linking its node
+		while (!queue->tasks.Pop(next))
+			sched_yield();
+
+		next.task(next.pParam);
+
+		// Once this hits zero the queue is idle, and may be gone
+		if (queue->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			return;
+	}
+
+	// Let other work go first, behind what was submitted from outside
+	queue->pool.Inject(&queue->runItem);
+}
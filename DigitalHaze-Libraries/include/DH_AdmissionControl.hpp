@@ -0,0 +1,255 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_AdmissionControl.hpp
+ * Author: phytress
+ *
+ * Created on October 19, 2026, 2:30 PM
+ */
+
+#ifndef DH_ADMISSIONCONTROL_HPP
+#define DH_ADMISSIONCONTROL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "DH_ThreadLockedObject.hpp"
+
+// Addresses and prefixes tracked at once, per table. Rounded up to a
+// power of two.
+#ifndef DH_ADMISSION_TABLESIZE
+#define DH_ADMISSION_TABLESIZE 16384
+#endif
+
+// Slots looked at for an address before giving up an idle one for it
+#ifndef DH_ADMISSION_PROBELIMIT
+#define DH_ADMISSION_PROBELIMIT 8
+#endif
+
+namespace DigitalHaze {
+
+	// Zero for a rate or a cap means no limit. A burst of zero is the
+	// same as the rate.
+	struct AdmissionLimits {
+		// New connections per second, and how many may come at once
+		uint32_t hostRate; // From one address
+		uint32_t hostBurst;
+		uint32_t prefixRate; // From one /24 (IPv4) or /64 (IPv6)
+		uint32_t prefixBurst;
+		uint32_t globalRate; // From anywhere
+		uint32_t globalBurst;
+		// Connections open at once
+		uint32_t maxHostConnections;
+		uint32_t maxPrefixConnections;
+	};
+
+	enum AdmissionDecision {
+		ADMIT_ACCEPTED = 0,
+		ADMIT_HOSTRATE,
+		ADMIT_PREFIXRATE,
+		ADMIT_GLOBALRATE,
+		ADMIT_HOSTCONNECTIONS,
+		ADMIT_PREFIXCONNECTIONS,
+		ADMIT_DECISIONCOUNT
+	};
+
+	struct AdmissionStats {
+		// Indexed by AdmissionDecision
+		uint64_t decisions[ADMIT_DECISIONCOUNT];
+		// Tracked addresses given up for new ones
+		uint64_t evictions;
+		// Accepted without being tracked, because every slot for the
+		// address held open connections
+		uint64_t untracked;
+	};
+
+	// An address, IPv4 ones as IPv4-mapped IPv6
+	struct AdmissionKey {
+		uint64_t high;
+		uint64_t low;
+	};
+
+	class AdmissionControl;
+
+	// Which of AdmissionControl's tables counted a connection
+	enum AdmissionCounted {
+		ADMITCOUNTED_HOST = 0x01,
+		ADMITCOUNTED_PREFIX = 0x02
+	};
+
+	// An accepted connection's place in the connection caps. Gives it up
+	// when released or destroyed. Moves, and copies as empty.
+	class AdmissionTicket {
+	public:
+
+		AdmissionTicket() : owner(nullptr), key(), counted(0) {
+		}
+
+		// counted: AdmissionCounted flags, the tables to give it up in
+
+		AdmissionTicket(AdmissionControl* admission, const AdmissionKey& admittedKey,
+						uint8_t countedIn)
+		: owner(admission), key(admittedKey), counted(countedIn) {
+		}
+
+		AdmissionTicket(const AdmissionTicket&) : owner(nullptr), key(), counted(0) {
+		}
+
+		AdmissionTicket(AdmissionTicket&& rhs) noexcept
+		: owner(rhs.owner), key(rhs.key), counted(rhs.counted) {
+			rhs.owner = nullptr;
+		}
+
+		AdmissionTicket& operator=(const AdmissionTicket& rhs);
+		AdmissionTicket& operator=(AdmissionTicket&& rhs) noexcept;
+
+		~AdmissionTicket() {
+			Release();
+		}
+
+		// Counts our connection as closed.
+		void Release();
+
+		// Lets go of our place without giving it up, to carry it where a
+		// ticket can't go. Build a ticket from the three again to hold it.
+		// Returns false if we held nothing.
+
+		bool Detach(AdmissionControl*& ownerOut, AdmissionKey& keyOut,
+					uint8_t& countedOut) {
+			ownerOut = owner;
+			keyOut = key;
+			countedOut = counted;
+			owner = nullptr;
+			return ownerOut != nullptr;
+		}
+
+		inline bool IsHeld() const {
+			return owner != nullptr;
+		}
+	private:
+		AdmissionControl* owner;
+		AdmissionKey key;
+		uint8_t counted;
+	};
+
+	// Decides whether to accept a connection from its address, before
+	// anything is spent on it. Token buckets limit the rate of new
+	// connections per address, per prefix, and overall. Caps limit how
+	// many connections an address or prefix has open. Addresses and
+	// prefixes live in fixed tables, where idle ones make way for new
+	// ones, so nothing is allocated after construction.
+	// Hand one to TCPServerSocket::SetAdmissionControl to apply it when
+	// accepting. Safe from any thread. Must outlive the connections it
+	// admitted.
+	class AdmissionControl : public ThreadLockedObject {
+	public:
+		explicit AdmissionControl(const AdmissionLimits& limits,
+								size_t tableSize = DH_ADMISSION_TABLESIZE);
+		~AdmissionControl();
+
+		// Decides on a connection from addr. Addresses that aren't IPv4
+		// or IPv6 only count towards the global rate. When accepted with
+		// connection caps in effect, ticketOut holds the connection's
+		// place until it's released.
+		AdmissionDecision Admit(const sockaddr* addr, AdmissionTicket& ticketOut);
+
+		// Replaces our limits. Tracked addresses keep their tokens and
+		// open connections.
+		void SetLimits(const AdmissionLimits& limits);
+
+		void GetLimits(AdmissionLimits& limitsOut);
+
+		void GetStats(AdmissionStats& statsOut);
+
+		void ResetStats();
+
+		// Tickets give their connections back through us
+		friend class AdmissionTicket;
+	private:
+		// New connections allowed, in billionths of a connection
+		struct tokenBucket {
+			uint64_t tokens;
+			uint64_t stamp; // When tokens was last topped up, in ns
+		};
+
+		// A bucket's rate, in the units tokenBucket uses
+		struct bucketRate {
+			uint64_t perNanosecond;
+			uint64_t capacity;
+			uint64_t fillTime; // Nanoseconds from empty to full
+		};
+
+		struct tableEntry {
+			AdmissionKey key;
+			tokenBucket bucket;
+			uint32_t connections;
+			bool used;
+		};
+
+		struct admissionTable {
+			tableEntry* entries;
+			size_t mask;
+		};
+
+		AdmissionLimits currentLimits;
+		bucketRate hostRate;
+		bucketRate prefixRate;
+		bucketRate globalRate;
+
+		admissionTable hosts;
+		admissionTable prefixes;
+		tokenBucket globalBucket;
+		uint64_t hashSeed;
+
+		AdmissionStats stats;
+
+		// Only tracked with a cap in effect
+		inline bool TracksConnections() const {
+			return currentLimits.maxHostConnections
+					|| currentLimits.maxPrefixConnections;
+		}
+
+		// Finds key's entry, or makes one. Returns null if every slot
+		// for it holds open connections.
+		tableEntry* FindOrInsert(admissionTable& table, const AdmissionKey& key,
+								const bucketRate& rate, uint64_t now);
+
+		// Finds key's entry without making one
+		tableEntry* Find(admissionTable& table, const AdmissionKey& key);
+
+		size_t HashKey(const AdmissionKey& key) const;
+
+		// Called by tickets. Only the tables in counted (AdmissionCounted
+		// flags) are given the connection back.
+		void ReleaseConnection(const AdmissionKey& key, uint8_t counted);
+
+		// Not copyable
+		AdmissionControl(const AdmissionControl&);
+		AdmissionControl& operator=(const AdmissionControl&);
+	};
+}
+
+#endif /* DH_ADMISSIONCONTROL_HPP */
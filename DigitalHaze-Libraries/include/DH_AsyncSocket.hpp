@@ -0,0 +1,491 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_AsyncSocket.hpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 7:10 PM
+ */
+
+#ifndef DH_ASYNCSOCKET_HPP
+#define DH_ASYNCSOCKET_HPP
+
+// Coroutines need C++20. Older standards see nothing in here, so the
+// rest of the library builds as it always did.
+#if __cplusplus >= 202002L
+
+#include <errno.h>
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+
+#include "DH_SocketPool.hpp"
+#include "DH_TCPSocket.hpp"
+#include "DH_TCPClientSocket.hpp"
+#include "DH_TCPServerSocket.hpp"
+
+namespace DigitalHaze {
+
+	// What a coroutine working with AsyncSockets returns.
+	// Calling the coroutine runs it until its first co_await that has to
+	// wait. It's resumed from inside PollSockets once what it waits for
+	// happened, on the pool's thread. There are no other threads.
+	// Its frame is its only allocation, and is freed when it returns.
+	// Nothing waits for it, so an exception escaping it terminates.
+	class SocketTask {
+	public:
+		struct promise_type {
+
+			SocketTask get_return_object() const noexcept {
+				return SocketTask();
+			}
+
+			std::suspend_never initial_suspend() const noexcept {
+				return std::suspend_never();
+			}
+
+			std::suspend_never final_suspend() const noexcept {
+				return std::suspend_never();
+			}
+
+			void return_void() const noexcept {
+			}
+
+			void unhandled_exception() const noexcept {
+				std::terminate();
+			}
+		};
+	};
+
+	// Puts an IOSocket in a SocketPool and lets coroutines wait on it.
+	// One coroutine may wait to read while another waits to write.
+	// Everything happens on the pool's thread, and nothing here is
+	// thread safe.
+	// Once the socket errors or its peer closes, it's taken out of the
+	// pool, and every wait ends with a failure.
+	// The socket must outlive us, and we must outlive every coroutine
+	// waiting on us.
+	class AsyncSocket : private SocketEventHandler {
+	public:
+		// Adds the socket to the pool, unless it isn't connected yet.
+		// A TCPClientSocket can then be connected with Connect.
+
+		AsyncSocket(SocketPool& pool, IOSocket* pSocket)
+		: pool(pool), socket(pSocket), client(nullptr) {
+			Init();
+		}
+
+		AsyncSocket(SocketPool& pool, TCPClientSocket* pSocket)
+		: pool(pool), socket(pSocket), client(pSocket) {
+			Init();
+		}
+
+		~AsyncSocket() {
+			if (handle != DH_INVALID_SOCKETHANDLE)
+				pool.RemoveSocket(handle);
+		}
+
+		struct ReadAwaiter {
+			AsyncSocket* owner;
+			void* outBuffer;
+			size_t len;
+
+			bool await_ready() const {
+				return owner->IsIngressReady(len);
+			}
+
+			void await_suspend(std::coroutine_handle<> waiter) {
+				owner->reader = waiter;
+				owner->readWant = len;
+			}
+
+			bool await_resume() {
+				if (owner->socket->GetIngressDataLen() < len) return false;
+				return owner->socket->Read(outBuffer, len);
+			}
+		};
+
+		struct ReadSomeAwaiter {
+			AsyncSocket* owner;
+
+			bool await_ready() const {
+				return owner->IsIngressReady(1);
+			}
+
+			void await_suspend(std::coroutine_handle<> waiter) {
+				owner->reader = waiter;
+				owner->readWant = 1;
+			}
+
+			size_t await_resume() const {
+				return owner->socket->GetIngressDataLen();
+			}
+		};
+
+		struct FlushAwaiter {
+			AsyncSocket* owner;
+
+			bool await_ready() {
+				owner->TrySend();
+				return owner->IsEgressDone();
+			}
+
+			void await_suspend(std::coroutine_handle<> waiter) {
+				owner->writer = waiter;
+				// Hear about it even if the pool sends for us
+				owner->pool.SetWatchWritable(owner->handle, true);
+			}
+
+			bool await_resume() const {
+				return !owner->failed;
+			}
+		};
+
+		struct ConnectAwaiter {
+			AsyncSocket* owner;
+			const char* hostname;
+			unsigned short port;
+
+			bool await_ready() {
+				return !owner->StartConnect(hostname, port);
+			}
+
+			void await_suspend(std::coroutine_handle<> waiter) {
+				owner->writer = waiter;
+			}
+
+			bool await_resume() const {
+				return !owner->failed;
+			}
+		};
+
+		// Waits until len bytes arrived, and moves them to outBuffer.
+		// Results in false if the connection failed first. Whatever
+		// arrived stays in the socket's read buffer then.
+
+		inline ReadAwaiter Read(void* outBuffer, size_t len) {
+			return ReadAwaiter{this, outBuffer, len ? len : 1};
+		}
+
+		// Waits until anything arrived. Results in the number of bytes in
+		// the socket's read buffer, which are left there, or zero if the
+		// connection failed and nothing is left.
+
+		inline ReadSomeAwaiter ReadSome() {
+			return ReadSomeAwaiter{this};
+		}
+
+		// Adds data to the socket's write buffer, and waits until all of
+		// it was handed to the kernel. Results in false on failure.
+
+		inline FlushAwaiter Write(const void* data, size_t len) {
+			socket->Write((void*) data, len);
+			return FlushAwaiter{this};
+		}
+
+		// Waits until the socket's write buffer was handed to the kernel.
+
+		inline FlushAwaiter Flush() {
+			return FlushAwaiter{this};
+		}
+
+		// Connects our TCPClientSocket without blocking (see
+		// TCPClientSocket::AttemptNonBlockingConnect), and adds it to the
+		// pool. hostname must be a numeric address. Results in false if
+		// the connect failed, or if we weren't given a TCPClientSocket.
+
+		inline ConnectAwaiter Connect(const char* hostname, unsigned short port) {
+			return ConnectAwaiter{this, hostname, port};
+		}
+
+		inline bool isFailed() const {
+			return failed;
+		}
+
+		inline IOSocket* GetSocket() const {
+			return socket;
+		}
+
+		inline SocketHandle GetHandle() const {
+			return handle;
+		}
+	private:
+		SocketPool& pool;
+		IOSocket* socket;
+		TCPClientSocket* client;
+		SocketHandle handle;
+
+		// Whether the pool receives and sends for us (io_uring)
+		bool poolDoesIO;
+		bool failed;
+		bool connecting;
+
+		// Who waits, and how much the reader waits for
+		std::coroutine_handle<> reader;
+		std::coroutine_handle<> writer;
+		size_t readWant;
+
+		void Init() {
+			handle = DH_INVALID_SOCKETHANDLE;
+			poolDoesIO = pool.GetBackend() == SOCKETPOOL_IOURING &&
+					dynamic_cast<TCPSocket*> (socket) != nullptr;
+			failed = false;
+			connecting = false;
+			readWant = 0;
+
+			// Joins the pool in Connect
+			if (client && !client->isConnected()) return;
+
+			handle = pool.AddSocket(socket, nullptr, this);
+			if (handle == DH_INVALID_SOCKETHANDLE) failed = true;
+		}
+
+		inline bool IsIngressReady(size_t len) const {
+			return failed || socket->GetIngressDataLen() >= len;
+		}
+
+		inline bool IsEgressDone() const {
+			return failed || (!connecting && !socket->GetEgressDataLen());
+		}
+
+		// Errors that only mean the kernel has nothing for us right now
+
+		static inline bool isWouldBlock(int err) {
+			return err == EAGAIN || err == EWOULDBLOCK;
+		}
+
+		void Fail() {
+			if (failed) return;
+			failed = true;
+			connecting = false;
+
+			if (handle != DH_INVALID_SOCKETHANDLE) {
+				pool.RemoveSocket(handle);
+				handle = DH_INVALID_SOCKETHANDLE;
+			}
+		}
+
+		void TrySend() {
+			if (failed || connecting || poolDoesIO || !socket->GetEgressDataLen())
+				return;
+
+			if (!socket->PerformSocketWrite() && !isWouldBlock(socket->GetLastError()))
+				Fail();
+		}
+
+		bool StartConnect(const char* hostname, unsigned short port) {
+			failed = false;
+
+			if (!client || !client->AttemptNonBlockingConnect(hostname, port)) {
+				failed = true;
+				return false;
+			}
+
+			handle = pool.AddSocket(socket, nullptr, this);
+			if (handle == DH_INVALID_SOCKETHANDLE) {
+				client->CloseSocket();
+				failed = true;
+				return false;
+			}
+
+			// Writable means the connect finished, one way or the other
+			connecting = true;
+			pool.SetWatchWritable(handle, true);
+			return true;
+		}
+
+		// Resumes whoever got what they waited for. Resuming may end the
+		// coroutine that owns us, so we're not touched after that.
+
+		void ResumeWaiters() {
+			std::coroutine_handle<> readerDone, writerDone;
+
+			if (reader && IsIngressReady(readWant)) {
+				readerDone = reader;
+				reader = nullptr;
+			}
+
+			if (writer && IsEgressDone()) {
+				writerDone = writer;
+				writer = nullptr;
+				if (!failed) pool.SetWatchWritable(handle, false);
+			}
+
+			if (readerDone) readerDone.resume();
+			if (writerDone) writerDone.resume();
+		}
+
+		void OnReadable(SocketPool& /*eventPool*/, SocketHandle /*eventHandle*/,
+						Socket* /*pSocket*/, void* /*pParam*/) override {
+			// The io_uring backend already put the data in our buffer
+			if (!poolDoesIO && !socket->PerformSocketRead() &&
+				!isWouldBlock(socket->GetLastError()))
+				Fail();
+
+			ResumeWaiters();
+		}
+
+		void OnWritable(SocketPool& /*eventPool*/, SocketHandle /*eventHandle*/,
+						IOSocket* /*pSocket*/, void* /*pParam*/) override {
+			if (connecting) {
+				connecting = false;
+				if (!client->FinishConnect()) Fail();
+			} else TrySend();
+
+			ResumeWaiters();
+		}
+
+		void OnError(SocketPool& /*eventPool*/, SocketHandle /*eventHandle*/,
+					Socket* /*pSocket*/, void* /*pParam*/) override {
+			// Records why a connect failed
+			if (connecting) client->FinishConnect();
+			Fail();
+
+			ResumeWaiters();
+		}
+
+		// Not copyable
+		AsyncSocket(const AsyncSocket&);
+		AsyncSocket& operator=(const AsyncSocket&);
+	};
+
+	// Lets coroutines accept the connections of a TCPServerSocket in a
+	// SocketPool. The listener is put in non-blocking mode, and must
+	// outlive us. Connections are accepted as they come in, and wait
+	// with us until taken.
+	// With the io_uring backend the pool accepts for us, and we take
+	// every connection the pool accepted that no one claimed yet, so
+	// don't use GetNextAcceptedFD on the same pool.
+	class AsyncListener : private SocketEventHandler {
+	public:
+
+		AsyncListener(SocketPool& pool, TCPServerSocket* pListener)
+		: pool(pool), listener(pListener), failed(false) {
+			listener->SetNonBlocking(true);
+			handle = pool.AddPassiveSocket(listener, nullptr, this);
+			if (handle == DH_INVALID_SOCKETHANDLE) failed = true;
+		}
+
+		// Connections no one took are closed
+
+		~AsyncListener() {
+			if (handle != DH_INVALID_SOCKETHANDLE)
+				pool.RemoveSocket(handle);
+
+			for (size_t i = 0; i < pending.size(); ++i)
+				delete pending[i];
+		}
+
+		struct AcceptAwaiter {
+			AsyncListener* owner;
+
+			bool await_ready() const {
+				return owner->failed || !owner->pending.empty();
+			}
+
+			void await_suspend(std::coroutine_handle<> waiter) {
+				owner->acceptor = waiter;
+			}
+
+			TCPSocket* await_resume() {
+				if (owner->pending.empty()) return nullptr;
+
+				TCPSocket* newSocket = owner->pending.front();
+				owner->pending.pop_front();
+				return newSocket;
+			}
+		};
+
+		// Waits for the next connection. Results in the new socket, which
+		// the caller owns, or null if the listener failed.
+		// Only one coroutine may wait at a time.
+
+		inline AcceptAwaiter Accept() {
+			return AcceptAwaiter{this};
+		}
+
+		inline bool isFailed() const {
+			return failed;
+		}
+
+		// Number of connections waiting to be taken
+
+		inline size_t GetPendingCount() const {
+			return pending.size();
+		}
+	private:
+		SocketPool& pool;
+		TCPServerSocket* listener;
+		SocketHandle handle;
+		bool failed;
+
+		std::deque<TCPSocket*> pending;
+		std::coroutine_handle<> acceptor;
+
+		void ResumeAcceptor() {
+			if (!acceptor || (pending.empty() && !failed)) return;
+
+			std::coroutine_handle<> waiter = acceptor;
+			acceptor = nullptr;
+			waiter.resume();
+		}
+
+		void OnReadable(SocketPool& /*eventPool*/, SocketHandle /*eventHandle*/,
+						Socket* /*pSocket*/, void* /*pParam*/) override {
+			if (pool.GetBackend() == SOCKETPOOL_IOURING) {
+				int newfd;
+				while (-1 != (newfd = pool.GetNextAcceptedFD())) {
+					if (TCPSocket* newSocket = listener->AdoptAcceptedFD(newfd))
+						pending.push_back(newSocket);
+				}
+			} else {
+				// Stops once the kernel has nothing more for us. Other
+				// errors are the connection's, not the listener's.
+				while (TCPSocket* newSocket = listener->GetNewConnection())
+					pending.push_back(newSocket);
+			}
+
+			ResumeAcceptor();
+		}
+
+		void OnError(SocketPool& /*eventPool*/, SocketHandle /*eventHandle*/,
+					Socket* /*pSocket*/, void* /*pParam*/) override {
+			failed = true;
+			pool.RemoveSocket(handle);
+			handle = DH_INVALID_SOCKETHANDLE;
+
+			ResumeAcceptor();
+		}
+
+		// Not copyable
+		AsyncListener(const AsyncListener&);
+		AsyncListener& operator=(const AsyncListener&);
+	};
+}
+
+#endif /* __cplusplus >= 202002L */
+
+#endif /* DH_ASYNCSOCKET_HPP */
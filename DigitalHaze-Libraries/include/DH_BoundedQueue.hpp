@@ -0,0 +1,157 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_BoundedQueue.hpp
+ * Author: phytress
+ *
+ * Created on October 19, 2026, 11:20 AM
+ */
+
+#ifndef DH_BOUNDEDQUEUE_HPP
+#define DH_BOUNDEDQUEUE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <stdexcept>
+
+namespace DigitalHaze {
+
+	// A lock-free queue of fixed capacity, which any number of threads
+	// can push to and pop from (Vyukov's bounded MPMC queue). Every slot
+	// carries a sequence number that tells pushers and poppers whose turn
+	// it is, so neither side allocates or waits on a lock. A full queue
+	// refuses pushes instead of growing.
+	// T must be default constructible and assignable.
+	template <typename T>
+	class BoundedQueue {
+	public:
+
+		// capacity must be a power of two.
+		explicit BoundedQueue(size_t capacity)
+		: mask(capacity - 1), cells(nullptr), pushPos(0), popPos(0) {
+			if (capacity < 2 || (capacity & (capacity - 1)))
+				throw std::invalid_argument("DigitalHaze::BoundedQueue capacity must be a power of two");
+
+			cells = new cell[capacity];
+			for (size_t i = 0; i < capacity; ++i)
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		// Elements left in the queue are destroyed.
+
+		~BoundedQueue() {
+			delete[] cells;
+		}
+
+		// Adds an element. Returns false if the queue is full.
+		// Safe from any thread.
+
+		bool TryPush(const T& value) {
+			size_t pos = pushPos.load(std::memory_order_relaxed);
+			cell* c;
+
+			for (;;) {
+				c = &cells[pos & mask];
+				size_t sequence = c->sequence.load(std::memory_order_acquire);
+				intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+				if (diff == 0) {
+					// Our turn, if nobody beats us to it
+					if (pushPos.compare_exchange_weak(pos, pos + 1,
+							std::memory_order_relaxed))
+						break;
+				} else if (diff < 0) {
+					// The slot still holds what was pushed a lap ago
+					return false;
+				} else pos = pushPos.load(std::memory_order_relaxed);
+			}
+
+			c->value = value;
+			c->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Takes the oldest element. Returns false if the queue is empty.
+		// Safe from any thread.
+
+		bool TryPop(T& valueOut) {
+			size_t pos = popPos.load(std::memory_order_relaxed);
+			cell* c;
+
+			for (;;) {
+				c = &cells[pos & mask];
+				size_t sequence = c->sequence.load(std::memory_order_acquire);
+				intptr_t diff = (intptr_t) sequence - (intptr_t) (pos + 1);
+
+				if (diff == 0) {
+					if (popPos.compare_exchange_weak(pos, pos + 1,
+							std::memory_order_relaxed))
+						break;
+				} else if (diff < 0) {
+					// Nothing pushed here yet
+					return false;
+				} else pos = popPos.load(std::memory_order_relaxed);
+			}
+
+			valueOut = c->value;
+			// Free for the push a lap from now
+			c->sequence.store(pos + mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		inline size_t GetCapacity() const {
+			return mask + 1;
+		}
+
+		// A guess while other threads push and pop.
+
+		inline size_t GetSizeApprox() const {
+			size_t popped = popPos.load(std::memory_order_relaxed);
+			size_t pushed = pushPos.load(std::memory_order_relaxed);
+			return pushed > popped ? pushed - popped : 0;
+		}
+	private:
+
+		struct cell {
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		size_t mask;
+		cell* cells;
+
+		// Pushers and poppers each work at their own end
+		std::atomic<size_t> pushPos;
+		std::atomic<size_t> popPos;
+
+		// Not copyable
+		BoundedQueue(const BoundedQueue&);
+		BoundedQueue& operator=(const BoundedQueue&);
+	};
+}
+
+#endif /* DH_BOUNDEDQUEUE_HPP */
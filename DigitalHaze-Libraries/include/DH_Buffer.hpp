@@ -38,6 +38,8 @@
 
 namespace DigitalHaze {
 
+	class MemoryBudget;
+
 	class Buffer {
 	public:
 		// sizeInBytes: The length of the buffer in bytes.
@@ -108,6 +110,28 @@ namespace DigitalHaze {
 		//   overflow_error if the buffer's maximum allowed size is reached.
 		void ExpandBufferAligned(size_t additionalBytes = 0);
 
+		// Same as ExpandBuffer, but returns false instead of throwing if
+		// our memory budget can't cover the growth.
+		// throws: see ExpandBuffer, except for the budget.
+		bool TryExpandBuffer(size_t additionalBytes = 0);
+
+		// Gives back the memory past newSize, keeping our data. We never
+		// shrink below the data we hold, or to nothing.
+		// returns: the number of bytes given back.
+		size_t ShrinkBuffer(size_t newSize);
+
+		// Charges our memory to a budget from now on. Growing past what
+		// the budget allows throws overflow_error, as if we reached our
+		// maximum size. What we hold now is moved from our old budget,
+		// if any, to the new one. Null stops charging.
+		// Our budget moves along with our memory when we're moved, but
+		// copies aren't charged to any.
+		void SetMemoryBudget(MemoryBudget* budget);
+
+		inline MemoryBudget* GetMemoryBudget() const {
+			return memoryBudget;
+		}
+
 		// See: Read
 		template<class vType>
 		inline bool ReadVar(vType& var, size_t offset = 0);
@@ -235,6 +259,8 @@ namespace DigitalHaze {
 		size_t bufferMaxSize;
 		// A malloc'd buffer.
 		void* buffer;
+		// What our bufferSize is charged to (can be null)
+		MemoryBudget* memoryBudget;
 	public:
 		// Rule of 5
 
@@ -0,0 +1,80 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_BufferPool.hpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 3:05 PM
+ */
+
+#ifndef DH_BUFFERPOOL_HPP
+#define DH_BUFFERPOOL_HPP
+
+#include "DH_Buffer.hpp"
+#include "DH_ThreadLockedObject.hpp"
+
+#include <vector>
+
+#define DH_BUFFERPOOL_DEFAULTSIZE 64
+
+namespace DigitalHaze {
+
+	// A pool of spare Buffers. Handing message buffers to another thread
+	// and getting them back through a pool means neither side allocates
+	// in the steady state. Buffers can be returned from any thread.
+	class BufferPool : public ThreadLockedObject {
+	public:
+		// bufferSize, reallocSize, maxSize: see Buffer. Every buffer
+		//  handed out by this pool starts with these settings.
+		// maxPooled: the most spare buffers we hold on to. Buffers
+		//  returned beyond that are freed.
+		explicit BufferPool(size_t bufferSize, size_t reallocSize = 0,
+							size_t maxSize = 0,
+							size_t maxPooled = DH_BUFFERPOOL_DEFAULTSIZE);
+		~BufferPool();
+
+		// Moves a spare buffer into bufOut. A new buffer is allocated if
+		// we're out of spares. The buffer has no data in it.
+		void Acquire(Buffer& bufOut);
+
+		// Takes back a buffer. Its data is discarded. Buffers that grew
+		// are shrunk back to our buffer size, and spares are no longer
+		// charged to a memory budget.
+		void Release(Buffer&& buf);
+
+		// Number of spare buffers currently held.
+		size_t GetSpareCount();
+	private:
+		size_t bufferSize;
+		size_t bufferReallocSize;
+		size_t bufferMaxSize;
+		size_t maxPooled;
+
+		std::vector<Buffer> spareBuffers;
+	};
+}
+
+#endif /* DH_BUFFERPOOL_HPP */
+
@@ -0,0 +1,187 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_ChaseLevDeque.hpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 7:45 PM
+ */
+
+#ifndef DH_CHASELEVDEQUE_HPP
+#define DH_CHASELEVDEQUE_HPP
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+// How many elements a deque holds before it grows. Must be a power of two.
+#ifndef DH_CHASELEVDEQUE_INITIALSIZE
+#define DH_CHASELEVDEQUE_INITIALSIZE 256
+#endif
+
+namespace DigitalHaze {
+
+	// The work-stealing deque of Chase and Lev, with the memory orderings
+	// of Le et al. (2013). One thread owns the deque and pushes and pops
+	// at its bottom, newest first. Any other thread may steal from its
+	// top, oldest first. Neither side takes a lock.
+	// The ring grows when it's full. Rings we outgrew are kept until we
+	// are destroyed, since a thief may still be reading one.
+	// T must be trivially copyable, and small enough for std::atomic<T>
+	// to be lock-free, a pointer in practice.
+	template <typename T>
+	class ChaseLevDeque {
+	public:
+
+		ChaseLevDeque() : top(0), bottom(0),
+		items(new ring(DH_CHASELEVDEQUE_INITIALSIZE)) {
+		}
+
+		// Elements left in the deque are not touched.
+
+		~ChaseLevDeque() {
+			delete items.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < retired.size(); ++i)
+				delete retired[i];
+		}
+
+		// Owner only.
+
+		void Push(T value) {
+			int64_t b = bottom.load(std::memory_order_relaxed);
+			int64_t t = top.load(std::memory_order_acquire);
+			ring* r = items.load(std::memory_order_relaxed);
+
+			if (b - t > (int64_t) r->mask)
+				r = Grow(r, t, b);
+
+			r->Put(b, value);
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		// Takes the newest element. Returns false if there is none.
+		// Owner only.
+
+		bool Pop(T& valueOut) {
+			int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+			ring* r = items.load(std::memory_order_relaxed);
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = top.load(std::memory_order_relaxed);
+
+			if (t > b) {
+				// Empty
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return false;
+			}
+
+			valueOut = r->Get(b);
+			if (t == b) {
+				// The last element. A thief may be after it too.
+				bool won = top.compare_exchange_strong(t, t + 1,
+						std::memory_order_seq_cst, std::memory_order_relaxed);
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return won;
+			}
+
+			return true;
+		}
+
+		// Takes the oldest element. Returns false if there is none, or if
+		// another thread took it first. Safe from any thread.
+
+		bool Steal(T& valueOut) {
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t b = bottom.load(std::memory_order_acquire);
+
+			if (t >= b) return false;
+
+			ring* r = items.load(std::memory_order_acquire);
+			T value = r->Get(t);
+			if (!top.compare_exchange_strong(t, t + 1,
+					std::memory_order_seq_cst, std::memory_order_relaxed))
+				return false;
+
+			valueOut = value;
+			return true;
+		}
+
+		// A guess when called by a thief, since the deque keeps changing.
+
+		inline bool IsEmpty() const {
+			return bottom.load(std::memory_order_acquire) <=
+					top.load(std::memory_order_acquire);
+		}
+	private:
+
+		struct ring {
+			uint64_t mask;
+			std::atomic<T>* slots;
+
+			explicit ring(uint64_t size) : mask(size - 1),
+			slots(new std::atomic<T>[size]) {
+			}
+
+			~ring() {
+				delete[] slots;
+			}
+
+			inline T Get(int64_t index) const {
+				return slots[index & mask].load(std::memory_order_relaxed);
+			}
+
+			inline void Put(int64_t index, T value) {
+				slots[index & mask].store(value, std::memory_order_relaxed);
+			}
+		};
+
+		// Thieves take from top, the owner works at bottom
+		std::atomic<int64_t> top;
+		std::atomic<int64_t> bottom;
+		std::atomic<ring*> items;
+
+		// Rings we grew out of. Owner only.
+		std::vector<ring*> retired;
+
+		ring* Grow(ring* old, int64_t t, int64_t b) {
+			ring* larger = new ring((old->mask + 1) * 2);
+			for (int64_t i = t; i < b; ++i)
+				larger->Put(i, old->Get(i));
+
+			retired.push_back(old);
+			items.store(larger, std::memory_order_release);
+			return larger;
+		}
+
+		// Not copyable
+		ChaseLevDeque(const ChaseLevDeque&);
+		ChaseLevDeque& operator=(const ChaseLevDeque&);
+	};
+}
+
+#endif /* DH_CHASELEVDEQUE_HPP */
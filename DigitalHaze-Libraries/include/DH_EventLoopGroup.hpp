@@ -0,0 +1,293 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_EventLoopGroup.hpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 2:05 PM
+ */
+
+#ifndef DH_EVENTLOOPGROUP_HPP
+#define DH_EVENTLOOPGROUP_HPP
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "DH_SocketPool.hpp"
+#include "DH_TCPServerSocket.hpp"
+
+// How long a shard waits in a poll when nothing happens.
+#ifndef DH_EVENTLOOP_POLLTIMEOUT
+#define DH_EVENTLOOP_POLLTIMEOUT 100
+#endif
+// Most connections a shard accepts each time its listener is readable.
+// The rest wait for its next poll, so a connection storm can't starve
+// the connections it already has.
+#ifndef DH_EVENTLOOP_ACCEPTBATCH
+#define DH_EVENTLOOP_ACCEPTBATCH 64
+#endif
+
+namespace DigitalHaze {
+
+	class EventLoopGroup;
+	class EventLoopShard;
+
+	struct EventLoopShardStats {
+		uint64_t connectionsAccepted;
+		uint64_t connectionsRejected; // Refused by OnNewConnection
+		uint64_t connectionsClosed;
+		uint64_t activeConnections;
+		uint64_t acceptErrors;
+		uint64_t pollIterations;
+		uint64_t readableEvents;
+		uint64_t writableEvents;
+		uint64_t errorEvents;
+	};
+
+	// Receives the events of every shard in a group. Every shard calls
+	// in from its own thread, so anything shared between shards must be
+	// protected by the handler.
+	class EventLoopHandler {
+	public:
+		virtual ~EventLoopHandler();
+
+		// Called on the shard's thread before it starts polling.
+		virtual void OnShardStart(EventLoopShard& shard);
+
+		// A shard accepted a connection. Return false to refuse it, and
+		// the shard closes it. pParam is given along with the socket in
+		// every event.
+		virtual bool OnNewConnection(EventLoopShard& shard, TCPSocket* pSocket,
+									void** pParam);
+
+		// A connection has data to read.
+		virtual void OnReadable(EventLoopShard& shard, TCPSocket* pSocket,
+								void* pParam) = 0;
+
+		// A connection can be written to. By default, pending data is sent.
+		virtual void OnWritable(EventLoopShard& shard, TCPSocket* pSocket,
+								void* pParam);
+
+		// A connection errored or was closed by its peer. By default, the
+		// shard closes it.
+		virtual void OnError(EventLoopShard& shard, TCPSocket* pSocket,
+							void* pParam);
+
+		// Called after the shard went through all events of a poll.
+		virtual void OnPollComplete(EventLoopShard& shard);
+
+		// Called on the shard's thread after it stopped polling. Any
+		// connections still open are closed after this returns.
+		virtual void OnShardStop(EventLoopShard& shard);
+	};
+
+	// One thread of an EventLoopGroup, with its own listener and pool.
+	// Connections accepted by a shard stay on that shard.
+	class EventLoopShard {
+		friend class EventLoopGroup;
+	public:
+		// The pool of this shard. Only use it from the shard's thread.
+
+		inline SocketPool& GetPool() {
+			return *pool;
+		}
+
+		inline TCPServerSocket& GetListener() {
+			return listener;
+		}
+
+		inline EventLoopGroup& GetGroup() {
+			return *group;
+		}
+
+		// Position of this shard in its group
+
+		inline size_t GetIndex() const {
+			return index;
+		}
+
+		// The CPU this shard's thread is pinned to, or -1 if it isn't.
+
+		inline int GetCPU() const {
+			return cpu;
+		}
+
+		// Removes a connection from our pool and deletes it.
+		// Only call this from the shard's thread.
+		void CloseConnection(TCPSocket* pSocket);
+
+		// Copies our counters. Safe from any thread.
+		void GetStats(EventLoopShardStats& statsOut) const;
+
+		// A shard whose poll fails for any reason but a signal stops,
+		// instead of failing over and over. Returns the errno it failed
+		// with, or zero if it didn't. Safe from any thread.
+
+		inline int GetPollError() const {
+			return pollError.load(std::memory_order_relaxed);
+		}
+
+		// Our thread needs access to our internals
+		friend void* EventLoopShardThread(void*);
+	private:
+		EventLoopShard(EventLoopGroup* parentGroup, size_t shardIndex, int shardCPU);
+		~EventLoopShard();
+
+		EventLoopGroup* group;
+		size_t index;
+		int cpu;
+
+		SocketPool* pool;
+		TCPServerSocket listener;
+
+		pthread_t thread;
+		bool threadStarted;
+
+		// Handles of our connections, so they can be closed when we stop.
+		// Entries of closed connections are dropped now and then.
+		std::vector<SocketHandle> connections;
+		size_t closedSinceCompact;
+
+		std::atomic<uint64_t> connectionsAccepted;
+		std::atomic<uint64_t> connectionsRejected;
+		std::atomic<uint64_t> connectionsClosed;
+		std::atomic<uint64_t> acceptErrors;
+		std::atomic<uint64_t> pollIterations;
+		std::atomic<uint64_t> readableEvents;
+		std::atomic<uint64_t> writableEvents;
+		std::atomic<uint64_t> errorEvents;
+		std::atomic<int> pollError;
+
+		// Our thread's loop
+		void Run();
+
+		// Gives a new connection to the handler, and keeps it if wanted.
+		void AdoptConnection(TCPSocket* pSocket);
+
+		// Closes every connection still in our pool.
+		void CloseAllConnections();
+	};
+
+	// Runs a number of event loops, each on its own thread pinned to its
+	// own CPU. Every shard binds its own listener to the same port with
+	// SO_REUSEPORT, and the kernel spreads new connections across them,
+	// so shards share nothing.
+	class EventLoopGroup {
+		friend class EventLoopShard;
+	public:
+		// shardCount is the number of threads. Zero uses one per CPU we're
+		// allowed to run on. backend is passed to every shard's pool.
+		// The handler must outlive the group.
+		explicit EventLoopGroup(EventLoopHandler* handler, size_t shardCount = 0,
+								SocketPoolBackend backend = SOCKETPOOL_EPOLL);
+		// Stops and joins all shards.
+		~EventLoopGroup();
+
+		// Pins shards to these CPUs, in order, wrapping around if there
+		// are more shards than CPUs. A negative CPU leaves a shard
+		// unpinned. By default shards are pinned to the CPUs we're allowed
+		// to run on, in order. Takes effect on the next Start.
+		void SetCPUs(const int* cpuList, size_t cpuCount);
+
+		// How long shards block in a poll when nothing happens. Stop
+		// wakes them up right away.
+
+		inline void SetPollTimeout(int milliSeconds) {
+			pollTimeout = milliSeconds;
+		}
+
+		// Puts every shard's pool in auto-drain mode.
+		// Takes effect on the next Start.
+
+		inline void SetAutoDrain(bool enable) {
+			autoDrain = enable;
+		}
+
+		// Creates every shard's listener and starts the threads.
+		// Returns false if the group is already running, or if a listener
+		// or thread could not be created (see GetLastError). Nothing is
+		// left running on failure.
+		// throws:
+		//   runtime_error if a shard's pool can't be created.
+		bool Start(unsigned short port);
+
+		// Asks all shards to stop. Does not wait for them, so it can be
+		// called from a handler.
+		void Stop();
+
+		// Waits for all shards to stop. Call Stop first, or from another
+		// thread.
+		void Join();
+
+		inline bool isRunning() const {
+			return running;
+		}
+
+		inline bool isStopRequested() const {
+			return stopRequested.load(std::memory_order_relaxed);
+		}
+
+		inline size_t GetShardCount() const {
+			return shards.size();
+		}
+
+		inline EventLoopShard& GetShard(size_t shardIndex) {
+			return *shards[shardIndex];
+		}
+
+		// Adds up the counters of all shards.
+		void GetTotalStats(EventLoopShardStats& statsOut) const;
+
+		// Retrieve the last errno caused by Start.
+
+		inline int GetLastError() const {
+			return lasterrno;
+		}
+	private:
+		EventLoopHandler* handler;
+		size_t requestedShards;
+		SocketPoolBackend poolBackend;
+		int pollTimeout;
+		bool autoDrain;
+
+		std::vector<int> cpus;
+		std::vector<EventLoopShard*> shards;
+
+		bool running;
+		std::atomic<bool> stopRequested;
+		int lasterrno;
+
+		// Deletes all shards. They must not be running.
+		void DestroyShards();
+	};
+
+	void* EventLoopShardThread(void*);
+}
+
+#endif /* DH_EVENTLOOPGROUP_HPP */
+
@@ -0,0 +1,123 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_Histogram.hpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 1:40 PM
+ */
+
+#ifndef DH_HISTOGRAM_HPP
+#define DH_HISTOGRAM_HPP
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Number of bits of precision kept inside each power of two.
+// 4 bits gives a relative error of at most 1/16th (6.25%).
+#define DH_HISTOGRAM_DEFAULTPRECISION 4
+
+namespace DigitalHaze {
+
+	// A log-linear histogram in the style of HdrHistogram.
+	// Every power of two range of values is split into a fixed number
+	// of linear buckets, so recording is a few bit operations and an
+	// increment, and memory use is fixed no matter the values recorded.
+	class Histogram {
+	public:
+		// precisionBits: Each power of two range is split into
+		//  2^precisionBits buckets. Values below 2^precisionBits are
+		//  recorded exactly.
+		// throws:
+		//   invalid_argument if precisionBits is zero or above 16.
+		explicit Histogram(unsigned int precisionBits = DH_HISTOGRAM_DEFAULTPRECISION);
+		~Histogram();
+
+		// Records a value count times.
+		void Record(uint64_t value, uint64_t count = 1);
+
+		// Adds all values recorded in another histogram to this one.
+		// throws:
+		//   invalid_argument if the histograms have different precision.
+		void Merge(const Histogram& other);
+
+		// Forgets all recorded values.
+		void Reset();
+
+		// Returns the value at the given percentile (0 to 100).
+		// The returned value is the largest value that falls into the
+		// same bucket as the percentile, so it is never an underestimate.
+		// Returns 0 if nothing has been recorded.
+		uint64_t GetPercentile(double percentile) const;
+
+		// Number of values recorded.
+
+		inline uint64_t GetCount() const {
+			return totalCount;
+		}
+
+		// Smallest value recorded. Zero if nothing was recorded.
+
+		inline uint64_t GetMin() const {
+			return totalCount ? minValue : 0;
+		}
+
+		// Largest value recorded.
+
+		inline uint64_t GetMax() const {
+			return maxValue;
+		}
+
+		// Average of all values recorded.
+
+		inline double GetMean() const {
+			return totalCount ? (double) valueSum / (double) totalCount : 0.0;
+		}
+
+		inline unsigned int GetPrecisionBits() const {
+			return precisionBits;
+		}
+	private:
+		unsigned int precisionBits;
+
+		uint64_t totalCount;
+		uint64_t minValue;
+		uint64_t maxValue;
+		uint64_t valueSum;
+
+		std::vector<uint64_t> counts;
+
+		// Maps a value to its bucket in counts.
+		size_t GetBucketIndex(uint64_t value) const;
+
+		// Returns the largest value that maps to a bucket.
+		uint64_t GetBucketHighestValue(size_t index) const;
+	};
+}
+
+#endif /* DH_HISTOGRAM_HPP */
+
@@ -0,0 +1,109 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_IPFilter.hpp
+ * Author: phytress
+ *
+ * Created on October 19, 2026, 4:10 PM
+ */
+
+#ifndef DH_IPFILTER_HPP
+#define DH_IPFILTER_HPP
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <atomic>
+
+#include "DH_IPPrefixTable.hpp"
+#include "DH_ThreadLockedObject.hpp"
+
+namespace DigitalHaze {
+
+	// The values an IPFilter's table maps prefixes to
+	enum IPFilterAction {
+		IPFILTER_DEFAULT = 0, // No prefix matched
+		IPFILTER_ALLOW,
+		IPFILTER_DENY
+	};
+
+	// Allows or denies addresses by the longest prefix they're in, from
+	// an IPPrefixTable of IPFilterAction values. Addresses in no prefix
+	// get the default action.
+	// The table can be replaced while lookups go on. Lookups never lock
+	// or wait: they only register themselves, so a replaced table is
+	// deleted once the lookups that may still use it are done. Build the
+	// next table on any thread, then hand it over with SetTable.
+	// Hand one to TCPServerSocket::SetIPFilter to check connections when
+	// accepting. Safe from any thread.
+	class IPFilter : public ThreadLockedObject {
+	public:
+		explicit IPFilter(IPFilterAction defaultAction = IPFILTER_ALLOW);
+		// Deletes our table
+		~IPFilter();
+
+		// Starts using table, and takes ownership of it. Waits for
+		// lookups still using the table it replaces, then deletes that.
+		// Null leaves every address to the default action.
+		void SetTable(IPPrefixTable* table);
+
+		// Returns whether addr is allowed.
+		bool IsAllowed(const sockaddr* addr);
+
+		inline void SetDefaultAction(IPFilterAction action) {
+			defaultAllows.store(action != IPFILTER_DENY, std::memory_order_relaxed);
+		}
+
+		inline uint64_t GetAllowedCount() const {
+			return allowedCount.load(std::memory_order_relaxed);
+		}
+
+		inline uint64_t GetDeniedCount() const {
+			return deniedCount.load(std::memory_order_relaxed);
+		}
+	private:
+		std::atomic<IPPrefixTable*> currentTable;
+		std::atomic<bool> defaultAllows;
+
+		// Lookups register with the reader count of the generation they
+		// started in. SetTable moves new lookups to the other count, then
+		// waits for the old one to drain, so readers can't hold it up
+		// forever. Each count has its own cache line.
+		std::atomic<unsigned int> generation;
+		struct readerCount {
+			std::atomic<uint64_t> count;
+			char padding[64 - sizeof (std::atomic<uint64_t>)];
+		} readers[2];
+
+		std::atomic<uint64_t> allowedCount;
+		std::atomic<uint64_t> deniedCount;
+
+		// Not copyable
+		IPFilter(const IPFilter&);
+		IPFilter& operator=(const IPFilter&);
+	};
+}
+
+#endif /* DH_IPFILTER_HPP */
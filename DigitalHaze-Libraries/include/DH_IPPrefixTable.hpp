@@ -0,0 +1,159 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_IPPrefixTable.hpp
+ * Author: phytress
+ *
+ * Created on October 19, 2026, 4:10 PM
+ */
+
+#ifndef DH_IPPREFIXTABLE_HPP
+#define DH_IPPREFIXTABLE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+namespace DigitalHaze {
+
+	// Prefixes, IPv4 and IPv6, and the value each maps to. Gathered here,
+	// then compiled into an IPPrefixTable.
+	class IPPrefixList {
+	public:
+		IPPrefixList();
+		~IPPrefixList();
+
+		// Adds a prefix written like "192.0.2.0/24" or "2001:db8::/32".
+		// A bare address is a prefix of its full length. Bits past the
+		// length are ignored. Returns false if it can't be parsed.
+		bool AddPrefix(const char* cidr, uint32_t value);
+
+		// addr is in host byte order. length is at most 32.
+		void AddIPv4Prefix(uint32_t addr, unsigned int length, uint32_t value);
+
+		// addr is 16 bytes in network byte order. length is at most 128.
+		void AddIPv6Prefix(const uint8_t* addr, unsigned int length, uint32_t value);
+
+		// Makes room for this many prefixes of each family
+		void Reserve(size_t prefixCount);
+
+		void Clear();
+
+		inline size_t GetPrefixCount() const {
+			return ipv4Prefixes.size() + ipv6Prefixes.size();
+		}
+
+		// Our tables compile from our internals
+		friend class IPPrefixTable;
+	private:
+		// Addresses are left-aligned in high, then low, with the bits
+		// past length cleared.
+		struct prefixEntry {
+			uint64_t high;
+			uint64_t low;
+			uint32_t value;
+			uint8_t length;
+		};
+
+		std::vector<prefixEntry> ipv4Prefixes;
+		std::vector<prefixEntry> ipv6Prefixes;
+	};
+
+	// Longest prefix match over IPv4 and IPv6 addresses, as a Poptrie.
+	// The first 16 bits of an address index an array directly. Past that
+	// is a trie taking 6 bits per node, where each node keeps a bitmap of
+	// its children and a bitmap of where its runs of leaves start. Both
+	// are indexed by counting bits, so children and leaves are packed
+	// into two arrays, and a lookup is a few popcounts and cache lines.
+	// A table never changes once built, so any number of threads can look
+	// up in it at once. Build a new one to change it (see IPFilter).
+	class IPPrefixTable {
+	public:
+		// Compiles the prefixes in list. Where the same prefix is in the
+		// list more than once, the last one counts.
+		explicit IPPrefixTable(const IPPrefixList& list);
+		~IPPrefixTable();
+
+		// Returns the value of the longest prefix addr is in, or zero if
+		// it's in none. IPv4-mapped IPv6 addresses are looked up as IPv4,
+		// and other families find nothing.
+		uint32_t Lookup(const sockaddr* addr) const;
+
+		// addr is in host byte order.
+		uint32_t LookupIPv4(uint32_t addr) const;
+
+		// addr is 16 bytes in network byte order.
+		uint32_t LookupIPv6(const uint8_t* addr) const;
+
+		inline size_t GetPrefixCount() const {
+			return prefixCount;
+		}
+
+		// Bytes taken by our nodes and leaves
+		size_t GetMemoryUsage() const;
+	private:
+		struct trieNode {
+			uint64_t childBits; // Slots that lead to another node
+			uint64_t leafBits; // Slots that start a run of leaves
+			uint32_t leafBase;
+			uint32_t childBase;
+		};
+
+		// Indexed by the first 16 bits. Either a node, or a leaf if
+		// flagged so.
+		std::vector<uint32_t> ipv4Direct;
+		std::vector<uint32_t> ipv6Direct;
+
+		std::vector<trieNode> nodes;
+		std::vector<uint32_t> leaves;
+		size_t prefixCount;
+
+		// Looks an address up, starting from direct
+		uint32_t LookupBits(const std::vector<uint32_t>& direct,
+							uint64_t high, uint64_t low) const;
+
+		typedef IPPrefixList::prefixEntry prefixEntry;
+
+		// Builds nodes[nodeIndex] from prefixes[begin, end), which all
+		// share the node's first offset bits. Shorter prefixes are already
+		// in inherited.
+		void CompileNode(const std::vector<prefixEntry>& prefixes,
+						size_t begin, size_t end, unsigned int offset,
+						uint32_t inherited, size_t nodeIndex);
+
+		// Builds a direct array, and the tries below it, from prefixes,
+		// which it sorts
+		void CompileDirect(std::vector<prefixEntry>& prefixes,
+						std::vector<uint32_t>& directOut);
+
+		// Not copyable
+		IPPrefixTable(const IPPrefixTable&);
+		IPPrefixTable& operator=(const IPPrefixTable&);
+	};
+}
+
+#endif /* DH_IPPREFIXTABLE_HPP */
@@ -0,0 +1,130 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_MPSCQueue.hpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 4:40 PM
+ */
+
+#ifndef DH_MPSCQUEUE_HPP
+#define DH_MPSCQUEUE_HPP
+
+#include <atomic>
+#include <utility>
+
+namespace DigitalHaze {
+
+	// A lock-free queue any number of threads can push to, and one thread
+	// pops from (Vyukov's intrusive MPSC queue, with a node per element).
+	// Pushing never waits on other threads: it's one allocation and one
+	// atomic exchange.
+	// A push that's still linking its node looks like an empty queue to
+	// Pop for a moment, so pushers should wake the consumer once they're
+	// done, not before.
+	// T must be default constructible.
+	template <typename T>
+	class MPSCQueue {
+	public:
+
+		MPSCQueue() : tail(new node) {
+			head.store(tail, std::memory_order_relaxed);
+		}
+
+		// Anything left in the queue is destroyed.
+
+		~MPSCQueue() {
+			T discarded;
+			while (Pop(discarded));
+			delete tail;
+		}
+
+		// Safe from any thread.
+
+		void Push(const T& value) {
+			Link(new node(value));
+		}
+
+		void Push(T&& value) {
+			Link(new node(std::move(value)));
+		}
+
+		// Takes the oldest element. Returns false if there is none.
+		// Only one thread may pop.
+
+		bool Pop(T& valueOut) {
+			node* next = tail->next.load(std::memory_order_acquire);
+			if (!next) return false;
+
+			// The next node becomes our new stub, and its value is ours
+			valueOut = std::move(next->value);
+			delete tail;
+			tail = next;
+			return true;
+		}
+
+		// Only meaningful on the popping thread.
+
+		inline bool IsEmpty() const {
+			return !tail->next.load(std::memory_order_acquire);
+		}
+
+		// Returns true if the queue looks empty only because a push is
+		// still linking its node. Only meaningful on the popping thread.
+
+		inline bool IsPushInProgress() const {
+			return IsEmpty() && head.load(std::memory_order_acquire) != tail;
+		}
+	private:
+		struct node {
+			std::atomic<node*> next;
+			T value;
+
+			node() : next(nullptr), value() {
+			}
+
+			explicit node(const T& v) : next(nullptr), value(v) {
+			}
+
+			explicit node(T&& v) : next(nullptr), value(std::move(v)) {
+			}
+		};
+
+		// Where pushers add, and where we pop from
+		std::atomic<node*> head;
+		node* tail;
+
+		void Link(node* n) {
+			node* prev = head.exchange(n, std::memory_order_acq_rel);
+			prev->next.store(n, std::memory_order_release);
+		}
+
+		// Not copyable
+		MPSCQueue(const MPSCQueue&);
+		MPSCQueue& operator=(const MPSCQueue&);
+	};
+}
+
+#endif /* DH_MPSCQUEUE_HPP */
@@ -0,0 +1,132 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_MemoryBudget.hpp
+ * Author: phytress
+ *
+ * Created on October 19, 2026, 9:10 AM
+ */
+
+#ifndef DH_MEMORYBUDGET_HPP
+#define DH_MEMORYBUDGET_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+// Default watermarks, in percent of the limit
+#ifndef DH_MEMORYBUDGET_HIGHPERCENT
+#define DH_MEMORYBUDGET_HIGHPERCENT 85
+#endif
+#ifndef DH_MEMORYBUDGET_LOWPERCENT
+#define DH_MEMORYBUDGET_LOWPERCENT 70
+#endif
+
+namespace DigitalHaze {
+
+	struct MemoryBudgetStats {
+		uint64_t limit;
+		uint64_t used;
+		uint64_t peak; // Most ever used at once
+		uint64_t refusedCharges; // Growth that was turned down
+		uint64_t refusedBytes;
+	};
+
+	// A number of bytes that Buffers draw from as they grow, and give
+	// back as they shrink or are freed (see Buffer::SetMemoryBudget).
+	// Sharing one budget between many buffers caps their memory as a
+	// whole. Above the high watermark the budget is under pressure, and
+	// it stays that way until use falls to the low watermark, so whoever
+	// relieves it doesn't flip back and forth.
+	// Safe from any thread. A budget must outlive everything charged to it.
+	class MemoryBudget {
+	public:
+		explicit MemoryBudget(size_t limitBytes);
+		~MemoryBudget();
+
+		// Takes bytes from the budget. Returns false, and takes nothing,
+		// if that would go over the limit.
+		bool TryCharge(size_t bytes);
+
+		// Takes bytes from the budget even if that goes over the limit,
+		// for memory that's already allocated.
+		void Charge(size_t bytes);
+
+		// Gives bytes back.
+		void Release(size_t bytes);
+
+		// Sets the watermarks in bytes. By default they're
+		// DH_MEMORYBUDGET_HIGHPERCENT and DH_MEMORYBUDGET_LOWPERCENT of
+		// the limit. low is capped at high, and high at the limit.
+		void SetWatermarks(size_t highBytes, size_t lowBytes);
+
+		inline size_t GetLimit() const {
+			return limit;
+		}
+
+		inline size_t GetUsed() const {
+			return used.load(std::memory_order_relaxed);
+		}
+
+		inline size_t GetHighWatermark() const {
+			return highWatermark;
+		}
+
+		inline size_t GetLowWatermark() const {
+			return lowWatermark;
+		}
+
+		// Returns true if use is at or above the high watermark.
+
+		inline bool IsAboveHighWatermark() const {
+			return GetUsed() >= highWatermark;
+		}
+
+		// Copies our counters.
+		void GetStats(MemoryBudgetStats& statsOut) const;
+
+		// Sets the peak back to what's used now, and forgets refusals.
+		void ResetStats();
+	private:
+		size_t limit;
+		size_t highWatermark;
+		size_t lowWatermark;
+
+		std::atomic<size_t> used;
+		std::atomic<size_t> peak;
+		std::atomic<uint64_t> refusedCharges;
+		std::atomic<uint64_t> refusedBytes;
+
+		// Raises peak to at least nowUsed
+		void UpdatePeak(size_t nowUsed);
+
+		// Not copyable
+		MemoryBudget(const MemoryBudget&);
+		MemoryBudget& operator=(const MemoryBudget&);
+	};
+}
+
+#endif /* DH_MEMORYBUDGET_HPP */
@@ -33,8 +33,10 @@
 #define DH_SOCKET_HPP
 
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "DH_Buffer.hpp"
+#include "DH_BufferPool.hpp"
 
 #ifndef DHSOCKETBUFSIZE
 #define DHSOCKETBUFSIZE 4096
@@ -42,17 +44,28 @@
 #ifndef DHSOCKETBUFRESIZE
 #define DHSOCKETBUFRESIZE 4096
 #endif
+// Reads that need at least this many bytes beyond what is buffered
+// are received directly into the caller's memory.
+#ifndef DHSOCKETDIRECTREADSIZE
+#define DHSOCKETDIRECTREADSIZE 16384
+#endif
 
 namespace DigitalHaze {
 
+	class SocketPool;
+
 	class Socket {
 		// We friend these classes so they can either:
 		//  * Use our file descriptor directly
 		//  * Access or set errors
 		// No one else needs this access since others may mess with our sockfd.
+		friend class IOSocket;
 		friend class TCPSocket;
 		friend class TCPClientSocket;
 		friend class TCPServerSocket;
+		friend class UnixSocket;
+		friend class UnixClientSocket;
+		friend class UnixServerSocket;
 		friend class SocketPool;
 	public:
 		Socket();
@@ -90,6 +103,9 @@ namespace DigitalHaze {
 	class IOSocket : public Socket {
 		// Derived types work with our buffers.
 		friend class TCPSocket;
+		friend class UnixSocket;
+		// The io_uring backend receives and sends with our buffers.
+		friend class SocketPool;
 	public:
 		IOSocket();
 		virtual ~IOSocket();
@@ -114,7 +130,11 @@ namespace DigitalHaze {
 		// If there is not enough data in our buffer,
 		// this becomes a blocking operation until there
 		// is enough data or an error occurs.
-		// Returns false on error, true on success.
+		// If the missing amount of data is at least the direct read
+		// threshold, the missing data is received straight into outBuffer
+		// instead of passing through our internal buffer.
+		// Returns false on error, true on success. On error no data is
+		// lost; anything received stays in our internal buffer.
 		// If len is zero, then the size of the entire internal
 		virtual bool Read(void* outBuffer, size_t len);
 
@@ -190,12 +210,75 @@ namespace DigitalHaze {
 		}
 		
 		inline void ClearEgressData() {
+			bool hadEgress = GetEgressDataLen() != 0;
 			writeBuffer.ClearData();
+			NotifyEgressChange(hadEgress);
 		}
 		
 		inline void* GetEgressDataPointer() const {
 			return writeBuffer.GetBufferStart();
 		}
+
+		// Hands over the first messageLen bytes of our read buffer as a
+		// Buffer of their own, without copying them. Our read buffer is
+		// replaced by one from our buffer pool (or a new one), and any
+		// bytes after the message are moved over to it. If those trailing
+		// bytes outnumber the message, the message is copied out instead,
+		// whichever moves fewer bytes.
+		// Whatever messageOut held before is freed.
+		// Returns false if fewer than messageLen bytes are buffered,
+		// or if messageLen is zero.
+		bool DetachMessage(size_t messageLen, Buffer& messageOut);
+
+		// Same as DetachMessage, but hands over the raw malloc'd block.
+		// The caller owns the block and must free() it.
+		// blockSize is set to the allocated size of the block.
+		// Returns null if fewer than messageLen bytes are buffered.
+		void* DetachMessageBlock(size_t messageLen, size_t& blockSize);
+
+		// Sets the pool our read buffer is replaced from when messages are
+		// detached. Pass null to allocate new buffers instead.
+
+		inline void SetBufferPool(BufferPool* pool) {
+			bufferPool = pool;
+		}
+
+		// Sets how many bytes a Read must be missing from our internal
+		// buffer before they are received straight into the caller's
+		// memory. Zero always reads through our internal buffer.
+
+		inline void SetDirectReadThreshold(size_t threshold) {
+			directReadThreshold = threshold;
+		}
+
+		inline size_t GetDirectReadThreshold() const {
+			return directReadThreshold;
+		}
+
+		// Charges our buffers to a memory budget (see
+		// Buffer::SetMemoryBudget), including the buffers that replace
+		// them when messages are detached. Reads that can't grow our read
+		// buffer fail with ENOBUFS. Null stops charging.
+		// A SocketPool with a budget sets it for its sockets.
+		void SetMemoryBudget(MemoryBudget* budget);
+
+		inline MemoryBudget* GetMemoryBudget() const {
+			return memoryBudget;
+		}
+
+		// Returns how much memory our buffers hold, used or not.
+
+		inline size_t GetBufferMemory() const {
+			return readBuffer.GetBufferSize() + writeBuffer.GetBufferSize();
+		}
+
+		// Gets us ready for another connection, keeping our buffers:
+		// leaves our pool, closes our socket, discards buffered data,
+		// shrinks grown buffers back to DHSOCKETBUFSIZE, and forgets our
+		// last error, memory budget, and buffer pool.
+		// Leaving our pool isn't thread safe: call this on our pool's
+		// thread while we're in one. See TCPSocketRecycler.
+		void ResetForReuse();
 	private:
 		// We use our own buffers and we do not increase the size
 		// of the send and recv buffer because of several reasons.
@@ -204,6 +287,38 @@ namespace DigitalHaze {
 		// write data, we should be okay with that and just buffer ourselves.
 		Buffer readBuffer;
 		Buffer writeBuffer;
+
+		size_t directReadThreshold;
+
+		// Where replacement read buffers come from. Can be null.
+		BufferPool* bufferPool;
+
+		// What our buffers are charged to. Can be null.
+		MemoryBudget* memoryBudget;
+
+		// The SocketPool we were last added to, and our handle in it.
+		// It's told when we start or stop having data to send, so it
+		// doesn't have to check every socket. Deleting us removes us
+		// from it.
+		SocketPool* ownerPool;
+		uint64_t ownerHandle;
+
+		// Tells our pool if we started or stopped having data to send
+		// since hadEgress was taken.
+
+		inline void NotifyEgressChange(bool hadEgress) {
+			if (ownerPool && hadEgress != (writeBuffer.GetBufferDataLen() != 0))
+				NotifyOwnerPool();
+		}
+
+		void NotifyOwnerPool();
+
+		// Fills bufOut with an empty buffer, from our pool if we have one.
+		void AcquireBuffer(Buffer& bufOut);
+
+		// Blocks until len bytes are received into outBuffer.
+		// bytesRead is set to how many bytes were received, even on error.
+		bool PerformDirectRead(void* outBuffer, size_t len, size_t& bytesRead);
 	public:
 		// Rule of 5
 
@@ -36,21 +36,186 @@
 
 #include "DH_Socket.hpp"
 #include "DH_Buffer.hpp"
+#include "DH_Histogram.hpp"
+#include "DH_TimerWheel.hpp"
+#include "DH_MPSCQueue.hpp"
+#include "DH_MemoryBudget.hpp"
 
 #include <sys/poll.h>
+#include <sys/epoll.h>
+#include <stdint.h>
+#include <atomic>
 #include <vector>
 
 #define DH_SOCKETPOOL_DEFAULTSIZE 50
 
+// io_uring backend sizing. The submission queue holds this many entries,
+// and the completion queue four times as many.
+#ifndef DH_SOCKETPOOL_URINGENTRIES
+#define DH_SOCKETPOOL_URINGENTRIES 256
+#endif
+// Receive buffers the kernel picks from for TCP sockets.
+// The count must be a power of two.
+#ifndef DH_SOCKETPOOL_URINGBUFCOUNT
+#define DH_SOCKETPOOL_URINGBUFCOUNT 256
+#endif
+#ifndef DH_SOCKETPOOL_URINGBUFSIZE
+#define DH_SOCKETPOOL_URINGBUFSIZE 4096
+#endif
+// Sockets in slots below this are registered with the ring, which
+// saves the kernel a file lookup on every operation.
+#ifndef DH_SOCKETPOOL_URINGFILES
+#define DH_SOCKETPOOL_URINGFILES 1024
+#endif
+
+// A handle that never refers to a socket
+#define DH_INVALID_SOCKETHANDLE 0
+
 namespace DigitalHaze {
 
+	// Identifies a socket inside a SocketPool. A handle stays valid until
+	// its socket is removed. Handles of removed sockets never become valid
+	// again, even if a new socket ends up with the same file descriptor.
+	typedef uint64_t SocketHandle;
+
+	class SocketPool;
+
+	// Receives a socket's events straight from the poll loop, instead of
+	// them going through GetNextReadableSocket and friends.
+	// A handler may add and remove sockets, including the one it was
+	// called for. Once a socket is removed, none of its remaining events
+	// are delivered.
+	class SocketEventHandler {
+	public:
+		virtual ~SocketEventHandler();
+
+		// The socket has data to read, or a passive socket has a
+		// connection waiting.
+		virtual void OnReadable(SocketPool& pool, SocketHandle handle,
+								Socket* pSocket, void* pParam) = 0;
+
+		// The socket can take more data. Sockets are only polled for
+		// this while they have data to send, or while they're watched
+		// (see SocketPool::SetWatchWritable).
+		virtual void OnWritable(SocketPool& pool, SocketHandle handle,
+								IOSocket* pSocket, void* pParam);
+
+		// The socket errored or was closed by its peer.
+		virtual void OnError(SocketPool& pool, SocketHandle handle,
+							Socket* pSocket, void* pParam);
+
+		// The socket's idle timeout ran out. See SetIdleTimeout.
+		virtual void OnIdleTimeout(SocketPool& pool, SocketHandle handle,
+								Socket* pSocket, void* pParam);
+	};
+
+	// How much a pool's busy polling spun, and what it got for it.
+	struct BusyPollStats {
+		uint64_t spinPolls; // Polls that didn't wait
+		uint64_t spinNanoSeconds; // Time spent in them
+		uint64_t spinHits; // Spins that ended with events
+		uint64_t spinMisses; // Spins that gave up and waited
+		uint64_t spinEvents; // Events picked up while spinning
+		uint64_t blockingPolls; // Polls that waited
+		uint64_t blockingEvents; // Events picked up by them
+		uint64_t socketOptionFailures; // SO_BUSY_POLL etc. refused
+	};
+
+	// How a pool's event loop spends its time, to tell a saturated loop
+	// from an idle one. Times are in microseconds.
+	struct PollLoopStats {
+		Histogram blockedTime; // Time waiting in the kernel per poll
+		Histogram processingTime; // Time per poll spent on everything else
+		Histogram betweenPolls; // Time the caller took between polls
+		Histogram readyPerWakeup; // Events picked up per poll
+		Histogram loopLag; // How much later than asked a wait timed out
+		uint64_t polls;
+		uint64_t idlePolls; // Polls that picked up no events
+		uint64_t readableEvents; // Sockets reported readable
+		uint64_t writableEvents; // Sockets reported writable
+		uint64_t errorEvents; // Sockets reported errored
+	};
+
+	// What a pool with a memory budget does while the budget is under
+	// pressure (see SocketPool::SetMemoryBudget). Combine with |.
+	enum MemoryPressurePolicy {
+		MEMPOLICY_NONE = 0,
+		// Stops reading from the sockets holding the most memory, until
+		// what they hold covers the way down to the low watermark.
+		MEMPOLICY_PAUSEREADS = 1,
+		// Stops accepting on passive sockets. New connections wait in
+		// the kernel's backlog.
+		MEMPOLICY_REFUSEACCEPTS = 2,
+		// Once the budget is spent, reports the sockets holding the most
+		// memory as errored with ENOBUFS, until what they hold covers the
+		// way down to the high watermark. Whoever handles errors is
+		// expected to close them.
+		MEMPOLICY_CLOSEWORST = 4
+	};
+
+	// What a pool did about the pressure on its memory budget.
+	struct MemoryPolicyStats {
+		uint64_t pressureEvents; // Times the budget went above its high watermark
+		uint64_t pressuredPolls; // Polls made while under pressure
+		uint64_t trimmedBytes; // Given back by shrinking idle socket buffers
+		uint64_t readPauses; // Sockets whose reads were paused
+		uint64_t acceptPauses; // Times passive sockets were paused
+		uint64_t evictions; // Sockets reported errored to free memory
+		uint64_t pausedSockets; // Paused right now, passive ones included
+	};
+
+	// Work posted to a pool from another thread. See PostClosure.
+	typedef void (*PoolClosure)(SocketPool& pool, void* pParam);
+
 	struct socketEntry {
 		Socket* pSocket;
 		void* pParam;
+		// Called with the socket's events. If null, events go to our
+		// output lists.
+		SocketEventHandler* handler;
 		bool passiveSocket;
+		// What we last asked the kernel to watch for (epoll backend)
+		uint32_t pollEvents;
+	};
+
+	// How a SocketPool waits on its sockets.
+	enum SocketPoolBackend {
+		// poll() over every socket on every call.
+		SOCKETPOOL_POLL = 0,
+		// epoll. Interest is registered once and changed only when it
+		// has to be, and each wakeup only costs as much as the number of
+		// ready sockets.
+		SOCKETPOOL_EPOLL,
+		// io_uring (Linux 6.1 or later). Operations are queued up during
+		// a poll and submitted together with the wait, in one system call.
+		// TCPSockets are worked on by the pool itself:
+		//  * Incoming data is already in the socket's read buffer when the
+		//    socket is returned as readable. Do not call PerformSocketRead.
+		//  * Data written to the socket is sent by the pool on its next
+		//    poll. Do not call PerformSocketWrite. The socket is returned
+		//    as writable once everything handed to the kernel was sent.
+		// Passive sockets accept connections on their own. Take them with
+		// GetNextAcceptedFD instead of waiting for the listener to become
+		// readable. Listeners that can't accept are polled instead.
+		// Other sockets are polled for readiness like with SOCKETPOOL_POLL.
+		// If io_uring is not available, epoll is used, then poll.
+		SOCKETPOOL_IOURING
+	};
+
+	// Distributions of kernel TCP state sampled across a pool's sockets.
+	struct TCPInfoStats {
+		Histogram rtt; // Smoothed round trip time in microseconds
+		Histogram rttVar; // Round trip time variance in microseconds
+		Histogram totalRetrans; // Lifetime retransmits per connection
+		Histogram unackedPackets; // Packets in flight per connection
+		Histogram sendCwnd; // Congestion window in packets
+		uint64_t samples; // Number of sockets sampled
+		uint64_t retransmitting; // Samples with retransmits in flight
 	};
 
 	class SocketPool : public ThreadLockedObject {
+		// Sockets tell us when they start or stop having data to send
+		friend class IOSocket;
 	public:
 		// The default pool size is how many clients we're anticipating.
 		// If that maximum is reached, we allocate more space for
@@ -59,98 +224,701 @@ namespace DigitalHaze {
 		// and an overflow error is thrown.
 		// If the pool size is 0, then a default size of 50 is used.
 		// This is defined by DH_SOCKETPOOL_DEFAULTSIZE.
+		// backend selects how sockets are polled. GetBackend tells which
+		// backend is actually used.
+		// throws:
+		//   runtime_error if the epoll instance can't be created.
 		explicit SocketPool(size_t defaultPoolSize = DH_SOCKETPOOL_DEFAULTSIZE,
-							size_t expandSlotsSize = DH_SOCKETPOOL_DEFAULTSIZE);
+							size_t expandSlotsSize = DH_SOCKETPOOL_DEFAULTSIZE,
+							SocketPoolBackend pollBackend = SOCKETPOOL_POLL);
 		~SocketPool();
 
 		// Adds a socket to the list. pParam is an optional parameter.
 		// This pointer is given along with the socket when any activity
-		// is detected.
-		void AddSocket(IOSocket* pSocket, void* pParam = nullptr);
+		// is detected. If handler is not null, the socket's events are
+		// given to it while polling (see SocketEventHandler) and the
+		// socket never shows up in GetNextReadableSocket and friends.
+		// Returns the socket's handle, or DH_INVALID_SOCKETHANDLE if the
+		// socket is invalid or already in our list.
+		// If our list still holds a socket by this file descriptor that
+		// has since been closed, that stale socket is removed first.
+		// A socket only reports its writes to the last pool it was added
+		// to, so it should not be in more than one pool at a time.
+		// Deleting a socket removes it from its pool.
+		// A socket added with data already in its read buffer, like one
+		// that read on accept, is reported readable by our next poll.
+		// throws:
+		//   runtime_error if the epoll backend can't register the socket.
+		SocketHandle AddSocket(IOSocket* pSocket, void* pParam = nullptr,
+							SocketEventHandler* handler = nullptr);
 		// Adds a passive socket to the list.
-		void AddPassiveSocket(Socket* pSocket, void* pParam = nullptr);
+		SocketHandle AddPassiveSocket(Socket* pSocket, void* pParam = nullptr,
+									SocketEventHandler* handler = nullptr);
 
 		// Removes a socket from the list.
+		// throws:
+		//   logic_error if the socket is not in our list.
 		bool RemoveSocket(Socket* pSocket);
 
+		// Removes a socket from the list by its handle. This works even if
+		// the socket was already closed. Returns false if the handle is
+		// no longer valid.
+		bool RemoveSocket(SocketHandle handle);
+
+		// Returns the socket a handle refers to, or null if the handle is
+		// no longer valid. If pParam is not null, then the socket's
+		// associated pointer is filled.
+		Socket* GetSocket(SocketHandle handle, void** pParam = nullptr) const;
+
+		// Changes who receives a socket's events. Null sends them to our
+		// output lists again. Returns false if the handle is no longer
+		// valid.
+		bool SetSocketHandler(SocketHandle handle, SocketEventHandler* handler);
+
+		// Reports a socket as writable even when it has nothing to send,
+		// for example to hear when a non-blocking connect finished.
+		// Returns false if the handle is no longer valid or the socket
+		// is passive.
+		bool SetWatchWritable(SocketHandle handle, bool enable);
+
+		// Returns the handle of a socket in our list, or
+		// DH_INVALID_SOCKETHANDLE if it isn't in our list.
+		SocketHandle GetSocketHandle(const Socket* pSocket) const;
+
+		// Returns true if the handle still refers to a socket in our list.
+
+		inline bool IsValidHandle(SocketHandle handle) const {
+			return GetSlotFromHandle(handle) != nullptr;
+		}
+
 		// Returns false on error. Returns true if sockets are ready
 		// to be worked with. Blocks for the specified number of milliseconds.
 		// If the milliseconds is negative, then the function will block
 		// until interrupted or until something in our list is ready for IO.
 		// A value of zero will not block.
+		// Handlers of ready sockets are called before this returns.
+		// Work posted from other threads is carried out before waiting
+		// and again after, and posting wakes up a blocked poll. If there
+		// was any before waiting, we don't wait, so the caller sees what
+		// it did right away. A pool
+		// without sockets still waits, for posted work or timers.
 		bool PollSockets(int milliSeconds = 0);
 
+		// The Post functions queue work for the thread polling this pool,
+		// without locking. They're safe from any thread, and wake up the
+		// pool if it's blocked in PollSockets.
+		// Work is carried out in the order it was posted.
+
+		// Adds a socket on the polling thread. The socket must not be
+		// touched by the posting thread afterwards. Use PostClosure if
+		// the handle is needed.
+		void PostAddSocket(IOSocket* pSocket, void* pParam = nullptr,
+						SocketEventHandler* handler = nullptr);
+		void PostAddPassiveSocket(Socket* pSocket, void* pParam = nullptr,
+								SocketEventHandler* handler = nullptr);
+
+		// Removes a socket on the polling thread. Nothing happens if the
+		// handle is no longer valid by then.
+		void PostRemoveSocket(SocketHandle handle);
+
+		// Copies data to be written to a socket on the polling thread.
+		// The data is sent with the pool's next round of writes, or
+		// dropped if the handle is no longer valid by then.
+		void PostWrite(SocketHandle handle, const void* data, size_t len);
+		// Same, but takes over a buffer's data instead of copying it.
+		void PostWrite(SocketHandle handle, Buffer&& data);
+
+		// Calls closure(pool, pParam) on the polling thread.
+		void PostClosure(PoolClosure closure, void* pParam = nullptr);
+
+		// Makes a blocked PollSockets return. Safe from any thread.
+		void Wake();
+
 		// Returns the next readable socket after polling.
 		// Returns null if there are no more readable sockets.
 		// If pParam is not null, then the socket's associated pointer is filled.
+		// If pHandle is not null, then the socket's handle is filled.
+		// Sockets removed since polling are skipped.
 
-		inline Socket* GetNextReadableSocket(void** pParam = nullptr) {
-			return GetNextEntryFromList(readList, readListIndex, pParam);
+		inline Socket* GetNextReadableSocket(void** pParam = nullptr,
+											SocketHandle* pHandle = nullptr) {
+			return GetNextEntryFromList(readList, readListIndex, pParam, pHandle);
 		}
 
 		// Returns the next writable socket after polling.
 		// Returns null if there are no more writable sockets.
 		// If pParam is not null, then the socket's associated pointer is filled.
+		// If pHandle is not null, then the socket's handle is filled.
 		// Writable sockets are only IOSockets and not passive.
 
-		inline IOSocket* GetNextWritableSocket(void** pParam = nullptr) {
-			return static_cast<IOSocket*> (GetNextEntryFromList(writeList, writeListIndex, pParam));
+		inline IOSocket* GetNextWritableSocket(void** pParam = nullptr,
+											SocketHandle* pHandle = nullptr) {
+			return static_cast<IOSocket*> (GetNextEntryFromList(writeList,
+					writeListIndex, pParam, pHandle));
 		}
 
 		// Returns the next socket that had an error on it after polling.
 		// Returns null if there are no more error'd sockets.
 		// If pParam is not null, then the socket's associated pointer is filled.
+		// If pHandle is not null, then the socket's handle is filled.
+
+		inline Socket* GetNextErroredSocket(void** pParam = nullptr,
+											SocketHandle* pHandle = nullptr) {
+			return GetNextEntryFromList(errorList, errorListIndex, pParam, pHandle);
+		}
+
+		// Returns the next socket whose idle timeout ran out during the
+		// last poll. Returns null if there are no more.
+		// If pParam is not null, then the socket's associated pointer is filled.
+		// If pHandle is not null, then the socket's handle is filled.
 
-		inline Socket* GetNextErroredSocket(void** pParam = nullptr) {
-			return GetNextEntryFromList(errorList, errorListIndex, pParam);
+		inline Socket* GetNextTimedOutSocket(void** pParam = nullptr,
+											SocketHandle* pHandle = nullptr) {
+			return GetNextEntryFromList(timedOutList, timedOutListIndex, pParam, pHandle);
 		}
 
+		// Returns the file descriptor of the next connection accepted by
+		// a passive socket (io_uring backend). The caller owns it. Hand it
+		// to the listener's TCPServerSocket::AdoptAcceptedFD to apply its
+		// filter, admission control, and recycler. Returns -1 if there
+		// are no more. If pParam is not null, then the listener's
+		// associated pointer is filled. If pListener is not null, then the
+		// listener's handle is filled.
+		int GetNextAcceptedFD(void** pParam = nullptr,
+							SocketHandle* pListener = nullptr);
+
 		// Returns the number of sockets in this pool
 
 		inline size_t GetListSize() const {
-			return sockList.size();
+			return socketCount;
 		}
+
+		// In auto-drain mode the pool does the IO on ready sockets while
+		// polling. Readable sockets are read until the kernel has nothing
+		// more, and pending outgoing data is flushed before waiting and
+		// whenever a socket can take more. Only sockets that gained data
+		// are returned as readable, only watched sockets (see
+		// SetWatchWritable) are returned as writable, and sockets whose
+		// reads or writes failed are returned as errored. The epoll backend watches sockets edge-triggered in
+		// this mode, so each change in readiness is reported once.
+		// Passive sockets are reported readable as usual.
+		// The io_uring backend already works this way for TCPSockets, so
+		// this has no effect there.
+		void SetAutoDrain(bool enable);
+
+		inline bool GetAutoDrain() const {
+			return autoDrain;
+		}
+
+		// Limits how much an auto-draining pool reads from one socket
+		// per poll, so a flooding peer can't hold up everyone else.
+		// bytesPerSocket caps the bytes read, and readsPerSocket the
+		// reads made. Zero means no limit.
+		// A socket that spends its budget before the kernel runs dry is
+		// carried over: the next PollSockets doesn't wait, and drains it
+		// again after the sockets that became ready, in the order they
+		// ran out. That happens even though an edge-triggered epoll
+		// won't report it again.
+		// Only applies in auto-drain mode, and not on io_uring.
+		void SetFairnessBudget(size_t bytesPerSocket, size_t readsPerSocket = 0);
+
+		// Returns the number of sockets waiting to be drained again.
+
+		inline size_t GetCarriedOverCount() const {
+			return carryOver.size();
+		}
+
+		// Busy polling. A PollSockets that would block first polls
+		// without waiting for up to spinMicroSeconds, and only waits if
+		// nothing happens by then. This saves the wakeup latency of
+		// sleeping in the kernel, at the cost of a busy CPU.
+		// The spin adapts: a spin that gives up halves the next one, down
+		// to a sixteenth, and a spin that finds events restores it.
+		// socketBusyPollMicroSeconds sets SO_BUSY_POLL on every socket,
+		// which makes the kernel poll the device queue on reads and
+		// polls instead of waiting for an interrupt. preferBusyPoll sets
+		// SO_PREFER_BUSY_POLL, which defers interrupts while the
+		// application keeps polling. Raising SO_BUSY_POLL above the
+		// net.core.busy_read sysctl needs CAP_NET_ADMIN; refused options
+		// are counted in the stats.
+		// A spin of zero disables spinning.
+		void SetBusyPoll(int spinMicroSeconds, int socketBusyPollMicroSeconds = 0,
+						bool preferBusyPoll = false);
+
+		// Copies how much we spun and what came of it.
+
+		inline void GetBusyPollStats(BusyPollStats& statsOut) const {
+			statsOut = busyPollStats;
+		}
+
+		void ResetBusyPollStats();
+
+		// Returns how this pool polls its sockets.
+
+		inline SocketPoolBackend GetBackend() const {
+			return backend;
+		}
+
+		// Returns the errno of the last poll that failed. EINTR means a
+		// signal interrupted it, and polling again is fine.
+
+		inline int GetLastError() const {
+			return lasterrno;
+		}
+
+		// Periodically samples TCP_INFO of the TCPSockets in this pool
+		// while polling, and records their round trip times and
+		// retransmits in histograms.
+		// intervalMilliSeconds: how often to sample. Zero or negative
+		//   disables sampling.
+		// socketsPerSample: how many sockets to visit every interval. The
+		//   pool is walked round-robin, so a small number spreads the
+		//   cost of a large pool over several intervals. Zero visits
+		//   every socket.
+		void SetTCPInfoSampling(int intervalMilliSeconds, size_t socketsPerSample = 0);
+
+		// Copies the sampled TCP distributions.
+
+		inline void GetTCPInfoStats(TCPInfoStats& statsOut) const {
+			statsOut = tcpInfoStats;
+		}
+
+		// Forgets all sampled TCP distributions.
+		void ResetTCPInfoStats();
+
+		// Measures how our event loop spends its time (see
+		// PollLoopStats). Costs a few clock reads per poll.
+		void SetLoopStats(bool enable);
+
+		// Copies our loop measurements. Safe from any thread.
+		void GetLoopStats(PollLoopStats& statsOut) const;
+
+		// Forgets our loop measurements. Safe from any thread.
+		void ResetLoopStats();
+
+		// Charges the buffers of every socket in this pool to a budget
+		// (see IOSocket::SetMemoryBudget), so the pool as a whole can't
+		// take more memory than the budget allows. The budget can be
+		// shared with other pools, and must outlive the pool, its sockets,
+		// and any messages detached from them.
+		// Every poll while the budget is above its high watermark, grown
+		// socket buffers are shrunk back as far as their data allows, then
+		// policies are applied (see MemoryPressurePolicy). Paused sockets
+		// resume once the budget falls to its low watermark.
+		// With MEMPOLICY_PAUSEREADS, a socket whose reads the budget can't
+		// cover is paused on the spot. Otherwise those reads fail with
+		// ENOBUFS, and so do posted writes: the socket is reported as
+		// errored, since part of a stream can't be dropped. Other writes
+		// throw overflow_error (see Buffer::SetMemoryBudget).
+		// The io_uring backend can go over the budget by what the kernel
+		// already received for sockets we pause, since that can't be
+		// given back. That's at most about its receive buffers, which are
+		// DH_SOCKETPOOL_URINGBUFCOUNT of DH_SOCKETPOOL_URINGBUFSIZE bytes.
+		// Null stops charging and resumes everything we paused.
+		void SetMemoryBudget(MemoryBudget* budget,
+							unsigned policies = MEMPOLICY_PAUSEREADS | MEMPOLICY_REFUSEACCEPTS);
+
+		inline MemoryBudget* GetMemoryBudget() const {
+			return memoryBudget;
+		}
+
+		// Copies what we did about memory pressure.
+
+		inline void GetMemoryPolicyStats(MemoryPolicyStats& statsOut) const {
+			statsOut = memoryPolicyStats;
+			statsOut.pausedSockets = memoryPausedSockets.size();
+		}
+
+		// Milliseconds on a monotonic clock. The clock is read once when
+		// polling starts and once when the wait ends, so this is cheap to
+		// call as often as wanted. It may lag a few milliseconds behind.
+
+		inline uint64_t GetCachedTime() const {
+			return cachedTime;
+		}
+
+		// Calls callback with pParam once milliSeconds have passed on our
+		// cached clock. Timers fire during PollSockets, after the sockets
+		// were polled, and PollSockets never blocks past the next timer.
+		// The callback may add and cancel timers, and remove sockets.
+		TimerHandle AddTimer(int milliSeconds, TimerCallback callback,
+							void* pParam = nullptr);
+
+		// Cancels a timer. Returns false if it already fired or was
+		// cancelled.
+
+		inline bool CancelTimer(TimerHandle handle) {
+			return timers.CancelTimer(handle);
+		}
+
+		// Returns the number of pending timers, including idle timeouts.
+
+		inline size_t GetTimerCount() const {
+			return timers.GetTimerCount();
+		}
+
+		// Reports a socket through GetNextTimedOutSocket when it had no
+		// events for milliSeconds, and again every milliSeconds for as
+		// long as it stays idle. Any event the pool sees on the socket
+		// counts as activity. Zero or negative disables the timeout.
+		// Returns false if the handle is no longer valid.
+		bool SetIdleTimeout(SocketHandle handle, int milliSeconds);
 	private:
-		// Our list of sockets
-		std::vector<socketEntry> sockList;
+		// Where a socket lives in our pool.
+		struct socketSlot {
+			socketEntry entry;
+			// The fd the socket had when it was added. Sockets may be
+			// closed before they are removed from our list.
+			int sockfd;
+			// Incremented every time the slot is emptied, which is what
+			// makes old handles to this slot invalid.
+			uint32_t generation;
+			// Position of our pollfd in pollfdsBuffer (poll backend)
+			uint32_t pollIndex;
+			// Next empty slot, if we are empty
+			uint32_t nextFreeSlot;
+			bool inUse;
+			// Idle timeout in milliseconds, zero if there is none.
+			// Events only update lastActivity. The timer checks it when it
+			// fires and is set again for whatever time is left.
+			uint32_t idleTimeout;
+			uint64_t lastActivity;
+			TimerHandle idleTimer;
+			// Auto-drain: the poll we last drained in, and whether we're
+			// waiting in carryOver.
+			uint32_t drainIteration;
+			bool carriedOver;
+			// Whether we're in dirtyEgress
+			bool egressDirty;
+			// Polled for writing no matter what's in the write buffer
+			bool watchWritable;
+			// Not polled for reading (or accepting) for now
+			bool readPaused;
+			// Already reported errored to free memory
+			bool memoryEvicted;
+		};
+
+		SocketPoolBackend backend;
+		bool autoDrain;
+		// Why our last poll failed
+		int lasterrno;
+
+		// Fairness budgets, and sockets that spent theirs. carryOver is
+		// swapped into carryOverRunning when a poll starts.
+		size_t budgetBytes;
+		size_t budgetReads;
+		uint32_t drainIteration;
+		std::vector<SocketHandle> carryOver;
+		std::vector<SocketHandle> carryOverRunning;
+
+		// Sockets added with data already read, which the kernel won't
+		// tell us about. Reported by the next poll.
+		std::vector<SocketHandle> bufferedIngress;
+		std::vector<SocketHandle> bufferedIngressRunning;
+
+		// Sockets whose write buffer became empty or non-empty since our
+		// last poll, so only they need their write interest changed.
+		// dirtyEgress is swapped into dirtyEgressRunning when the backend
+		// gets to them.
+		std::vector<SocketHandle> dirtyEgress;
+		std::vector<SocketHandle> dirtyEgressRunning;
+
+		// Every socket in our pool. Emptied slots are chained together
+		// and reused, so slot indexes never move.
+		std::vector<socketSlot> slots;
+		uint32_t freeSlotHead;
+		size_t socketCount;
+
+		// Slot index of every file descriptor in our list, indexed by
+		// the file descriptor.
+		std::vector<uint32_t> fdSlotTable;
 
 		// Our array that we poll with.
 		// We keep this allocated and updated so we can poll without
 		// having to allocate every time.
 		Buffer pollfdsBuffer;
+		// The slot index of every pollfd in pollfdsBuffer
+		std::vector<uint32_t> pollSlots;
+		// Wakes us up when other threads post work. wakePending is set
+		// by whoever writes to it first, so it's written once per wakeup
+		// no matter how much is posted.
+		int wakefd;
+		std::atomic<bool> wakePending;
+
+		// Work posted from other threads
+		enum poolCommandType {
+			POOLCMD_ADDSOCKET = 0,
+			POOLCMD_ADDPASSIVESOCKET,
+			POOLCMD_REMOVESOCKET,
+			POOLCMD_WRITE,
+			POOLCMD_CLOSURE
+		};
+
+		struct poolCommand {
+			poolCommandType type;
+			Socket* pSocket;
+			void* pParam;
+			SocketEventHandler* handler;
+			SocketHandle handle;
+			Buffer* data;
+			PoolClosure closure;
+		};
+		MPSCQueue<poolCommand> commands;
+
+		// Ready sockets of the poll backend. Handlers can add and remove
+		// sockets, which moves pollfds around, so the results are taken
+		// out of the pollfds before any handler is called.
+		struct pollResult {
+			SocketHandle handle;
+			short revents;
+		};
+		std::vector<pollResult> pollResults;
+
+		// Our epoll instance and the array it reports events in.
+		int epollfd;
+		Buffer epollEventsBuffer;
+
+		// io_uring instance and per-slot operation state.
+		// Null unless we're using the io_uring backend.
+		struct uringState;
+		uringState* uring;
 
 		// List that contains what sockets can be read from
-		std::vector<socketEntry> readList;
+		std::vector<SocketHandle> readList;
 		size_t readListIndex;
 
 		// List that contains what sockets we can write to
-		std::vector<socketEntry> writeList;
+		std::vector<SocketHandle> writeList;
 		size_t writeListIndex;
 
 		// List that contains what sockets have errored.
-		std::vector<socketEntry> errorList;
+		std::vector<SocketHandle> errorList;
 		size_t errorListIndex;
 
-		// Add a socket to the poll list
-		void AddSocketToPollList(int sockfd);
+		// List that contains what sockets went idle for too long.
+		std::vector<SocketHandle> timedOutList;
+		size_t timedOutListIndex;
+
+		// Our timers and the clock they run on
+		TimerWheel timers;
+		uint64_t cachedTime;
+		// Slot index of every idle timer, indexed by its timer index
+		std::vector<uint32_t> idleTimerSlots;
+
+		// Busy polling settings, in microseconds, and how long we spin
+		// for now.
+		int busyPollSpin;
+		int busyPollCurrentSpin;
+		int socketBusyPoll;
+		bool preferBusyPoll;
+		BusyPollStats busyPollStats;
+
+		// Counts every event we see, so we can tell whether a poll
+		// found anything.
+		uint64_t pollEventCount;
+
+		// Event loop measurements. They're copied from other threads, so
+		// they're only touched under their own lock, once per poll. The
+		// rest is what the current poll has seen so far.
+		bool loopStatsEnabled;
+		PollLoopStats loopStats;
+		mutable ThreadLockedObject loopStatsLock;
+		uint64_t lastPollEnd;
+		uint64_t pollBlockedTime;
+		uint64_t pollReadable;
+		uint64_t pollWritable;
+		uint64_t pollErrors;
+
+		// Memory budget state. Sockets we paused because of pressure are
+		// kept in memoryPausedSockets so they can be resumed.
+		MemoryBudget* memoryBudget;
+		unsigned memoryPolicies;
+		bool memoryPressured;
+		bool acceptsPaused;
+		std::vector<SocketHandle> memoryPausedSockets;
+		// Memory held and slot index of sockets we could pause or evict
+		std::vector<std::pair<size_t, uint32_t> > memoryCandidates;
+		MemoryPolicyStats memoryPolicyStats;
+
+		// TCP_INFO sampling state
+		int tcpInfoInterval;
+		size_t tcpInfoSocketsPerSample;
+		size_t tcpInfoCursor;
+		uint64_t tcpInfoNextSample;
+		TCPInfoStats tcpInfoStats;
+
+		// Puts a new entry in a slot and starts polling it.
+		// Returns the new handle.
+		SocketHandle AddEntry(socketEntry& entry);
+
+		// Stops polling a slot and empties it.
+		void RemoveSlot(uint32_t slotIndex);
+
+		// Add a slot's socket to the poll list
+		void AddSocketToPollList(uint32_t slotIndex);
+
+		// Remove a slot's socket from the poll list. The last pollfd
+		// takes its place.
+		void RemoveSocketFromPollList(uint32_t slotIndex);
+
+		// Polls with our backend
+		bool PollBackend(int milliSeconds);
+
+		// Polls without waiting until something happens or our spin runs
+		// out, then polls for the rest of milliSeconds.
+		bool BusyPoll(int milliSeconds);
+
+		// Sets the busy poll socket options on a socket
+		void ApplyBusyPollOptions(int sockfd);
+
+		// Polls with poll(), filling our output lists.
+		bool PollWithPoll(int milliSeconds);
 
-		// Remove a socket from the poll list.
-		// Returns false if the socket file descriptor is not found
-		bool RemoveSocketFromPollList(int sockfd);
+		// Polls with epoll_wait(), filling our output lists.
+		bool PollWithEpoll(int milliSeconds);
 
-		// Remove a socket from the specified list.
-		static bool RemoveSocketFromVector(Socket* pSock,
-										std::vector<socketEntry>& list,
-										size_t& vectorIndex);
+		// Sets up our io_uring instance. Returns false if io_uring (or a
+		// feature we rely on) isn't available.
+		bool InitIOUring();
+		void DestroyIOUring();
 
-		// Gets the next socketEntry from the specified list
-		static Socket* GetNextEntryFromList(std::vector<socketEntry>& list,
-											size_t& index,
-											void** pParam = nullptr);
+		// Submits queued operations and waits for completions in one call,
+		// filling our output lists.
+		bool PollWithIOUring(int milliSeconds);
 
-		// Returns the index inside sockList where sockfd occurs.
-		// If it is not found, -1 is returned.
-		ssize_t GetListIndexFromFD(int sockfd) const;
+		// Starts and stops operations on a slot's socket
+		void IOUringAddSlot(uint32_t slotIndex);
+		void IOUringRemoveSlot(uint32_t slotIndex);
+		// Cancels or rearms its reads (or accepts)
+		void IOUringSetReadPaused(uint32_t slotIndex, bool paused);
+
+		// Queues operations that start on the next submission
+		void IOUringArmSlot(SocketHandle handle);
+		bool IOUringSubmitSend(uint32_t slotIndex);
+
+		// Works a completion into our sockets and output lists.
+		void IOUringComplete(uint64_t userData, int32_t res, uint32_t flags);
+
+		// What epoll should watch a socket for, given whether it has
+		// data to write, and whether its reads are paused.
+		uint32_t GetEpollEvents(const socketEntry& entry, bool wantWrite,
+								bool wantRead) const;
+
+		// Stops or resumes polling a socket for reading (or accepting).
+		void SetReadPaused(uint32_t slotIndex, bool paused);
+
+		// Relieves our memory budget if it's under pressure, or resumes
+		// what we paused once it no longer is.
+		void ApplyMemoryPolicy();
+
+		// Stops reading from a socket until our memory budget recovers.
+		void PauseForMemory(uint32_t slotIndex);
+
+		// Reports the sockets in bufferedIngress readable.
+		void ReportBufferedIngress();
+
+		// Resumes every socket we paused for memory.
+		void ReleaseMemoryPressure();
+
+		// Shrinks grown socket buffers as far as their data allows.
+		// Returns the number of bytes given back.
+		size_t TrimSocketBuffers();
+
+		// Fills memoryCandidates with sockets that aren't paused (or
+		// evicted, if that's what they're for), largest first.
+		void FindMemoryCandidates(bool forEviction);
+
+		// Puts a socket in dirtyEgress, unless it's already there.
+		void MarkEgressDirty(SocketHandle handle);
+
+		// Moves dirtyEgress into dirtyEgressRunning, so sockets can be
+		// marked again while the running list is worked on.
+		void TakeDirtyEgress();
+
+		// Auto-drain: sends data written to sockets since our last poll
+		void FlushPendingEgress();
+
+		// Auto-drain: does the IO on a ready socket and reports it.
+		void DrainSocket(SocketHandle handle, IOSocket* sockio, bool readable,
+						bool writable, bool errored);
+
+		// Drains the sockets that were carried over from our last poll
+		void DrainCarriedOver();
+
+		// Sends data until it's all gone or the kernel can't take more.
+		// Returns false on error.
+		bool FlushSocket(IOSocket* sockio);
+
+		// Sorts a socket's events into our output lists
+		void RecordEvents(SocketHandle handle, bool readable, bool writable,
+						bool errored);
+
+		// Calls a socket's handler with its events, or puts them in our
+		// output lists if it has none.
+		void DispatchEvents(SocketHandle handle, bool readable, bool writable,
+							bool errored);
+
+		// Gets the next valid socket from the specified list
+		Socket* GetNextEntryFromList(std::vector<SocketHandle>& list,
+									size_t& index,
+									void** pParam,
+									SocketHandle* pHandle) const;
+
+		// Samples TCP_INFO of sockets if our interval has passed.
+		void SampleTCPInfo();
+
+		// Shortens a poll's wait so it ends by our next timer
+		int GetPollWaitTime(int milliSeconds) const;
+
+		// Rereads our cached clock
+		void UpdateCachedTime();
+
+		// Called around every wait in the kernel. StartWait returns what
+		// EndWait needs to know when the wait started. EndWait rereads
+		// our cached clock.
+		uint64_t StartWait() const;
+		void EndWait(uint64_t waitStart);
+
+		// Adds a finished poll to our loop measurements
+		void RecordLoopStats(uint64_t pollStart, uint64_t readyCount,
+							int waitTime);
+
+		// Carries out work posted from other threads. Returns how many
+		// commands were run.
+		size_t RunPostedCommands();
+
+		// Queues a command and wakes us up
+		void PostCommand(const poolCommand& command);
+
+		// Sets a slot's idle timer to fire at expireTime
+		void ArmIdleTimer(uint32_t slotIndex, uint64_t expireTime);
+
+		// Timer callback of idle timeouts. pParam is the pool.
+		static void IdleTimerExpired(TimerHandle handle, void* pParam);
+
+		// Returns the slot index where sockfd occurs.
+		// If it is not found, UINT32_MAX is returned.
+
+		inline uint32_t GetSlotIndexFromFD(int sockfd) const {
+			if (sockfd < 0 || (size_t) sockfd >= fdSlotTable.size())
+				return UINT32_MAX;
+			return fdSlotTable[sockfd];
+		}
+
+		inline SocketHandle MakeHandle(uint32_t slotIndex) const {
+			return ((SocketHandle) slots[slotIndex].generation << 32) | slotIndex;
+		}
+
+		// Returns the slot a handle refers to, or null if it's stale.
+
+		inline const socketSlot* GetSlotFromHandle(SocketHandle handle) const {
+			uint32_t slotIndex = (uint32_t) (handle & 0xFFFFFFFF);
+			if (slotIndex >= slots.size()) return nullptr;
+			const socketSlot& slot = slots[slotIndex];
+			if (!slot.inUse || slot.generation != (uint32_t) (handle >> 32))
+				return nullptr;
+			return &slot;
+		}
 	};
 }
 
@@ -62,6 +62,19 @@ namespace DigitalHaze {
 		// and isConnected() will return true.
 		bool AttemptThreadedConnect(const char* hostname, unsigned short port);
 
+		// Starts connecting without waiting and without a thread. Name
+		// lookups would block, so hostname must be a numeric IPv4 or IPv6
+		// address. Returns false if the attempt failed right away.
+		// Otherwise wait for the socket to become writable (for example
+		// with SocketPool::SetWatchWritable) and call FinishConnect.
+		bool AttemptNonBlockingConnect(const char* hostname, unsigned short port);
+
+		// Completes a non-blocking connect once the socket became
+		// writable. Returns true if we're connected, and puts the socket
+		// in blocking mode like any other connection. Returns false and
+		// closes the socket if the connect failed (see GetLastError).
+		bool FinishConnect();
+
 		// If a threaded attempt to connect was attempted
 		// this function will let you know if the thread
 		// is still in process of connecting.
@@ -35,12 +35,27 @@
 #include <pthread.h>
 #include <signal.h>
 
+#include <atomic>
+
 #include "DH_Socket.hpp"
 #include "DH_TCPSocket.hpp"
 #include "DH_ThreadLockedObject.hpp"
+#include "DH_BoundedQueue.hpp"
+
+// Connections a threaded listener accepts ahead of whoever takes them.
+// Beyond this, the rest wait in the kernel's backlog. Must be a power
+// of two.
+#ifndef DH_TCPSERVER_ACCEPTQUEUESIZE
+#define DH_TCPSERVER_ACCEPTQUEUESIZE 1024
+#endif
 
 namespace DigitalHaze {
 
+	class SocketPool;
+	class SocketEventHandler;
+	class TCPSocketRecycler;
+	class IPFilter;
+
 	class TCPServerSocket : public Socket, public ThreadLockedObject {
 	public:
 		TCPServerSocket();
@@ -48,15 +63,65 @@ namespace DigitalHaze {
 
 		// Creates our listener
 		bool CreateListener(unsigned short port);
-		// Creates our listener on a separate thread
+		// Creates our listener on a separate thread. The thread keeps
+		// accepting into a queue of DH_TCPSERVER_ACCEPTQUEUESIZE
+		// connections while nobody takes them, and waits for room once
+		// it's full.
 		bool CreateThreadedListener(unsigned short port);
 		// Retrieves a new client connection from the seperated thread.
 		// Optionally, pass a sockaddr structure or socklen_t* to retrieve
 		// the new connection's address info. Either or both can be null
 		// to be disregarded. Returns null if there is no waiting connection.
 		// Also returns null if there is no thread running.
+		// Safe from any thread, like GetNewConnections.
 		TCPSocket* GetNewConnectionFromThread(TCPAddressStorage* newAddr = nullptr,
 											socklen_t* newAddrLen = nullptr);
+		// Retrieves up to maxCount connections at once. Connections are
+		// stored in socketsOut, and their addresses in addrsOut and
+		// addrLensOut if those aren't null. Returns the number retrieved.
+		// Threaded listeners hand over what their thread queued, and
+		// never block. Otherwise this is a single GetNewConnection.
+		// Safe from any thread while a thread is running.
+		size_t GetNewConnections(TCPSocket** socketsOut, size_t maxCount,
+								TCPAddressStorage* addrsOut = nullptr,
+								socklen_t* addrLensOut = nullptr);
+
+		// Accepts the connections waiting on us, without blocking, until
+		// the kernel has none left or maxCount were taken, and returns
+		// how many were. Call it when a SocketPool reports us readable.
+		// This puts us in non-blocking mode. New sockets are non-blocking
+		// too, so reads and writes that flush on them fail with EAGAIN
+		// instead of waiting.
+		// With SetDeferAccept or SetFastOpen, whatever data came with a
+		// connection is already in its read buffer.
+		// If targetPool isn't null, new sockets are added to it with
+		// pParam and handler. socketsOut can then be null, if the pool's
+		// events are how the caller finds them. Either way the caller
+		// owns them.
+		// The last error is EAGAIN if we ran out of connections, or what
+		// made accepting stop otherwise. Threaded listeners hand over
+		// what their thread queued instead (see GetNewConnections).
+		size_t AcceptConnections(TCPSocket** socketsOut, size_t maxCount,
+								SocketPool* targetPool = nullptr,
+								void* pParam = nullptr,
+								SocketEventHandler* handler = nullptr);
+
+		// Makes a socket for a connection something else accepted on our
+		// listener, such as a SocketPool with the io_uring backend (see
+		// SocketPool::GetNextAcceptedFD). It gets what our own accepts do:
+		// our filter, admission control, recycler, and read on accept.
+		// Returns null, having closed newfd, if the connection is refused.
+		TCPSocket* AdoptAcceptedFD(int newfd);
+
+		// An eventfd that's readable while our thread has connections
+		// queued. Add it to a SocketPool with AddPassiveSocket to hear
+		// about new connections in the poll loop, then take them with
+		// GetNewConnections. It becomes valid with CreateThreadedListener,
+		// and stays valid until we're destroyed.
+
+		inline Socket* GetAcceptNotifier() {
+			return &acceptNotifier;
+		}
 		// Retrieves a new client connection.
 		// Optionally, pass a sockaddr structure or socklen_t* to retrieve
 		// the new connection's address info. Either or both can be null
@@ -72,6 +137,104 @@ namespace DigitalHaze {
 		// all threads are closed too.
 		virtual void CloseSocket() override;
 
+		// Lets several listeners bind the same port (SO_REUSEPORT). The
+		// kernel then spreads new connections across them. Takes effect
+		// on the next CreateListener. Every listener on the port must
+		// set this.
+
+		inline void SetReusePort(bool enable) {
+			reusePort = enable;
+		}
+
+		inline bool GetReusePort() const {
+			return reusePort;
+		}
+
+		// Has the kernel hold new connections back until their first data
+		// arrives (TCP_DEFER_ACCEPT), for up to the given number of
+		// seconds. Connections whose client never sends are then dropped,
+		// so it suits protocols where the client speaks first. Zero turns
+		// it off. It stays set for later listeners.
+		// Returns false if the option could not be set.
+		bool SetDeferAccept(int seconds);
+
+		inline int GetDeferAccept() const {
+			return deferAcceptSeconds;
+		}
+
+		// Accepts data in the SYN of clients that have a TCP Fast Open
+		// cookie from us (TCP_FASTOPEN), saving them a round trip. At
+		// most queueLength such connections wait to be accepted. Zero
+		// turns it off. It stays set for later listeners. The system must
+		// allow server Fast Open (net.ipv4.tcp_fastopen).
+		// Returns false if the option could not be set.
+		bool SetFastOpen(int queueLength);
+
+		inline int GetFastOpen() const {
+			return fastOpenQueueLength;
+		}
+
+		// Takes the sockets of new connections from a recycler instead of
+		// allocating them. Give them back with its Release, or own them
+		// through a PooledTCPSocket. Deleting them still works, it just
+		// doesn't recycle. Null stops recycling. The recycler must outlive
+		// the sockets it hands out, and any connections we accept.
+		// Connections a SocketPool accepts for us (io_uring backend) only
+		// come from it through AdoptAcceptedFD.
+
+		inline void SetSocketRecycler(TCPSocketRecycler* recycler) {
+			socketRecycler = recycler;
+		}
+
+		inline TCPSocketRecycler* GetSocketRecycler() const {
+			return socketRecycler;
+		}
+
+		// Decides on every connection we accept before a socket is made
+		// for it. Refused connections are closed right away, and never
+		// returned. Accepted sockets count towards its connection caps
+		// until they close. Set it before listening, and keep it alive
+		// while we, or sockets we accepted, are. Null accepts everything.
+		// Connections a SocketPool accepts for us (io_uring backend) are
+		// only decided on when handed to AdoptAcceptedFD.
+
+		inline void SetAdmissionControl(AdmissionControl* admission) {
+			admissionControl = admission;
+		}
+
+		inline AdmissionControl* GetAdmissionControl() const {
+			return admissionControl;
+		}
+
+		// Checks every connection we accept against a filter, before
+		// admission control and before a socket is made for it. Denied
+		// connections are closed right away, and never returned. The
+		// filter's table can be replaced while we accept. Set it before
+		// listening, and keep it alive while we are. Null allows
+		// everything.
+		// Connections a SocketPool accepts for us (io_uring backend) are
+		// only checked when handed to AdoptAcceptedFD. EventLoopGroup and
+		// AsyncListener do that, callers of GetNextAcceptedFD must too.
+
+		inline void SetIPFilter(IPFilter* filter) {
+			ipFilter = filter;
+		}
+
+		inline IPFilter* GetIPFilter() const {
+			return ipFilter;
+		}
+
+		// In non-blocking mode GetNewConnection returns null right away
+		// (with EAGAIN as the last error) when no connection is waiting,
+		// which is what event loops want. It stays set for later
+		// listeners. Not meant for threaded listeners.
+		// Returns false if the mode could not be changed.
+		bool SetNonBlocking(bool enable);
+
+		inline bool GetNonBlocking() const {
+			return nonBlocking;
+		}
+
 		// We could use a macro, but this works better with code parsing
 
 		inline bool isListening() {
@@ -89,24 +252,81 @@ namespace DigitalHaze {
 
 		// Our thread needs access to our internals
 		friend void* ListenerThread(void*);
+		friend void CleanupNewConnection(void*);
 	private:
 		// Thread status
 		volatile sig_atomic_t listenerThreadStatus;
+		// Whether listenerThread still has to be joined
+		bool listenerThreadJoinable;
+		// Bind with SO_REUSEPORT
+		bool reusePort;
+		// Accept without blocking
+		bool nonBlocking;
+		// TCP_DEFER_ACCEPT timeout and TCP_FASTOPEN queue length
+		int deferAcceptSeconds;
+		int fastOpenQueueLength;
+		// Where new connections' sockets come from, if not new
+		TCPSocketRecycler* socketRecycler;
+		// Who decides on new connections, if anyone
+		AdmissionControl* admissionControl;
+		// Who allows or denies addresses, if anyone
+		IPFilter* ipFilter;
 		// Thread
 		pthread_t listenerThread;
-		// Condition variable for new connections
+		// Signaled when connections are taken from a full queue
 		pthread_cond_t waitNewConnectionCond;
 
-		// When our thread gets a new socket, we store it until another
-		// thread retrieves it
-		int newsockfd;
+		// Where GetNewConnection stores addresses nobody asked for
 		TCPAddressStorage remoteAddr;
 		socklen_t remoteAddrLen;
 
-		// Notify object for when a new connection was retrieved
-		void Thread_NotifyNewClient(int newfd, TCPAddressStorage* addr, socklen_t addrLen);
+		// Connections our thread accepted that nobody took yet
+		struct queuedConnection {
+			int fd;
+			socklen_t addrLen;
+			TCPAddressStorage addr;
+			// Its admission ticket, detached (see AdmissionTicket::Detach)
+			AdmissionControl* admittedBy;
+			AdmissionKey admissionKey;
+			uint8_t admissionCounted;
+		};
+		BoundedQueue<queuedConnection> acceptQueue;
+		// Set while our thread waits for room in the queue
+		std::atomic<bool> acceptorWaiting;
+
+		// Our eventfd, and whether it was written since it was last read
+		Socket acceptNotifier;
+		std::atomic<bool> notifyPending;
+
+		// Queues a connection our thread accepted, waiting for room if
+		// we're full.
+		void Thread_QueueNewClient(const queuedConnection& conn);
+
+		// Tells our eventfd about queued connections
+		void NotifyQueuedConnections();
+
+		// Wakes our thread if it waits for room in the queue
+		void WakeAcceptor();
+
+		// Turns a queued connection into a socket, filling in its address
+		TCPSocket* TakeQueuedConnection(const queuedConnection& conn,
+										TCPAddressStorage* newAddr,
+										socklen_t* newAddrLen);
+
+		// Asks our filter, then our admission control, about a connection
+		// we accepted. Closes it and returns false if it's refused.
+		bool AdmitConnection(int newfd, const TCPAddressStorage& addr,
+							AdmissionTicket& ticketOut);
+
+		// Makes a socket for an accepted connection, from our recycler if
+		// we have one.
+		TCPSocket* WrapConnection(int newfd, AdmissionTicket&& ticket);
+
+		// With deferred accepts or Fast Open, connections come with data.
+		// Reading it right away saves a poll for it.
+		void ReadOnAccept(TCPSocket* newSocket);
 
-		// Closes the listening thread
+		// Closes the listening thread, and the connections it queued
 		void CloseCurrentThreads();
 
 		// Give our thread access to private parent functions
@@ -125,6 +345,7 @@ namespace DigitalHaze {
 	};
 	
 	void* ListenerThread(void*);
+	void CleanupNewConnection(void*);
 }
 
 #endif /* DH_TCPSERVERSOCKET_HPP */
@@ -33,9 +33,11 @@
 #define DH_TCPSOCKET_HPP
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <netdb.h>
 
 #include "DH_Socket.hpp"
+#include "DH_AdmissionControl.hpp"
 
 namespace DigitalHaze {
 
@@ -46,6 +48,38 @@ namespace DigitalHaze {
 		sockaddr_storage sa_storage;
 	};
 
+	// A snapshot of the kernel's TCP state for a connection (TCP_INFO).
+	// Times are in microseconds unless noted otherwise.
+	struct TCPInfoSnapshot {
+		uint8_t state; // TCP_ESTABLISHED, TCP_CLOSE_WAIT, ...
+		uint8_t congestionState; // TCP_CA_Open, TCP_CA_Loss, ...
+		uint8_t retransmits; // Consecutive retransmits of the same segment
+		uint8_t probes;
+		uint8_t backoff;
+		uint32_t rto;
+		uint32_t sendMSS;
+		uint32_t recvMSS;
+		uint32_t unackedPackets; // Packets sent but not yet acknowledged
+		uint32_t sackedPackets;
+		uint32_t lostPackets;
+		uint32_t retransPackets; // Retransmitted packets still in flight
+		uint32_t lastDataSentMs; // Milliseconds since we last sent data
+		uint32_t lastDataRecvMs; // Milliseconds since we last got data
+		uint32_t pathMTU;
+		uint32_t rtt; // Smoothed round trip time
+		uint32_t rttVar;
+		uint32_t sendSSThresh;
+		uint32_t sendCwnd; // Congestion window in packets
+		uint32_t reordering;
+		uint32_t recvRTT;
+		uint32_t recvSpace;
+		uint32_t totalRetrans; // Retransmits over the connection's lifetime
+		// Only filled in when queue sizes are requested.
+		uint32_t unackedBytes; // Bytes sent but not yet acknowledged
+		uint32_t unsentBytes; // Bytes not even sent yet
+		uint32_t recvQueueBytes; // Bytes waiting for us to recv
+	};
+
 	class TCPSocket : public IOSocket {
 	public:
 		TCPSocket();
@@ -66,15 +100,34 @@ namespace DigitalHaze {
 		// Returns false on error, true on success.
 		virtual bool PerformSocketWrite(bool flush = false) override;
 
+		// Takes over a connected file descriptor. Whatever socket we had
+		// is closed first. Used to reuse a socket object, see
+		// ResetForReuse.
+		void AdoptConnection(int connectedfd);
+
+		// Holds this connection's place in an AdmissionControl's
+		// connection caps, until we close.
+		void SetAdmissionTicket(AdmissionTicket&& ticket);
+
+		// Closes our connection, and gives up our admission ticket.
+		virtual void CloseSocket() override;
+
 		// Let's you know if you're connected or not.
 		bool isConnected() const;
 
+		// Retrieves the kernel's TCP state for this connection.
+		// If includeQueueSizes is true, the send and receive queue sizes
+		// are retrieved as well, which costs three extra system calls.
+		// Returns false on error.
+		bool GetTCPInfo(TCPInfoSnapshot& infoOut, bool includeQueueSizes = false);
+
 		// Converts a TCPAddressStorage structure to a text address.
 		// Returns false if the address cannot be parsed.
 		static bool ConvertAddrToText(TCPAddressStorage& addr,
 									socklen_t len,
 									char* outText);
 	private:
+		AdmissionTicket admissionTicket;
 	};
 }
 
@@ -0,0 +1,166 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_TCPSocketRecycler.hpp
+ * Author: phytress
+ *
+ * Created on October 19, 2026, 1:40 PM
+ */
+
+#ifndef DH_TCPSOCKETRECYCLER_HPP
+#define DH_TCPSOCKETRECYCLER_HPP
+
+#include "DH_TCPSocket.hpp"
+#include "DH_ThreadLockedObject.hpp"
+
+#include <stdint.h>
+
+#include <vector>
+
+#define DH_SOCKETRECYCLER_DEFAULTSIZE 256
+
+namespace DigitalHaze {
+
+	struct TCPSocketRecyclerStats {
+		uint64_t reused; // Connections given a spare socket
+		uint64_t allocated; // Connections given a new socket
+		uint64_t released; // Sockets given back
+		uint64_t discarded; // Given back beyond maxSpares, and deleted
+	};
+
+	// A pool of spare TCPSockets. A socket given back keeps its object and
+	// its buffers, so the next connection doesn't allocate either. A
+	// TCPServerSocket with a recycler (see SetSocketRecycler) takes every
+	// new connection's socket from it.
+	// Sockets can be given back from any thread, or simply deleted. A
+	// socket still in a SocketPool must be given back on that pool's
+	// thread, since resetting it removes it from the pool.
+	class TCPSocketRecycler : public ThreadLockedObject {
+	public:
+		// maxSpares: the most spare sockets we hold on to. Sockets given
+		//  back beyond that are deleted.
+		// preallocate: spare sockets to create up front.
+		explicit TCPSocketRecycler(size_t maxSpares = DH_SOCKETRECYCLER_DEFAULTSIZE,
+								size_t preallocate = 0);
+		// Deletes our spares. Sockets handed out are the caller's.
+		~TCPSocketRecycler();
+
+		// Returns a socket for a connected file descriptor. A new socket
+		// is allocated if we're out of spares.
+		TCPSocket* Acquire(int connectedfd);
+
+		// Takes back a socket. It's reset (see IOSocket::ResetForReuse),
+		// which closes its connection and takes it out of its pool. A
+		// socket in a pool must be given back on the pool's thread;
+		// remove it first (see SocketPool::PostRemoveSocket) to give it
+		// back from elsewhere. Null is ignored.
+		void Release(TCPSocket* pSocket);
+
+		// Number of spare sockets currently held.
+		size_t GetSpareCount();
+
+		void GetStats(TCPSocketRecyclerStats& statsOut);
+	private:
+		size_t maxPooled;
+		std::vector<TCPSocket*> spareSockets;
+		TCPSocketRecyclerStats stats;
+
+		// Not copyable
+		TCPSocketRecycler(const TCPSocketRecycler&);
+		TCPSocketRecycler& operator=(const TCPSocketRecycler&);
+	};
+
+	// Owns a socket from a TCPSocketRecycler, and gives it back when
+	// destroyed or closed. Movable, not copyable. Like Release, destroy
+	// or close it on the pool's thread while the socket is in a pool.
+	class PooledTCPSocket {
+	public:
+
+		PooledTCPSocket() : pSocket(nullptr), recycler(nullptr) {
+		}
+
+		PooledTCPSocket(TCPSocket* socket, TCPSocketRecycler* owner)
+		: pSocket(socket), recycler(owner) {
+		}
+
+		PooledTCPSocket(PooledTCPSocket&& rhs) noexcept
+		: pSocket(rhs.pSocket), recycler(rhs.recycler) {
+			rhs.pSocket = nullptr;
+		}
+
+		PooledTCPSocket& operator=(PooledTCPSocket&& rhs) noexcept {
+			if (this != &rhs) {
+				Close();
+				pSocket = rhs.pSocket;
+				recycler = rhs.recycler;
+				rhs.pSocket = nullptr;
+			}
+			return *this;
+		}
+
+		~PooledTCPSocket() {
+			Close();
+		}
+
+		// Gives our socket back now. Without a recycler it's deleted.
+
+		void Close() {
+			if (!pSocket) return;
+
+			if (recycler) recycler->Release(pSocket);
+			else delete pSocket;
+			pSocket = nullptr;
+		}
+
+		// Stops owning our socket, and returns it.
+
+		TCPSocket* Detach() {
+			TCPSocket* detached = pSocket;
+			pSocket = nullptr;
+			return detached;
+		}
+
+		inline TCPSocket* Get() const {
+			return pSocket;
+		}
+
+		inline TCPSocket* operator->() const {
+			return pSocket;
+		}
+
+		inline explicit operator bool() const {
+			return pSocket != nullptr;
+		}
+	private:
+		TCPSocket* pSocket;
+		TCPSocketRecycler* recycler;
+
+		// Not copyable
+		PooledTCPSocket(const PooledTCPSocket&);
+		PooledTCPSocket& operator=(const PooledTCPSocket&);
+	};
+}
+
+#endif /* DH_TCPSOCKETRECYCLER_HPP */
@@ -0,0 +1,180 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_TimerWheel.hpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 3:20 PM
+ */
+
+#ifndef DH_TIMERWHEEL_HPP
+#define DH_TIMERWHEEL_HPP
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Every level of the wheel has 2^DH_TIMERWHEEL_SLOTBITS slots.
+#define DH_TIMERWHEEL_SLOTBITS 8
+#define DH_TIMERWHEEL_SLOTS (1 << DH_TIMERWHEEL_SLOTBITS)
+#define DH_TIMERWHEEL_LEVELS 4
+
+// A handle that never refers to a timer
+#define DH_INVALID_TIMERHANDLE 0
+
+namespace DigitalHaze {
+
+	// Identifies a pending timer. Handles of timers that fired or were
+	// cancelled never become valid again.
+	typedef uint64_t TimerHandle;
+
+	// Called when a timer expires. The timer is no longer pending by then,
+	// so it's safe to add or cancel timers from the callback.
+	typedef void (*TimerCallback)(TimerHandle handle, void* pParam);
+
+	// A hashed hierarchical timing wheel. Time is counted in ticks, which
+	// are whatever unit the caller uses (SocketPool uses milliseconds).
+	// Four levels of 256 slots cover 2^32 ticks. Timers further out than
+	// that are clamped to it.
+	// Adding, cancelling and rescheduling are O(1). Advancing costs one
+	// step per tick with pending timers, and one per 256 ticks otherwise.
+	// Timers on outer levels move inward as their time nears.
+	// Not thread safe.
+	class TimerWheel {
+	public:
+		// startTime is the current time. reserveTimers preallocates space
+		// for that many timers.
+		explicit TimerWheel(uint64_t startTime = 0, size_t reserveTimers = 0);
+		~TimerWheel();
+
+		// Adds a timer that fires once expireTime has been reached.
+		// Times at or before the current time fire on the next Advance.
+		TimerHandle AddTimer(uint64_t expireTime, TimerCallback callback,
+							void* pParam = nullptr);
+
+		// Cancels a pending timer. Returns false if it already fired or
+		// was cancelled.
+		bool CancelTimer(TimerHandle handle);
+
+		// Moves a pending timer to a new time. Its handle stays the same.
+		// Returns false if it already fired or was cancelled.
+		bool RescheduleTimer(TimerHandle handle, uint64_t expireTime);
+
+		// Returns true if the timer hasn't fired or been cancelled yet.
+		bool IsPending(TimerHandle handle) const;
+
+		// Returns when a pending timer expires, or zero if it isn't pending.
+		uint64_t GetExpireTime(TimerHandle handle) const;
+
+		// Fires every timer that expires up to and including now, and
+		// every timer that was added already overdue.
+		// Returns the number of timers fired.
+		size_t Advance(uint64_t now);
+
+		// Returns the earliest time a timer could fire, or UINT64_MAX if
+		// there are no timers. Timers on outer levels are only known to
+		// the precision of their slot, so this may be earlier than the
+		// real expiry. Advancing to it is always safe.
+		uint64_t GetNextExpiry() const;
+
+		// Returns the number of pending timers
+
+		inline size_t GetTimerCount() const {
+			return timerCount;
+		}
+
+		// Returns the time the wheel has advanced to
+
+		inline uint64_t GetCurrentTime() const {
+			return currentTick ? currentTick - 1 : 0;
+		}
+
+		// Returns the slot a handle occupies in our timer storage.
+		// It's below the number of timers ever pending at once, so it can
+		// index a caller's array of per-timer data.
+
+		static inline uint32_t GetTimerIndex(TimerHandle handle) {
+			return (uint32_t) (handle & 0xFFFFFFFF);
+		}
+	private:
+		struct timerNode {
+			uint64_t expireTime;
+			TimerCallback callback;
+			void* pParam;
+			// Neighbours in our slot's list, or in the free list
+			uint32_t next;
+			uint32_t prev;
+			// Incremented whenever the node is freed
+			uint32_t generation;
+			// Level * DH_TIMERWHEEL_SLOTS + slot, the overdue list right
+			// after the last level, or UINT16_MAX if unused
+			uint16_t wheelSlot;
+		};
+
+		std::vector<timerNode> nodes;
+		uint32_t freeHead;
+		size_t timerCount;
+
+		// The next tick to be processed. Everything before it has fired.
+		uint64_t currentTick;
+
+		// First timer in every slot of every level, then the first timer
+		// that was overdue when added
+		uint32_t slotHeads[DH_TIMERWHEEL_LEVELS * DH_TIMERWHEEL_SLOTS + 1];
+		// Which slots have timers
+		uint64_t occupied[DH_TIMERWHEEL_LEVELS][DH_TIMERWHEEL_SLOTS / 64];
+
+		// Returns the node a handle refers to if it's still pending
+		const timerNode* GetNode(TimerHandle handle) const;
+
+		// Puts a node in the slot its expire time belongs to
+		void Link(uint32_t nodeIndex);
+		// Takes a node out of its slot
+		void Unlink(uint32_t nodeIndex);
+
+		// Frees a node, making its handle invalid
+		void FreeNode(uint32_t nodeIndex);
+
+		// Fires every timer in a slot, including ones callbacks add to it.
+		// Returns the number of timers fired.
+		size_t FireSlot(unsigned wheelSlot);
+
+		// Moves the timers of an outer slot inward
+		void Cascade(unsigned level, unsigned slotIndex);
+		// Moves inward every outer slot that's due once the innermost
+		// level wraps. Called as soon as currentTick reaches a multiple of
+		// DH_TIMERWHEEL_SLOTS, so the innermost level always holds
+		// everything due in its current rotation.
+		void CascadeInward();
+
+		// Returns the first occupied slot at or after fromSlot on a level,
+		// or -1 if there is none before the end of the level.
+		int FindOccupiedSlot(unsigned level, unsigned fromSlot) const;
+	};
+}
+
+#endif /* DH_TIMERWHEEL_HPP */
+
@@ -0,0 +1,59 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_UnixClientSocket.hpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 10:02 AM
+ */
+
+#ifndef DH_UNIXCLIENTSOCKET_HPP
+#define DH_UNIXCLIENTSOCKET_HPP
+
+#include "DH_UnixSocket.hpp"
+
+#include <sys/socket.h>
+
+namespace DigitalHaze {
+
+	class UnixClientSocket : public UnixSocket {
+	public:
+		UnixClientSocket();
+		virtual ~UnixClientSocket();
+
+		// A blocking connect attempt. Will return true if successful.
+		// False if connection did not go through.
+		// socketType is either SOCK_STREAM or SOCK_SEQPACKET.
+		// If abstractNamespace is true, path names an address in the
+		// Linux abstract namespace instead of a file.
+		// Connecting locally never waits on name resolution or the
+		// network, so there is no threaded variant of this call.
+		bool AttemptConnect(const char* path, int socketType = SOCK_STREAM,
+							bool abstractNamespace = false);
+	};
+}
+
+#endif /* DH_UNIXCLIENTSOCKET_HPP */
+
@@ -0,0 +1,89 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_UnixServerSocket.hpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 10:24 AM
+ */
+
+#ifndef DH_UNIXSERVERSOCKET_HPP
+#define DH_UNIXSERVERSOCKET_HPP
+
+#include "DH_Socket.hpp"
+#include "DH_UnixSocket.hpp"
+
+#include <sys/socket.h>
+
+namespace DigitalHaze {
+
+	class UnixServerSocket : public Socket {
+	public:
+		UnixServerSocket();
+		~UnixServerSocket();
+
+		// Creates our listener on the specified path.
+		// socketType is either SOCK_STREAM or SOCK_SEQPACKET.
+		// If abstractNamespace is true, the listener is bound to a name in
+		// the Linux abstract namespace and nothing is created on the
+		// filesystem. Otherwise a stale socket file left at path by an
+		// earlier listener is removed before binding, and the file is
+		// removed again when the listener is closed. If another listener
+		// still accepts on path, this fails with EADDRINUSE.
+		bool CreateListener(const char* path, int socketType = SOCK_STREAM,
+							bool abstractNamespace = false);
+
+		// Retrieves a new client connection. Blocks until there is a new
+		// connection present, so add this socket to a SocketPool as a
+		// passive socket and only call this when it is readable.
+		// If an error occurs, null is returned.
+		UnixSocket* GetNewConnection();
+
+		// Override of closing a socket. Removes our socket file as well.
+		virtual void CloseSocket() override;
+
+		inline bool isListening() {
+			return Socket::sockfd != -1;
+		}
+
+		inline int GetSocketType() const {
+			return socketType;
+		}
+	private:
+		int socketType;
+
+		// The address we're bound to, so we can clean up the socket file.
+		UnixAddressStorage boundAddress;
+		bool boundToFilesystem;
+
+		// Returns true if nobody accepts on the socket file at addr,
+		// so it was left behind and can be removed.
+		static bool IsStaleSocketFile(const UnixAddressStorage& addr,
+									socklen_t addrLen, int sockType);
+	};
+}
+
+#endif /* DH_UNIXSERVERSOCKET_HPP */
+
@@ -0,0 +1,164 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_UnixSocket.hpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 9:12 AM
+ */
+
+#ifndef DH_UNIXSOCKET_HPP
+#define DH_UNIXSOCKET_HPP
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <deque>
+
+#include "DH_Socket.hpp"
+
+// The largest single message we expect on a SOCK_SEQPACKET socket.
+// Space for one of these is guaranteed before every receive, since
+// the kernel discards whatever part of a message does not fit.
+#ifndef DHUNIXMAXMSGSIZE
+#define DHUNIXMAXMSGSIZE 65536
+#endif
+
+namespace DigitalHaze {
+
+	union UnixAddressStorage {
+		sockaddr sa;
+		sockaddr_un sa_unix;
+	};
+
+	class UnixSocket : public IOSocket {
+		// Our client and server set up the socket type of new connections.
+		friend class UnixClientSocket;
+		friend class UnixServerSocket;
+	public:
+		UnixSocket();
+		// socketType is either SOCK_STREAM or SOCK_SEQPACKET
+		explicit UnixSocket(int connectedfd, int socketType = SOCK_STREAM);
+		virtual ~UnixSocket();
+
+		// Perform a read into our internal read buffer.
+		// If len is zero, any amount of data is read in.
+		// If flush is true, then this function will block until
+		// the specified amount of bytes is read.
+		// If len is zero and flush is true, then the call will block
+		// until the read buffer is full.
+		// On a SOCK_SEQPACKET socket, whole messages are read in and
+		// their boundaries are remembered. Flushing blocks until at least
+		// len bytes worth of messages (or one message if len is zero)
+		// have been received.
+		virtual bool PerformSocketRead(size_t len = 0, bool flush = false) override;
+
+		// Perform a write from our outgoing buffer.
+		// If flush is set to true, then the function will
+		// block until all data in our outgoing buffer is sent.
+		// On a SOCK_SEQPACKET socket, every Write call is sent as
+		// its own message.
+		// Returns false on error, true on success.
+		virtual bool PerformSocketWrite(bool flush = false) override;
+
+		// Read data into caller provided buffer. See IOSocket::Read.
+		// On a SOCK_SEQPACKET socket all data passes through our internal
+		// buffer so message boundaries are kept.
+		virtual bool Read(void* outBuffer, size_t len) override;
+
+		// Write data from caller provided buffer into internal outgoing
+		// buffer. On a SOCK_SEQPACKET socket, the data forms one message.
+		virtual void Write(void* inBuffer, size_t len) override;
+
+		// Returns the length of the next complete message in our read
+		// buffer. Returns zero if there is no message waiting, or if the
+		// socket is not a SOCK_SEQPACKET socket.
+		size_t GetNextMessageLen();
+
+		// Reads the next complete message into the passed buffer.
+		// Returns the length of the message. If there is not enough
+		// space to store the message, the length of the message is returned
+		// (check if return is greater than maxLen for errors), and no read
+		// takes place. Returns zero if there is no message waiting.
+		size_t ReadMessage(void* outBuffer, size_t maxLen);
+
+		// When we close our connection, we forget our message boundaries.
+		virtual void CloseSocket() override;
+
+		// Let's you know if you're connected or not.
+		bool isConnected() const;
+
+		// Returns SOCK_STREAM or SOCK_SEQPACKET
+
+		inline int GetSocketType() const {
+			return socketType;
+		}
+
+		// Sets the largest message we can receive on a SOCK_SEQPACKET socket.
+
+		inline void SetMaxMessageSize(size_t maxSize) {
+			maxMessageSize = maxSize ? maxSize : DHUNIXMAXMSGSIZE;
+		}
+
+		inline size_t GetMaxMessageSize() const {
+			return maxMessageSize;
+		}
+
+		// Builds a unix address from a path. If abstractNamespace is true,
+		// the path is a name in the Linux abstract namespace and no file is
+		// created on the filesystem. Returns false if the path is too long.
+		static bool BuildAddress(const char* path, bool abstractNamespace,
+								UnixAddressStorage& addrOut,
+								socklen_t& addrLenOut);
+	private:
+		int socketType;
+		size_t maxMessageSize;
+
+		// Message boundaries are recorded as absolute positions in the
+		// stream of bytes that have gone through our buffers. This way
+		// anything that consumes data from a buffer (Read, ReadString,
+		// ClearIngressData, ...) keeps the boundaries correct.
+		uint64_t ingressTotal;
+		uint64_t egressTotal;
+		std::deque<uint64_t> ingressBoundaries;
+		std::deque<uint64_t> egressBoundaries;
+
+		bool PerformStreamRead(size_t len, bool flush);
+		bool PerformStreamWrite(bool flush);
+		bool PerformMessageRead(size_t len, bool flush);
+		bool PerformMessageWrite(bool flush);
+
+		// Discards boundaries of messages that were already consumed.
+		void TrimIngressBoundaries();
+		void TrimEgressBoundaries();
+
+		void ResetBoundaries();
+	};
+}
+
+#endif /* DH_UNIXSOCKET_HPP */
+
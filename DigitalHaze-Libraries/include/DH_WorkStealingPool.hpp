@@ -0,0 +1,284 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2026 phytress.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * File:   DH_WorkStealingPool.hpp
+ * Author: phytress
+ *
+ * Created on October 18, 2026, 8:00 PM
+ */
+
+#ifndef DH_WORKSTEALINGPOOL_HPP
+#define DH_WORKSTEALINGPOOL_HPP
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include "DH_ChaseLevDeque.hpp"
+#include "DH_MPSCQueue.hpp"
+#include "DH_ThreadLockedObject.hpp"
+
+// Every this many tasks, a worker looks at the tasks submitted from
+// outside the pool before its own, so they aren't starved by tasks that
+// keep submitting more.
+#ifndef DH_WORKSTEALING_INJECTINTERVAL
+#define DH_WORKSTEALING_INJECTINTERVAL 61
+#endif
+// Most tasks a worker takes from outside the pool at once
+#ifndef DH_WORKSTEALING_INJECTBATCH
+#define DH_WORKSTEALING_INJECTBATCH 32
+#endif
+// How many tasks a SerialQueue runs before it lets other work go first.
+#ifndef DH_SERIALQUEUE_BATCH
+#define DH_SERIALQUEUE_BATCH 32
+#endif
+
+namespace DigitalHaze {
+
+	class WorkStealingPool;
+	class SerialQueue;
+
+	// A task for a WorkStealingPool.
+	typedef void (*WorkTask)(void* pParam);
+
+	struct WorkStealingStats {
+		uint64_t tasksRun;
+		uint64_t tasksStolen; // Run by another worker than they were given to
+		uint64_t parks; // Times a worker ran out of work and went to sleep
+	};
+
+	// Runs tasks on a number of worker threads. Every worker has a
+	// Chase-Lev deque of its own, and a worker that runs out of work
+	// steals the oldest tasks of the others, so a burst of work handed
+	// to one worker spreads over all of them.
+	// Tasks submitted from outside the pool, like a thread polling a
+	// SocketPool, wait in a shared queue until a worker takes them, a
+	// batch at a time. Tasks submitted by a worker stay with it until
+	// someone steals them.
+	// A typical use is to keep socket IO on the polling thread, and hand
+	// whole messages (see IOSocket::DetachMessage) to a connection's
+	// SerialQueue. Workers must not touch the socket itself. They send
+	// their results with SocketPool::PostWrite, which is safe from any
+	// thread.
+	class WorkStealingPool {
+		friend class SerialQueue;
+	public:
+		// workerCount is the number of threads. Zero uses one per CPU we're
+		// allowed to run on.
+		explicit WorkStealingPool(size_t workerCount = 0);
+		// Stops and joins all workers.
+		~WorkStealingPool();
+
+		// Starts the workers. Returns false if the pool is already
+		// running, or if a thread could not be created (see
+		// GetLastError). Nothing is left running on failure.
+		// Tasks can be submitted before the workers start.
+		bool Start();
+
+		// Asks the workers to stop once they run out of work. Does not
+		// wait for them, so it can be called from a task.
+		void Stop();
+
+		// Waits for all workers to stop, then runs whatever was submitted
+		// in the meantime on the calling thread. Call Stop first.
+		void Join();
+
+		// Queues a task. Safe from any thread, including a task.
+		void Submit(WorkTask task, void* pParam = nullptr);
+
+		// Returns true if the calling thread is one of our workers.
+		bool IsWorkerThread() const;
+
+		inline bool isRunning() const {
+			return running;
+		}
+
+		inline size_t GetWorkerCount() const {
+			return workers.size();
+		}
+
+		// Adds up the counters of all workers. Safe from any thread.
+		void GetStats(WorkStealingStats& statsOut) const;
+
+		// Retrieve the last errno caused by Start.
+
+		inline int GetLastError() const {
+			return lasterrno;
+		}
+	private:
+
+		struct workItem {
+			WorkTask task;
+			void* pParam;
+			// Deleted once it ran. SerialQueue reuses an item of its own.
+			bool ownedByPool;
+		};
+
+		struct worker {
+			WorkStealingPool* pool;
+			size_t index;
+
+			ChaseLevDeque<workItem*> deque;
+
+			pthread_t thread;
+			bool threadStarted;
+
+			// Set while the worker sleeps, or is about to. Whoever gives
+			// it work clears this and signals parkCond under parkLock.
+			std::atomic<bool> parked;
+			ThreadLockedObject parkLock;
+			pthread_cond_t parkCond;
+
+			// For picking who to steal from
+			uint32_t randomState;
+			// Tasks run, for DH_WORKSTEALING_INJECTINTERVAL
+			uint32_t tick;
+
+			std::atomic<uint64_t> tasksRun;
+			std::atomic<uint64_t> tasksStolen;
+			std::atomic<uint64_t> parks;
+
+			worker(WorkStealingPool* parentPool, size_t workerIndex);
+			~worker();
+		};
+
+		std::vector<worker*> workers;
+		std::atomic<size_t> parkedWorkers;
+
+		// Tasks submitted from outside the pool, oldest first.
+		// injectedCount can be checked without the lock.
+		ThreadLockedObject injectLock;
+		std::deque<workItem*> injected;
+		std::atomic<size_t> injectedCount;
+
+		bool running;
+		std::atomic<bool> stopRequested;
+		int lasterrno;
+
+		// Queues an item on the calling worker, or with Inject.
+		void Schedule(workItem* item);
+
+		// Queues an item behind everything submitted from outside.
+		void Inject(workItem* item);
+
+		// Our thread's loop
+		void Run(worker* self);
+
+		// Finds work for self: its own deque, then what was submitted from
+		// outside, then the other workers. Returns null if there was none.
+		workItem* FindWork(worker* self);
+
+		// Takes a batch of what was submitted from outside. The first item
+		// is returned, the rest go on self's deque. self can be null.
+		workItem* TakeInjected(worker* self);
+
+		// Steals one item from another worker.
+		workItem* StealWork(worker* self);
+
+		// Returns true if anything is queued that a worker could take.
+		bool HasWork();
+
+		// Puts self to sleep until someone wakes it, or until it sees
+		// work or a stop request after announcing that it's parked.
+		void Park(worker* self);
+
+		// Wakes a worker if it's parked. Returns false if it wasn't.
+		bool Unpark(worker* target);
+
+		// Wakes one parked worker, if there is one.
+		void UnparkIdleWorker();
+
+		// self is null when Join runs leftovers.
+		void RunItem(worker* self, workItem* item);
+
+		// Deletes all workers. They must not be running.
+		void DestroyWorkers();
+
+		// Our thread needs access to our internals
+		friend void* WorkStealingPoolThread(void*);
+
+		// Not copyable
+		WorkStealingPool(const WorkStealingPool&);
+		WorkStealingPool& operator=(const WorkStealingPool&);
+	};
+
+	// Runs the tasks submitted to it one at a time, in the order they were
+	// submitted, on whichever worker of a WorkStealingPool is free. Tasks
+	// of different queues run in parallel. One queue per connection keeps
+	// a connection's messages in order, while connections spread over
+	// all cores.
+	// A queue only occupies a worker while it has tasks, and lets other
+	// work go first every DH_SERIALQUEUE_BATCH tasks.
+	class SerialQueue {
+	public:
+		explicit SerialQueue(WorkStealingPool& workPool);
+		// The queue must be idle. Tasks still queued are not run.
+		~SerialQueue();
+
+		// Queues a task. Safe from any thread, including a task.
+		void Submit(WorkTask task, void* pParam = nullptr);
+
+		// Returns true if no task is queued or running. Useful before
+		// destroying the queue.
+
+		inline bool IsIdle() const {
+			return pending.load(std::memory_order_acquire) == 0;
+		}
+
+		inline WorkStealingPool& GetPool() {
+			return pool;
+		}
+	private:
+
+		struct serialTask {
+			WorkTask task;
+			void* pParam;
+		};
+
+		WorkStealingPool& pool;
+		MPSCQueue<serialTask> tasks;
+
+		// Tasks submitted but not yet finished. Whoever takes this from
+		// zero schedules us.
+		std::atomic<size_t> pending;
+
+		// What we schedule on the pool to run our tasks
+		WorkStealingPool::workItem runItem;
+
+		// Runs a batch of our tasks on a worker.
+		static void RunBatch(void* pParam);
+
+		// Not copyable
+		SerialQueue(const SerialQueue&);
+		SerialQueue& operator=(const SerialQueue&);
+	};
+
+	void* WorkStealingPoolThread(void*);
+}
+
+#endif /* DH_WORKSTEALINGPOOL_HPP */